@@ -8,13 +8,21 @@
 #define auxFunction_hpp
 
 #include "fs.h"
+#include "fsExt.h"
+#include "compressao.hpp"
+#include "caminho.hpp"
+#include "dispositivo.hpp"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <vector>
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <string_view>
+#include <unordered_map>
+#include <openssl/evp.h>
 
 using namespace std;
 
@@ -42,498 +50,2738 @@ int getBitMapSize(int numBlocks)
   return (int)ceil(numBlocks / 8.0);
 }
 
-// Função para pegar o primeiro inode livre
-int getFreeInode(unsigned char numInodes, vector<INODE> inodes)
+// Função para pegar o primeiro inode livre. Retorna -1 se não houver.
+int getFreeInode(unsigned char numInodes, const vector<INODE> &inodes)
 {
-  int inodeIndex = 0;
   for (int i = 0; i < numInodes; i++)
   {
     if (inodes[i].IS_USED == 0x00)
     {
-      inodeIndex = i;
-      break;
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Superbloco estendido: fica depois do vetor de blocos e só existe em imagens criadas com alguma feature.
+// Imagens sem features têm exatamente o layout original.
+// MAGIC (4 bytes) | FEATURES (1 byte) | flags de cada inode (numInodes bytes)
+// Com FS_FEATURE_DEDUP: | referências de cada bloco (numBlocks bytes) | hash de cada bloco (numBlocks * 8 bytes)
+// Com FS_FEATURE_GROUPS: | descritor de cada grupo (blocos livres, inodes livres, diretórios: 3 bytes)
+// Com FS_FEATURE_COUNTERS: | blocos livres, inodes livres, diretórios (1 byte cada) | bytes usados (2 bytes, little-endian)
+// FS_FEATURE_EXTENTS não acrescenta nada aqui: os arquivos com INODE_EXTENTS guardam extensões no lugar dos ponteiros.
+const char MAGIC_EXTENSAO[4] = {'E', 'X', 'T', '3'};
+
+// Flags de inode guardadas no superbloco estendido.
+const unsigned char INODE_COMPRIMIDO = 0x01;
+const unsigned char INODE_EXTENTS = 0x02;
+
+// Extensão de um arquivo (FS_FEATURE_EXTENTS): quantidade blocos lógicos, a partir de logico, guardados em blocos
+// consecutivos a partir de inicio. Nos 9 bytes de ponteiros do inode cabem EXTENTS_NO_INODE extensões (quantidade 0 =
+// posição vazia). Com mais, a primeira posição vira um índice {EXTENT_INDICE, bloco folha, número de extensões} e
+// as extensões ficam no bloco folha, uma após a outra.
+typedef struct
+{
+  unsigned char logico;
+  unsigned char inicio;
+  unsigned char quantidade;
+} EXTENT;
+
+const int EXTENTS_NO_INODE = 3;
+const unsigned char EXTENT_INDICE = 0xFF;
+
+// Descritor de um grupo de blocos (como o group descriptor do ext3).
+typedef struct
+{
+  unsigned char blocosLivres;
+  unsigned char inodesLivres;
+  unsigned char diretorios;
+} GRUPO;
+
+/**
+ * @brief Calcula a divisão em grupos. Como no ext3, cada grupo tem 8 * blockSize blocos (o mapa de bits do grupo
+ * ocupa exatamente um bloco) e uma fatia proporcional da tabela de inodes. Sem FS_FEATURE_GROUPS há um único grupo.
+ * O mapa de bits global e a tabela de inodes são a concatenação das partes de cada grupo, então o layout não muda.
+ */
+void geometriaGrupos(int blockSize, int numBlocks, int numInodes, int features, int &blocosPorGrupo, int &inodesPorGrupo, int &numGrupos)
+{
+  blocosPorGrupo = (features & FS_FEATURE_GROUPS) ? min(8 * blockSize, numBlocks) : numBlocks;
+  numGrupos = (numBlocks + blocosPorGrupo - 1) / blocosPorGrupo;
+  inodesPorGrupo = (numInodes + numGrupos - 1) / numGrupos;
+}
+
+// Totais da imagem, mantidos a cada alteração junto com os contadores dos grupos; gravados com FS_FEATURE_COUNTERS.
+typedef struct
+{
+  int blocosLivres;
+  int inodesLivres;
+  int diretorios;
+  int bytesUsados;                          // soma do SIZE dos arquivos (no máximo 255 * 255)
+} TOTAIS;
+
+// Tamanho dos totais no superbloco estendido.
+const int TAMANHO_TOTAIS = 5;
+
+// Features cujos contadores são gravados: qualquer alteração nos contadores altera o superbloco estendido.
+const int FEATURES_CONTADORES = FS_FEATURE_GROUPS | FS_FEATURE_COUNTERS;
+
+// Conteúdo de um arquivo que ainda não recebeu blocos (alocação adiada).
+typedef struct
+{
+  int inode;
+  int pai;
+  string conteudo;
+  int reservados; // blocos livres reservados para o conteúdo (somados em IMAGEM::blocosReservados)
+} ESCRITA_PENDENTE;
+
+// Estado de uma imagem aberta.
+// O cabeçalho, o mapa de bits e os inodes são lidos de uma vez; os blocos são lidos sob demanda.
+// Apenas o mapa de bits, os inodes e os blocos marcados como alterados são gravados de volta.
+typedef struct
+{
+  DISPOSITIVO *dispositivo;
+  unsigned char blockSize, numBlocks, numInodes, root;
+  int bitMapSize;
+  vector<unsigned char> bitMap;
+  vector<INODE> inodes;
+  vector<vector<unsigned char>> blocos;
+  vector<bool> blocoCarregado;
+  vector<bool> blocoAlterado;
+  vector<bool> inodeAlterado;
+  bool bitMapAlterado;
+
+  // Superbloco estendido (features == 0 em imagens sem extensão).
+  unsigned char features;
+  vector<unsigned char> flagsInode;
+  bool extensaoAlterada;
+
+  // Extents: em memória os arquivos sempre usam os 9 ponteiros; as extensões são montadas ao gravar os inodes e
+  // desfeitas ao ler. Bloco folha de cada inode com mais de EXTENTS_NO_INODE extensões (-1 se não houver).
+  vector<int> folhaExtents;
+
+  // Deduplicação: quantos ponteiros de arquivo apontam para cada bloco (0 = bloco não deduplicado,
+  // ex. blocos de diretório), os 8 primeiros bytes do SHA-256 de cada bloco e o índice hash -> bloco.
+  vector<unsigned char> refBloco;
+  vector<unsigned long long> hashBloco;
+  unordered_map<unsigned long long, int> indiceHash;
+
+  // Alocação adiada: os arquivos recebem blocos apenas em alocarPendentes. Os blocos de que eles vão precisar ficam
+  // reservados desde o addFile: nenhuma outra alocação usa os blocos reservados, então o flush sempre encontra espaço.
+  bool alocacaoAdiada;
+  vector<ESCRITA_PENDENTE> pendentes;
+  int blocosReservados;
+
+  // Política de alocação de blocos (FS_ALLOC_POLICY) e cursor da política next-fit.
+  int politica;
+  int cursor;
+
+  // Grupos de blocos. Os contadores são mantidos a cada alteração; só são gravados com FS_FEATURE_GROUPS.
+  int blocosPorGrupo;
+  int inodesPorGrupo;
+  vector<GRUPO> grupos;
+  TOTAIS totais;
+} IMAGEM;
+
+int grupoDoBloco(const IMAGEM &img, int bloco)
+{
+  return bloco / img.blocosPorGrupo;
+}
+
+int grupoDoInode(const IMAGEM &img, int inode)
+{
+  return inode / img.inodesPorGrupo;
+}
+
+// Função para dividir a imagem em grupos (segundo as features), com os contadores zerados.
+void definirGrupos(IMAGEM &img)
+{
+  int numGrupos;
+  geometriaGrupos(img.blockSize, img.numBlocks, img.numInodes, img.features, img.blocosPorGrupo, img.inodesPorGrupo, numGrupos);
+  img.grupos.assign(numGrupos, GRUPO());
+}
+
+/**
+ * @brief Conta os contadores dos grupos e os totais a partir do mapa de bits e dos inodes.
+ * @param img estado da imagem, com a divisão em grupos já definida.
+ * @param grupos contadores de cada grupo.
+ * @param totais totais da imagem.
+ */
+void contarGrupos(const IMAGEM &img, vector<GRUPO> &grupos, TOTAIS &totais)
+{
+  grupos.assign(img.grupos.size(), GRUPO());
+  totais = TOTAIS();
+  for (int i = 0; i < img.numBlocks; i++)
+  {
+    if (!((img.bitMap[i / 8] >> (i % 8)) & 0x01))
+    {
+      grupos[grupoDoBloco(img, i)].blocosLivres++;
+      totais.blocosLivres++;
+    }
+  }
+  for (int i = 0; i < img.numInodes; i++)
+  {
+    if (img.inodes[i].IS_USED == 0x00)
+    {
+      grupos[grupoDoInode(img, i)].inodesLivres++;
+      totais.inodesLivres++;
+    }
+    else if (img.inodes[i].IS_DIR == 0x01)
+    {
+      grupos[grupoDoInode(img, i)].diretorios++;
+      totais.diretorios++;
+    }
+    else
+    {
+      totais.bytesUsados += (unsigned char)img.inodes[i].SIZE;
+    }
+  }
+}
+
+// Função para recalcular os contadores dos grupos e os totais.
+void recontarGrupos(IMAGEM &img)
+{
+  definirGrupos(img);
+  contarGrupos(img, img.grupos, img.totais);
+}
+
+// Totais no formato gravado no superbloco estendido.
+void codificarTotais(const TOTAIS &totais, unsigned char saida[TAMANHO_TOTAIS])
+{
+  saida[0] = totais.blocosLivres;
+  saida[1] = totais.inodesLivres;
+  saida[2] = totais.diretorios;
+  saida[3] = totais.bytesUsados & 0xFF;
+  saida[4] = (totais.bytesUsados >> 8) & 0xFF;
+}
+
+void decodificarTotais(const unsigned char entrada[TAMANHO_TOTAIS], TOTAIS &totais)
+{
+  totais.blocosLivres = entrada[0];
+  totais.inodesLivres = entrada[1];
+  totais.diretorios = entrada[2];
+  totais.bytesUsados = entrada[3] | (entrada[4] << 8);
+}
+
+// Posição do vetor de inodes no arquivo: 3 bytes de cabeçalho + mapa de bits.
+long offsetInodes(const IMAGEM &img)
+{
+  return 3 + img.bitMapSize;
+}
+
+// Posição do vetor de blocos no arquivo: inodes + 1 byte do índice da raiz.
+long offsetBlocos(const IMAGEM &img)
+{
+  return offsetInodes(img) + img.numInodes * (long)sizeof(INODE) + 1;
+}
+
+// Posição do superbloco estendido no arquivo: logo após o vetor de blocos.
+long offsetExtensao(const IMAGEM &img)
+{
+  return offsetBlocos(img) + (long)img.numBlocks * img.blockSize;
+}
+
+// Função para ler o superbloco estendido, se existir.
+void lerExtensao(IMAGEM &img)
+{
+  img.features = 0x00;
+  img.flagsInode.assign(img.numInodes, 0x00);
+  img.extensaoAlterada = false;
+
+  char magic[4];
+  long posicao = offsetExtensao(img);
+  if (!lerDispositivo(*img.dispositivo, posicao, magic, 4) || memcmp(magic, MAGIC_EXTENSAO, 4) != 0)
+  {
+    recontarGrupos(img);
+    return;
+  }
+  lerDispositivo(*img.dispositivo, posicao + 4, &img.features, 1);
+  lerDispositivo(*img.dispositivo, posicao + 5, &img.flagsInode[0], img.numInodes);
+  posicao += 5 + img.numInodes;
+
+  if (img.features & FS_FEATURE_DEDUP)
+  {
+    img.refBloco.assign(img.numBlocks, 0x00);
+    img.hashBloco.assign(img.numBlocks, 0);
+    lerDispositivo(*img.dispositivo, posicao, &img.refBloco[0], img.numBlocks);
+    lerDispositivo(*img.dispositivo, posicao + img.numBlocks, &img.hashBloco[0], img.numBlocks * sizeof(unsigned long long));
+    posicao += img.numBlocks * (1 + sizeof(unsigned long long));
+
+    // O índice em memória é montado a partir da tabela gravada na imagem.
+    img.indiceHash.clear();
+    for (int i = 0; i < img.numBlocks; i++)
+    {
+      if (img.refBloco[i] > 0)
+      {
+        img.indiceHash.insert(make_pair(img.hashBloco[i], i));
+      }
+    }
+  }
+
+  // Com grupos e totais gravados, os contadores vêm do superbloco; sem, são contados a partir do mapa de bits e dos
+  // inodes (que já estão carregados).
+  if ((img.features & FEATURES_CONTADORES) != FEATURES_CONTADORES)
+  {
+    recontarGrupos(img);
+  }
+  if (img.features & FS_FEATURE_GROUPS)
+  {
+    definirGrupos(img);
+    lerDispositivo(*img.dispositivo, posicao, &img.grupos[0], img.grupos.size() * sizeof(GRUPO));
+    posicao += img.grupos.size() * sizeof(GRUPO);
+  }
+  if (img.features & FS_FEATURE_COUNTERS)
+  {
+    unsigned char totais[TAMANHO_TOTAIS];
+    lerDispositivo(*img.dispositivo, posicao, totais, TAMANHO_TOTAIS);
+    decodificarTotais(totais, img.totais);
+  }
+}
+
+// Função para montar os bytes do superbloco estendido.
+void montarExtensao(const IMAGEM &img, vector<unsigned char> &extensao)
+{
+  extensao.clear();
+  acrescentarBytes(extensao, MAGIC_EXTENSAO, 4);
+  acrescentarBytes(extensao, &img.features, 1);
+  acrescentarBytes(extensao, &img.flagsInode[0], img.numInodes);
+  if (img.features & FS_FEATURE_DEDUP)
+  {
+    acrescentarBytes(extensao, &img.refBloco[0], img.numBlocks);
+    acrescentarBytes(extensao, &img.hashBloco[0], img.numBlocks * sizeof(unsigned long long));
+  }
+  if (img.features & FS_FEATURE_GROUPS)
+  {
+    acrescentarBytes(extensao, &img.grupos[0], img.grupos.size() * sizeof(GRUPO));
+  }
+  if (img.features & FS_FEATURE_COUNTERS)
+  {
+    unsigned char totais[TAMANHO_TOTAIS];
+    codificarTotais(img.totais, totais);
+    acrescentarBytes(extensao, totais, TAMANHO_TOTAIS);
+  }
+}
+
+// Função para gravar o superbloco estendido.
+void gravarExtensao(IMAGEM &img)
+{
+  vector<unsigned char> extensao;
+  montarExtensao(img, extensao);
+  escreverDispositivo(*img.dispositivo, offsetExtensao(img), extensao.data(), extensao.size());
+  img.extensaoAlterada = false;
+}
+
+/**
+ * @brief Lê só o cabeçalho e os totais gravados no superbloco estendido, sem carregar a imagem.
+ * @param dispositivo dispositivo da imagem.
+ * @param cabecalho blockSize, numBlocks e numInodes.
+ * @param totais totais gravados.
+ * @return false se a imagem não tiver FS_FEATURE_COUNTERS.
+ */
+bool lerTotais(DISPOSITIVO &dispositivo, unsigned char cabecalho[3], TOTAIS &totais)
+{
+  lerDispositivo(dispositivo, 0, cabecalho, 3);
+  int blockSize = cabecalho[0], numBlocks = cabecalho[1], numInodes = cabecalho[2];
+  long posicao = 3 + getBitMapSize(numBlocks) + numInodes * (long)sizeof(INODE) + 1 + (long)numBlocks * blockSize;
+
+  char magic[4];
+  unsigned char features;
+  if (!lerDispositivo(dispositivo, posicao, magic, 4) || memcmp(magic, MAGIC_EXTENSAO, 4) != 0 ||
+      !lerDispositivo(dispositivo, posicao + 4, &features, 1) || !(features & FS_FEATURE_COUNTERS))
+  {
+    return false;
+  }
+  posicao += 5 + numInodes;
+  if (features & FS_FEATURE_DEDUP)
+  {
+    posicao += numBlocks * (1 + sizeof(unsigned long long));
+  }
+  if (features & FS_FEATURE_GROUPS)
+  {
+    int blocosPorGrupo, inodesPorGrupo, numGrupos;
+    geometriaGrupos(blockSize, numBlocks, numInodes, features, blocosPorGrupo, inodesPorGrupo, numGrupos);
+    posicao += numGrupos * sizeof(GRUPO);
+  }
+  unsigned char bytes[TAMANHO_TOTAIS];
+  if (!lerDispositivo(dispositivo, posicao, bytes, TAMANHO_TOTAIS))
+  {
+    return false;
+  }
+  decodificarTotais(bytes, totais);
+  return true;
+}
+
+// Função para alterar as flags de um inode. Não faz nada em imagens sem superbloco estendido.
+void definirFlagsInode(IMAGEM &img, int inode, unsigned char flags)
+{
+  if (img.features != 0x00 && img.flagsInode[inode] != flags)
+  {
+    img.flagsInode[inode] = flags;
+    img.extensaoAlterada = true;
+  }
+}
+
+// Os 9 ponteiros do inode (DIRECT_BLOCKS, INDIRECT_BLOCKS e DOUBLE_INDIRECT_BLOCKS) são usados em sequência.
+// Função para acessar o j-ésimo ponteiro de blocos do inode, j de 0 a 8.
+unsigned char &ponteiroBloco(INODE &inode, int j)
+{
+  if (j < 3)
+  {
+    return inode.DIRECT_BLOCKS[j];
+  }
+  if (j < 6)
+  {
+    return inode.INDIRECT_BLOCKS[j - 3];
+  }
+  return inode.DOUBLE_INDIRECT_BLOCKS[j - 6];
+}
+
+// Função para obter o tamanho do inode sem sinal (o campo SIZE é um char).
+int tamanhoInode(const INODE &inode)
+{
+  return (unsigned char)inode.SIZE;
+}
+
+// Função para juntar os ponteiros de um arquivo em extensões. Buracos (ponteiros 0x00) não entram.
+void montarExtents(INODE inode, vector<EXTENT> &extents)
+{
+  extents.clear();
+  for (int j = 0; j < 9; j++)
+  {
+    int bloco = ponteiroBloco(inode, j);
+    if (bloco == 0x00)
+    {
+      continue;
+    }
+    if (!extents.empty())
+    {
+      EXTENT &ultima = extents.back();
+      if (ultima.logico + ultima.quantidade == j && ultima.inicio + ultima.quantidade == bloco)
+      {
+        ultima.quantidade++;
+        continue;
+      }
+    }
+    EXTENT extent = {(unsigned char)j, (unsigned char)bloco, 1};
+    extents.push_back(extent);
+  }
+}
+
+// Função para obter um inode como é gravado: com INODE_EXTENTS, as extensões (ou o índice da folha) no lugar dos ponteiros.
+INODE codificarInode(const IMAGEM &img, int inode)
+{
+  INODE disco = img.inodes[inode];
+  if (!(img.flagsInode[inode] & INODE_EXTENTS))
+  {
+    return disco;
+  }
+  vector<EXTENT> extents;
+  montarExtents(disco, extents);
+  for (int j = 0; j < 9; j++)
+  {
+    ponteiroBloco(disco, j) = 0x00;
+  }
+  if (extents.size() > EXTENTS_NO_INODE)
+  {
+    ponteiroBloco(disco, 0) = EXTENT_INDICE;
+    ponteiroBloco(disco, 1) = img.folhaExtents[inode];
+    ponteiroBloco(disco, 2) = extents.size();
+    return disco;
+  }
+  for (int k = 0; k < extents.size(); k++)
+  {
+    ponteiroBloco(disco, 3 * k) = extents[k].logico;
+    ponteiroBloco(disco, 3 * k + 1) = extents[k].inicio;
+    ponteiroBloco(disco, 3 * k + 2) = extents[k].quantidade;
+  }
+  return disco;
+}
+
+/**
+ * @brief Desfaz as extensões de um inode gravado com INODE_EXTENTS, deixando os 9 ponteiros usados em memória.
+ * Extensões fora dos 9 blocos lógicos e folhas inválidas são ignoradas (o fsck acusa o mapa de bits).
+ * @param registro inode como gravado; recebe os ponteiros.
+ * @param numBlocks quantidade de blocos da imagem.
+ * @param blockSize tamanho do bloco.
+ * @param dadosBloco função que devolve o conteúdo de um bloco pelo número (para ler a folha).
+ * @return bloco folha; -1 se as extensões estiverem no próprio inode.
+ */
+template <typename LEITOR>
+int decodificarInode(INODE &registro, int numBlocks, int blockSize, LEITOR dadosBloco)
+{
+  unsigned char mapa[9];
+  for (int j = 0; j < 9; j++)
+  {
+    mapa[j] = ponteiroBloco(registro, j);
+    ponteiroBloco(registro, j) = 0x00;
+  }
+  int folha = -1;
+  int numExtents = EXTENTS_NO_INODE;
+  const unsigned char *extents = mapa;
+  if (mapa[0] == EXTENT_INDICE)
+  {
+    numExtents = 0;
+    if (mapa[1] < numBlocks && mapa[2] * (int)sizeof(EXTENT) <= blockSize)
+    {
+      folha = mapa[1];
+      numExtents = mapa[2];
+      extents = dadosBloco(folha);
+    }
+  }
+  for (int k = 0; k < numExtents; k++)
+  {
+    int logico = extents[3 * k], inicio = extents[3 * k + 1], quantidade = extents[3 * k + 2];
+    for (int t = 0; t < quantidade && logico + t < 9; t++)
+    {
+      ponteiroBloco(registro, logico + t) = inicio + t;
+    }
+  }
+  return folha;
+}
+
+/**
+ * @brief Lê o cabeçalho, o mapa de bits, os inodes e a raiz de uma imagem. Os blocos não são lidos aqui.
+ * @param dispositivo dispositivo aberto que contém um sistema de arquivos que simula EXT3.
+ * @param img estrutura que recebe o estado da imagem.
+ */
+void carregarImagem(DISPOSITIVO *dispositivo, IMAGEM &img)
+{
+  img.dispositivo = dispositivo;
+
+  unsigned char cabecalho[3];
+  lerDispositivo(*dispositivo, 0, cabecalho, 3);
+  img.blockSize = cabecalho[0];
+  img.numBlocks = cabecalho[1];
+  img.numInodes = cabecalho[2];
+
+  img.bitMapSize = getBitMapSize(img.numBlocks);
+  img.bitMap.assign(img.bitMapSize, 0x00);
+  img.inodes.assign(img.numInodes, INODE());
+
+  lerDispositivo(*dispositivo, 3, &img.bitMap[0], img.bitMapSize);
+  lerDispositivo(*dispositivo, offsetInodes(img), &img.inodes[0], img.numInodes * sizeof(INODE));
+  lerDispositivo(*dispositivo, offsetBlocos(img) - 1, &img.root, 1);
+
+  img.blocos.assign(img.numBlocks, vector<unsigned char>());
+  img.blocoCarregado.assign(img.numBlocks, false);
+  img.blocoAlterado.assign(img.numBlocks, false);
+  img.inodeAlterado.assign(img.numInodes, false);
+  img.bitMapAlterado = false;
+
+  lerExtensao(img);
+
+  img.folhaExtents.assign(img.numInodes, -1);
+  vector<unsigned char> folha(img.blockSize);
+  for (int i = 0; (img.features & FS_FEATURE_EXTENTS) && i < img.numInodes; i++)
+  {
+    if (img.inodes[i].IS_USED == 0x01 && (img.flagsInode[i] & INODE_EXTENTS))
+    {
+      img.folhaExtents[i] = decodificarInode(img.inodes[i], img.numBlocks, img.blockSize, [&](int bloco)
+                                             {
+                                               lerDispositivo(*dispositivo, offsetBlocos(img) + (long)bloco * img.blockSize, &folha[0], img.blockSize);
+                                               return &folha[0]; });
+    }
+  }
+
+  img.alocacaoAdiada = false;
+  img.pendentes.clear();
+  img.blocosReservados = 0;
+  img.politica = FS_ALLOC_FIRST_FIT;
+  img.cursor = 0;
+}
+
+// Função para obter o conteúdo de um bloco, lendo do arquivo na primeira vez que é acessado.
+unsigned char *lerBloco(IMAGEM &img, int bloco)
+{
+  if (!img.blocoCarregado[bloco])
+  {
+    img.blocos[bloco].assign(img.blockSize, 0x00);
+    lerDispositivo(*img.dispositivo, offsetBlocos(img) + (long)bloco * img.blockSize, &img.blocos[bloco][0], img.blockSize);
+    img.blocoCarregado[bloco] = true;
+  }
+  return &img.blocos[bloco][0];
+}
+
+// Função para obter o conteúdo de um bloco que será modificado.
+unsigned char *escreverBloco(IMAGEM &img, int bloco)
+{
+  unsigned char *dados = lerBloco(img, bloco);
+  img.blocoAlterado[bloco] = true;
+  return dados;
+}
+
+/**
+ * @brief Grava no arquivo os blocos marcados como alterados. Cada sequência de blocos alterados vira uma faixa, e
+ * todas as faixas vão ao dispositivo em um único lote.
+ * @param img estado da imagem aberta.
+ * @param gravou recebe true se algum bloco foi gravado.
+ * @return false se alguma gravação falhar.
+ */
+bool gravarBlocos(IMAGEM &img, bool &gravou)
+{
+  vector<vector<unsigned char>> sequencias;
+  vector<long> posicoes;
+  for (int i = 0; i < img.numBlocks; i++)
+  {
+    if (!img.blocoAlterado[i])
+    {
+      continue;
+    }
+    posicoes.push_back(offsetBlocos(img) + (long)i * img.blockSize);
+    sequencias.push_back(vector<unsigned char>());
+    while (i < img.numBlocks && img.blocoAlterado[i])
+    {
+      sequencias.back().insert(sequencias.back().end(), img.blocos[i].begin(), img.blocos[i].end());
+      img.blocoAlterado[i] = false;
+      i++;
+    }
+  }
+  vector<FAIXA> faixas(sequencias.size());
+  for (int i = 0; i < sequencias.size(); i++)
+  {
+    faixas[i].posicao = posicoes[i];
+    faixas[i].dados = &sequencias[i][0];
+    faixas[i].tamanho = sequencias[i].size();
+  }
+  gravou = !faixas.empty();
+  return escreverLote(*img.dispositivo, faixas);
+}
+
+/**
+ * @brief Grava no arquivo os metadados alterados: mapa de bits, inodes e superbloco estendido, em um único lote.
+ * Inodes alterados consecutivos formam uma só faixa.
+ * @param img estado da imagem aberta.
+ * @param gravou recebe true se algo foi gravado.
+ * @return false se alguma gravação falhar.
+ */
+bool gravarMetadados(IMAGEM &img, bool &gravou)
+{
+  vector<FAIXA> faixas;
+  if (img.bitMapAlterado)
+  {
+    FAIXA faixa = {3, &img.bitMap[0], (size_t)img.bitMapSize};
+    faixas.push_back(faixa);
+    img.bitMapAlterado = false;
+  }
+
+  // Com extents, os inodes são gravados a partir de uma cópia no formato do disco.
+  vector<INODE> disco;
+  if (img.features & FS_FEATURE_EXTENTS)
+  {
+    disco.resize(img.numInodes);
+  }
+  for (int i = 0; i < img.numInodes; i++)
+  {
+    if (!img.inodeAlterado[i])
+    {
+      continue;
+    }
+    int fim = i;
+    while (fim < img.numInodes && img.inodeAlterado[fim])
+    {
+      if (!disco.empty())
+      {
+        disco[fim] = codificarInode(img, fim);
+      }
+      img.inodeAlterado[fim] = false;
+      fim++;
+    }
+    INODE *origem = disco.empty() ? &img.inodes[i] : &disco[i];
+    FAIXA faixa = {offsetInodes(img) + i * (long)sizeof(INODE), (unsigned char *)origem, (fim - i) * sizeof(INODE)};
+    faixas.push_back(faixa);
+    i = fim;
+  }
+
+  vector<unsigned char> extensao;
+  if (img.extensaoAlterada)
+  {
+    montarExtensao(img, extensao);
+    FAIXA faixa = {offsetExtensao(img), &extensao[0], extensao.size()};
+    faixas.push_back(faixa);
+    img.extensaoAlterada = false;
+  }
+  gravou = !faixas.empty();
+  return escreverLote(*img.dispositivo, faixas);
+}
+
+/**
+ * @brief Grava no arquivo apenas o que foi alterado: blocos, mapa de bits e inodes marcados.
+ * @param img estado da imagem aberta.
+ * @return false se alguma gravação falhar.
+ */
+bool gravarImagem(IMAGEM &img)
+{
+  bool gravou;
+  bool blocos = gravarBlocos(img, gravou);
+  return gravarMetadados(img, gravou) && blocos;
+}
+
+// Função para saber se um bloco está marcado como usado no mapa de bits.
+bool blocoUsado(const IMAGEM &img, int bloco)
+{
+  return (img.bitMap[bloco / 8] >> (bloco % 8)) & 0x01;
+}
+
+// Função para marcar um bloco como usado ou livre no mapa de bits.
+void marcarBloco(IMAGEM &img, int bloco, bool usado)
+{
+  if (blocoUsado(img, bloco) != usado)
+  {
+    img.grupos[grupoDoBloco(img, bloco)].blocosLivres += usado ? -1 : 1;
+    img.totais.blocosLivres += usado ? -1 : 1;
+    img.extensaoAlterada = img.extensaoAlterada || (img.features & FEATURES_CONTADORES);
+  }
+  if (usado)
+  {
+    img.bitMap[bloco / 8] |= (1 << (bloco % 8));
+  }
+  else
+  {
+    img.bitMap[bloco / 8] &= ~(1 << (bloco % 8));
+  }
+  img.bitMapAlterado = true;
+}
+
+// Função para soltar n referências de um bloco. Blocos deduplicados só são liberados quando a última referência sai.
+void soltarBloco(IMAGEM &img, int bloco, int n)
+{
+  if ((img.features & FS_FEATURE_DEDUP) && img.refBloco[bloco] > 0)
+  {
+    img.refBloco[bloco] = max(0, img.refBloco[bloco] - n);
+    img.extensaoAlterada = true;
+    if (img.refBloco[bloco] > 0)
+    {
+      return;
+    }
+    unordered_map<unsigned long long, int>::iterator it = img.indiceHash.find(img.hashBloco[bloco]);
+    if (it != img.indiceHash.end() && it->second == bloco)
+    {
+      img.indiceHash.erase(it);
+    }
+  }
+  marcarBloco(img, bloco, false);
+}
+
+// Função para pegar o primeiro bloco livre no mapa de bits. Retorna -1 se não houver.
+int getFreeBlock(const IMAGEM &img)
+{
+  for (int i = 0; i < img.numBlocks; i++)
+  {
+    if (!blocoUsado(img, i))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Função para calcular quantos blocos um conteúdo ocupa.
+int blocosNecessarios(const IMAGEM &img, int tamanho)
+{
+  return (int)ceil((double)tamanho / (double)img.blockSize);
+}
+
+// Função para saber se uma faixa de bytes é toda 0x00. Os bytes são combinados com OU 8 de cada vez, sem desvio
+// dentro do laço, para o compilador vetorizar.
+bool faixaZerada(const unsigned char *dados, int tamanho)
+{
+  unsigned long long acumulado = 0;
+  int i = 0;
+  for (; i + 8 <= tamanho; i += 8)
+  {
+    unsigned long long palavra;
+    memcpy(&palavra, dados + i, 8);
+    acumulado |= palavra;
+  }
+  for (; i < tamanho; i++)
+  {
+    acumulado |= dados[i];
+  }
+  return acumulado == 0;
+}
+
+// Função para saber se o i-ésimo bloco de um arquivo vira um buraco: um ponteiro 0x00, sem bloco alocado, que é lido
+// como um bloco de zeros. Só em arquivos não comprimidos (nos comprimidos o ponteiro 0x00 marca o fim dos dados).
+bool blocoBuraco(const IMAGEM &img, const string &conteudo, int i, bool comprimido)
+{
+  int inicio = i * img.blockSize;
+  return !comprimido && faixaZerada((const unsigned char *)conteudo.data() + inicio, min((int)img.blockSize, (int)conteudo.size() - inicio));
+}
+
+// Função para escolher os n primeiros blocos livres (first-fit). Não marca os blocos no mapa de bits.
+// Retorna false se não houver blocos livres suficientes.
+bool escolherPrimeirosLivres(const IMAGEM &img, int n, vector<int> &blocos)
+{
+  blocos.clear();
+  for (int i = 0; i < img.numBlocks && (int)blocos.size() < n; i++)
+  {
+    if (!blocoUsado(img, i))
+    {
+      blocos.push_back(i);
+    }
+  }
+  return (int)blocos.size() == n;
+}
+
+// Função para buscar a primeira sequência de n blocos livres consecutivos. Retorna -1 se não houver.
+int buscarSequenciaLivre(const IMAGEM &img, int n)
+{
+  int inicio = 0;
+  int tamanho = 0;
+  for (int i = 0; i < img.numBlocks; i++)
+  {
+    if (blocoUsado(img, i))
+    {
+      inicio = i + 1;
+      tamanho = 0;
+      continue;
+    }
+    tamanho++;
+    if (tamanho == n)
+    {
+      return inicio;
+    }
+  }
+  return -1;
+}
+
+// Função para buscar a menor sequência de blocos livres consecutivos com pelo menos n blocos. Retorna -1 se não houver.
+int buscarMelhorSequencia(const IMAGEM &img, int n)
+{
+  int melhor = -1;
+  int tamanhoMelhor = 0;
+  int inicio = 0;
+  for (int i = 0; i <= img.numBlocks; i++)
+  {
+    if (i < img.numBlocks && !blocoUsado(img, i))
+    {
+      continue;
+    }
+    int tamanho = i - inicio;
+    if (tamanho >= n && (melhor == -1 || tamanho < tamanhoMelhor))
+    {
+      melhor = inicio;
+      tamanhoMelhor = tamanho;
+    }
+    inicio = i + 1;
+  }
+  return melhor;
+}
+
+// Função para escolher até n blocos livres percorrendo o disco em círculo a partir de um bloco.
+// Com contiguos, procura primeiro uma sequência de n blocos livres que comece a partir do bloco.
+bool escolherAPartirDe(const IMAGEM &img, int n, int partida, bool contiguos, vector<int> &blocos)
+{
+  blocos.clear();
+  if (contiguos)
+  {
+    for (int k = 0; k < img.numBlocks; k++)
+    {
+      int inicio = (partida + k) % img.numBlocks;
+      int tamanho = 0;
+      while (tamanho < n && inicio + tamanho < img.numBlocks && !blocoUsado(img, inicio + tamanho))
+      {
+        tamanho++;
+      }
+      if (tamanho == n)
+      {
+        for (int j = 0; j < n; j++)
+        {
+          blocos.push_back(inicio + j);
+        }
+        return true;
+      }
+    }
+  }
+  for (int k = 0; k < img.numBlocks && (int)blocos.size() < n; k++)
+  {
+    int i = (partida + k) % img.numBlocks;
+    if (!blocoUsado(img, i))
+    {
+      blocos.push_back(i);
+    }
+  }
+  return (int)blocos.size() == n;
+}
+
+/**
+ * @brief Escolhe n blocos livres segundo a política de alocação da imagem. Não marca os blocos no mapa de bits.
+ * Todas as políticas encontram blocos sempre que houver n blocos livres; só muda quais são escolhidos.
+ * @param img estado da imagem aberta.
+ * @param n quantidade de blocos.
+ * @param objetivo bloco perto do qual os novos blocos devem ficar (FS_ALLOC_GOAL); -1 se não houver.
+ * @param blocos blocos escolhidos, na ordem em que devem ser usados.
+ * @return false se não houver n blocos livres.
+ */
+bool escolherBlocos(IMAGEM &img, int n, int objetivo, vector<int> &blocos)
+{
+  if (n == 0)
+  {
+    blocos.clear();
+    return true;
+  }
+  // Os blocos reservados para a alocação adiada não podem ser usados por outras alocações.
+  if (img.totais.blocosLivres - img.blocosReservados < n)
+  {
+    return false;
+  }
+
+  // Com extents, cada sequência contígua é uma extensão só: first-fit e next-fit procuram antes uma sequência inteira.
+  bool contiguos = img.features & FS_FEATURE_EXTENTS;
+  switch (img.politica)
+  {
+  case FS_ALLOC_NEXT_FIT:
+    // Continua de onde a última alocação parou.
+    if (!escolherAPartirDe(img, n, img.cursor, contiguos, blocos))
+    {
+      return false;
+    }
+    img.cursor = (blocos.back() + 1) % img.numBlocks;
+    return true;
+  case FS_ALLOC_BEST_FIT:
+  {
+    // Menor buraco em que o conteúdo cabe inteiro; sem buraco grande o bastante, first-fit.
+    int inicio = buscarMelhorSequencia(img, n);
+    if (inicio != -1)
+    {
+      blocos.clear();
+      for (int j = 0; j < n; j++)
+      {
+        blocos.push_back(inicio + j);
+      }
+      return true;
+    }
+    break;
+  }
+  case FS_ALLOC_GOAL:
+    // O mais perto possível (para frente) do bloco do diretório pai, de preferência contíguo.
+    if (objetivo != -1)
+    {
+      return escolherAPartirDe(img, n, objetivo, true, blocos);
+    }
+    break;
+  }
+
+  // Com grupos, o first-fit começa no grupo do objetivo e segue pelos grupos seguintes.
+  if ((img.features & FS_FEATURE_GROUPS) && objetivo != -1)
+  {
+    return escolherAPartirDe(img, n, grupoDoBloco(img, objetivo) * img.blocosPorGrupo, contiguos, blocos);
+  }
+  if (contiguos)
+  {
+    return escolherAPartirDe(img, n, 0, true, blocos);
+  }
+  return escolherPrimeirosLivres(img, n, blocos);
+}
+
+// Função para obter a i-ésima entrada (índice de inode) de um diretório.
+// A entrada i fica no bloco i / blockSize do diretório, na posição i % blockSize.
+int entradaDiretorio(IMAGEM &img, int dir, int i)
+{
+  int bloco = ponteiroBloco(img.inodes[dir], i / img.blockSize);
+  return lerBloco(img, bloco)[i % img.blockSize];
+}
+
+/**
+ * @brief Lê antecipadamente os blocos de um inode que ainda não estão em memória, todos em um único lote
+ * (uma submissão no io_uring), em vez de um bloco por vez em lerBloco.
+ * @param img estado da imagem aberta.
+ * @param inode diretório ou arquivo.
+ */
+void carregarBlocos(IMAGEM &img, int inode)
+{
+  bool diretorio = img.inodes[inode].IS_DIR == 0x01;
+  bool comprimido = img.flagsInode[inode] & INODE_COMPRIMIDO;
+  int numBlocos = comprimido ? 9 : (int)ceil((double)tamanhoInode(img.inodes[inode]) / img.blockSize);
+  vector<FAIXA> faixas;
+  for (int j = 0; j < numBlocos && j < 9; j++)
+  {
+    int bloco = ponteiroBloco(img.inodes[inode], j);
+    // Em arquivos, o ponteiro 0x00 é um bloco de zeros (ou o fim dos dados comprimidos); em diretórios é o bloco 0.
+    if (bloco == 0x00 && !diretorio)
+    {
+      continue;
+    }
+    if (bloco >= img.numBlocks || img.blocoCarregado[bloco])
+    {
+      continue;
+    }
+    img.blocos[bloco].assign(img.blockSize, 0x00);
+    img.blocoCarregado[bloco] = true;
+    FAIXA faixa = {offsetBlocos(img) + (long)bloco * img.blockSize, &img.blocos[bloco][0], (size_t)img.blockSize};
+    faixas.push_back(faixa);
+  }
+  lerLote(*img.dispositivo, faixas);
+}
+
+/**
+ * @brief Escolhe o formato do mapa de blocos de um arquivo recém-gravado em uma imagem com FS_FEATURE_EXTENTS.
+ * Até EXTENTS_NO_INODE extensões ficam no próprio inode; mais que isso vão para um bloco folha, alocado agora.
+ * Se as extensões não couberem em um bloco ou não houver bloco livre para a folha, o arquivo fica com os ponteiros.
+ * @param img estado da imagem aberta.
+ * @param inode arquivo com os ponteiros já definidos.
+ */
+void mapearExtents(IMAGEM &img, int inode)
+{
+  if (!(img.features & FS_FEATURE_EXTENTS))
+  {
+    return;
+  }
+  if (img.folhaExtents[inode] != -1)
+  {
+    soltarBloco(img, img.folhaExtents[inode], 1);
+    img.folhaExtents[inode] = -1;
+  }
+
+  vector<EXTENT> extents;
+  montarExtents(img.inodes[inode], extents);
+  unsigned char flags = img.flagsInode[inode] | INODE_EXTENTS;
+  if (extents.size() > EXTENTS_NO_INODE)
+  {
+    vector<int> folha;
+    if (extents.size() * sizeof(EXTENT) <= img.blockSize && escolherBlocos(img, 1, extents[0].inicio, folha))
+    {
+      unsigned char *dados = escreverBloco(img, folha[0]);
+      memset(dados, 0x00, img.blockSize);
+      memcpy(dados, &extents[0], extents.size() * sizeof(EXTENT));
+      marcarBloco(img, folha[0], true);
+      img.folhaExtents[inode] = folha[0];
+    }
+    else
+    {
+      flags &= ~INODE_EXTENTS;
+    }
+  }
+  definirFlagsInode(img, inode, flags);
+  img.inodeAlterado[inode] = true;
+}
+
+// Função para obter o índice do inode de um filho de um diretório pelo nome. Retorna -1 se não existir.
+int buscarFilho(IMAGEM &img, int dir, const NOME_INODE &nome)
+{
+  carregarBlocos(img, dir);
+  for (int i = 0; i < tamanhoInode(img.inodes[dir]); i++)
+  {
+    int filho = entradaDiretorio(img, dir, i);
+    if (mesmoNome(img.inodes[filho].NAME, nome))
+    {
+      return filho;
+    }
+  }
+  return -1;
+}
+
+// Função para obter o índice do inode de um caminho absoluto, resolvendo componente a componente a partir da raiz.
+// Retorna -1 se algum componente do caminho não existir (ou não couber no campo NAME) ou se o caminho atravessar
+// o inode evitar (usado para não mover um diretório para dentro de si mesmo).
+int resolverCaminho(IMAGEM &img, string_view path, int evitar = -1)
+{
+  int atual = img.root;
+  size_t posicao = 0;
+  string_view componente;
+  NOME_INODE nome;
+  while (proximoComponente(path, posicao, componente))
+  {
+    if (img.inodes[atual].IS_DIR != 0x01 || !prepararNome(componente, nome))
+    {
+      return -1;
+    }
+    atual = buscarFilho(img, atual, nome);
+    if (atual == -1 || atual == evitar)
+    {
+      return -1;
+    }
+  }
+  return atual;
+}
+
+/**
+ * @brief Resolve o diretório pai de um caminho e converte o último componente, para criar, mover ou remover.
+ * @param img estado da imagem aberta.
+ * @param path caminho completo.
+ * @param nome último componente no formato do campo NAME.
+ * @param evitar inode que o caminho do pai não pode atravessar (-1: nenhum).
+ * @return inode do pai; -1 se o pai não existir, não for diretório, o caminho for a raiz ou o nome for inválido
+ * (vazio ou com mais de 10 bytes).
+ */
+int resolverPai(IMAGEM &img, string_view path, NOME_INODE &nome, int evitar = -1)
+{
+  string_view caminhoPai, componente;
+  separarCaminho(path, caminhoPai, componente);
+  if (!prepararNome(componente, nome))
+  {
+    return -1;
+  }
+  int pai = resolverCaminho(img, caminhoPai, evitar);
+  if (pai == -1 || pai == evitar || img.inodes[pai].IS_DIR != 0x01)
+  {
+    return -1;
+  }
+  return pai;
+}
+
+// Função para preencher uma entrada de diretório com os dados de um inode (o nome aponta para o próprio inode).
+void preencherEntrada(IMAGEM &img, int inode, FS_DIRENT &entrada)
+{
+  entrada.inode = inode;
+  entrada.name = img.inodes[inode].NAME;
+  entrada.nameLength = strnlen(img.inodes[inode].NAME, 10);
+  entrada.isDir = img.inodes[inode].IS_DIR == 0x01;
+  entrada.size = tamanhoInode(img.inodes[inode]);
+}
+
+/**
+ * @brief Percorre em profundidade a subárvore de um diretório com uma pilha de tamanho fixo (a profundidade
+ * não passa da quantidade de inodes), sem alocar memória por entrada.
+ * @param img estado da imagem aberta.
+ * @param dir inode do diretório inicial.
+ * @param enter callback de pré-ordem (pode podar).
+ * @param leave callback de pós-ordem dos diretórios (pode ser NULL).
+ * @param context ponteiro repassado aos callbacks.
+ * @return false se um callback pedir FS_WALK_STOP.
+ */
+bool percorrerArvore(IMAGEM &img, int dir, FS_WALK_CALLBACK enter, FS_WALK_CALLBACK leave, void *context)
+{
+  // Cada nível guarda o diretório, a próxima posição a visitar e a entrada do próprio diretório.
+  int pilhaDir[256];
+  int pilhaPosicao[256];
+  FS_DIRENT pilhaEntrada[256];
+  int topo = 0;
+  pilhaDir[0] = dir;
+  pilhaPosicao[0] = 0;
+
+  while (topo >= 0)
+  {
+    int atual = pilhaDir[topo];
+    if (pilhaPosicao[topo] >= tamanhoInode(img.inodes[atual]))
+    {
+      if (topo > 0 && leave != NULL && leave(pilhaEntrada[topo], topo - 1, context) == FS_WALK_STOP)
+      {
+        return false;
+      }
+      topo--;
+      continue;
+    }
+
+    FS_DIRENT entrada;
+    preencherEntrada(img, entradaDiretorio(img, atual, pilhaPosicao[topo]), entrada);
+    pilhaPosicao[topo]++;
+
+    FS_WALK_ACTION acao = enter(entrada, topo, context);
+    if (acao == FS_WALK_STOP)
+    {
+      return false;
+    }
+    if (entrada.isDir && acao != FS_WALK_SKIP && topo + 1 < 256)
+    {
+      topo++;
+      pilhaDir[topo] = entrada.inode;
+      pilhaPosicao[topo] = 0;
+      pilhaEntrada[topo] = entrada;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Retira um filho da lista de entradas de um diretório.
+ * As entradas seguintes são deslocadas uma posição (B[j] = B[j+1]) e, se o diretório passar a caber em menos blocos,
+ * o último bloco é liberado. O primeiro bloco do diretório nunca é liberado.
+ * @param img estado da imagem aberta.
+ * @param pai índice do inode do diretório.
+ * @param filho índice do inode a ser retirado.
+ */
+void desvincularEntrada(IMAGEM &img, int pai, int filho)
+{
+  int tamanho = tamanhoInode(img.inodes[pai]);
+  int k = 0;
+  while (k < tamanho && entradaDiretorio(img, pai, k) != filho)
+  {
+    k++;
+  }
+  if (k == tamanho)
+  {
+    return;
+  }
+
+  for (int j = k; j < tamanho - 1; j++)
+  {
+    int bloco = ponteiroBloco(img.inodes[pai], j / img.blockSize);
+    escreverBloco(img, bloco)[j % img.blockSize] = entradaDiretorio(img, pai, j + 1);
+  }
+  tamanho--;
+  img.inodes[pai].SIZE = tamanho;
+  img.inodeAlterado[pai] = true;
+
+  int blocosNecessarios = max(1, (int)ceil((double)tamanho / img.blockSize));
+  for (int j = blocosNecessarios; j < 9; j++)
+  {
+    unsigned char &ponteiro = ponteiroBloco(img.inodes[pai], j);
+    if (ponteiro != 0x00)
+    {
+      marcarBloco(img, ponteiro, false);
+      ponteiro = 0x00;
+    }
+  }
+}
+
+/**
+ * @brief Acrescenta um filho ao final da lista de entradas de um diretório, alocando um novo bloco se o último estiver cheio.
+ * @param img estado da imagem aberta.
+ * @param pai índice do inode do diretório.
+ * @param filho índice do inode a ser acrescentado.
+ * @return false se não houver espaço no diretório ou bloco livre.
+ */
+bool vincularEntrada(IMAGEM &img, int pai, int filho)
+{
+  int tamanho = tamanhoInode(img.inodes[pai]);
+  int j = tamanho / img.blockSize;
+  if (j >= 9 || tamanho >= MAX_ENTRADAS_DIRETORIO)
+  {
+    return false;
+  }
+
+  unsigned char &ponteiro = ponteiroBloco(img.inodes[pai], j);
+  if (j > 0 && ponteiro == 0x00)
+  {
+    // O novo bloco do diretório fica perto do bloco anterior.
+    vector<int> novoBloco;
+    if (!escolherBlocos(img, 1, ponteiroBloco(img.inodes[pai], j - 1), novoBloco))
+    {
+      return false;
+    }
+    marcarBloco(img, novoBloco[0], true);
+    ponteiro = novoBloco[0];
+  }
+
+  escreverBloco(img, ponteiro)[tamanho % img.blockSize] = filho;
+  img.inodes[pai].SIZE = tamanho + 1;
+  img.inodeAlterado[pai] = true;
+  return true;
+}
+
+/**
+ * @brief Escolhe o inode de uma nova entrada. Sem FS_FEATURE_GROUPS é o primeiro inode livre.
+ * Com grupos, como no ext3: um arquivo fica no grupo do diretório pai e um diretório vai para o grupo com mais blocos
+ * livres (espalha as subárvores); se o grupo não tiver inode livre, os grupos seguintes são tentados em ordem.
+ * @param img estado da imagem aberta.
+ * @param pai índice do inode do diretório pai.
+ * @param dir true se a nova entrada for um diretório.
+ * @return índice do inode ou -1 se não houver inode livre.
+ */
+int escolherInode(IMAGEM &img, int pai, bool dir)
+{
+  if (!(img.features & FS_FEATURE_GROUPS))
+  {
+    return getFreeInode(img.numInodes, img.inodes);
+  }
+
+  int numGrupos = img.grupos.size();
+  int inicio = grupoDoInode(img, pai);
+  if (dir)
+  {
+    for (int g = 0; g < numGrupos; g++)
+    {
+      if (img.grupos[g].inodesLivres > 0 && (img.grupos[inicio].inodesLivres == 0 || img.grupos[g].blocosLivres > img.grupos[inicio].blocosLivres))
+      {
+        inicio = g;
+      }
+    }
+  }
+
+  for (int k = 0; k < numGrupos; k++)
+  {
+    int g = (inicio + k) % numGrupos;
+    if (img.grupos[g].inodesLivres == 0)
+    {
+      continue;
+    }
+    for (int i = g * img.inodesPorGrupo; i < min((int)img.numInodes, (g + 1) * img.inodesPorGrupo); i++)
+    {
+      if (img.inodes[i].IS_USED == 0x00)
+      {
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
+// Função para obter o bloco a partir do qual os blocos de um inode devem ser procurados: com grupos, o início do
+// grupo do inode; sem grupos, o objetivo padrão.
+int objetivoDoInode(const IMAGEM &img, int inode, int objetivoPadrao)
+{
+  if (img.features & FS_FEATURE_GROUPS)
+  {
+    return grupoDoInode(img, inode) * img.blocosPorGrupo;
+  }
+  return objetivoPadrao;
+}
+
+// Função para marcar um inode como usado (zerado, só com IS_USED e IS_DIR), atualizando o grupo.
+void ocuparInode(IMAGEM &img, int inode, bool dir)
+{
+  memset(&img.inodes[inode], 0x00, sizeof(INODE));
+  img.inodes[inode].IS_USED = 0x01;
+  img.inodes[inode].IS_DIR = dir ? 0x01 : 0x00;
+  img.inodeAlterado[inode] = true;
+
+  GRUPO &grupo = img.grupos[grupoDoInode(img, inode)];
+  grupo.inodesLivres--;
+  grupo.diretorios += dir;
+  img.totais.inodesLivres--;
+  img.totais.diretorios += dir;
+  img.extensaoAlterada = img.extensaoAlterada || (img.features & FEATURES_CONTADORES);
+}
+
+// Função para definir o tamanho de um arquivo, atualizando os bytes usados.
+void definirTamanho(IMAGEM &img, int inode, int tamanho)
+{
+  img.totais.bytesUsados += tamanho - (unsigned char)img.inodes[inode].SIZE;
+  img.inodes[inode].SIZE = tamanho;
+  img.extensaoAlterada = img.extensaoAlterada || (img.features & FS_FEATURE_COUNTERS);
+}
+
+// Função para liberar um inode (zerado), atualizando o grupo e os totais.
+void liberarInode(IMAGEM &img, int inode)
+{
+  GRUPO &grupo = img.grupos[grupoDoInode(img, inode)];
+  if (img.inodes[inode].IS_USED == 0x01)
+  {
+    bool dir = img.inodes[inode].IS_DIR == 0x01;
+    grupo.inodesLivres++;
+    grupo.diretorios -= dir;
+    img.totais.inodesLivres++;
+    img.totais.diretorios -= dir;
+    img.totais.bytesUsados -= dir ? 0 : (unsigned char)img.inodes[inode].SIZE;
+    img.extensaoAlterada = img.extensaoAlterada || (img.features & FEATURES_CONTADORES);
+  }
+  memset(&img.inodes[inode], 0x00, sizeof(INODE));
+  img.inodeAlterado[inode] = true;
+  img.folhaExtents[inode] = -1;
+  definirFlagsInode(img, inode, 0x00);
+}
+
+/**
+ * @brief Mede a fragmentação dos arquivos (extensões) e do espaço livre (sequências de blocos livres).
+ * @param img estado da imagem aberta.
+ * @param stats métricas calculadas.
+ */
+void medirFragmentacao(IMAGEM &img, FS_FRAG_STATS &stats)
+{
+  memset(&stats, 0, sizeof(stats));
+  for (int i = 0; i < img.numInodes; i++)
+  {
+    if (img.inodes[i].IS_USED != 0x01 || img.inodes[i].IS_DIR == 0x01)
+    {
+      continue;
+    }
+    int anterior = -1;
+    int extensoes = 0;
+    for (int j = 0; j < 9; j++)
+    {
+      int bloco = ponteiroBloco(img.inodes[i], j);
+      if (bloco == 0x00)
+      {
+        continue;
+      }
+      if (bloco != anterior + 1)
+      {
+        extensoes++;
+      }
+      anterior = bloco;
+      stats.fileBlocks++;
+    }
+    if (extensoes > 0)
+    {
+      stats.files++;
+      stats.extents += extensoes;
+      stats.fragmentedFiles += extensoes > 1;
+    }
+  }
+  stats.averageExtentLength = stats.extents > 0 ? (double)stats.fileBlocks / stats.extents : 0;
+
+  int tamanho = 0;
+  for (int i = 0; i <= img.numBlocks; i++)
+  {
+    if (i < img.numBlocks && !blocoUsado(img, i))
+    {
+      tamanho++;
+      continue;
+    }
+    if (tamanho > 0)
+    {
+      int k = 0;
+      while ((2 << k) <= tamanho)
+      {
+        k++;
+      }
+      stats.freeBlocks += tamanho;
+      stats.freeRuns++;
+      stats.largestFreeRun = max(stats.largestFreeRun, tamanho);
+      stats.freeRunHistogram[k]++;
+    }
+    tamanho = 0;
+  }
+}
+
+/**
+ * @brief Confere as entradas dos diretórios, os contadores mantidos a cada alteração (grupos e totais) e o mapa de
+ * bits contra uma contagem a partir dos inodes. Usada pelo fsck.
+ * @param img estado da imagem aberta, sem escritas pendentes.
+ * @param problemas uma mensagem por divergência encontrada.
+ */
+void verificarImagem(IMAGEM &img, vector<string> &problemas)
+{
+  char mensagem[128];
+
+  // Cada entrada de um diretório usado aponta para um inode usado.
+  for (int i = 0; i < img.numInodes; i++)
+  {
+    for (int k = 0; img.inodes[i].IS_USED == 0x01 && img.inodes[i].IS_DIR == 0x01 && k < tamanhoInode(img.inodes[i]); k++)
+    {
+      int filho = entradaDiretorio(img, i, k);
+      if (filho >= img.numInodes || img.inodes[filho].IS_USED != 0x01)
+      {
+        snprintf(mensagem, sizeof(mensagem), "directory inode %d has an entry for inode %d, which is not in use", i, filho);
+        problemas.push_back(mensagem);
+      }
+    }
+  }
+
+  // Blocos referenciados pelos inodes usados. O bloco 0 é sempre do diretório raiz; um ponteiro 0x00 não usa bloco.
+  vector<int> donoDoBloco(img.numBlocks, -1);
+  donoDoBloco[0] = 0;
+  for (int i = 0; i < img.numInodes; i++)
+  {
+    INODE inode = img.inodes[i];
+    for (int j = 0; inode.IS_USED == 0x01 && j < 9; j++)
+    {
+      int bloco = ponteiroBloco(inode, j);
+      if (bloco >= img.numBlocks)
+      {
+        snprintf(mensagem, sizeof(mensagem), "inode %d points to block %d, beyond the last block", i, bloco);
+        problemas.push_back(mensagem);
+      }
+      else if (bloco != 0x00)
+      {
+        donoDoBloco[bloco] = i;
+      }
+    }
+    if (inode.IS_USED == 0x01 && img.folhaExtents[i] != -1)
+    {
+      donoDoBloco[img.folhaExtents[i]] = i;
+    }
+  }
+  for (int b = 0; b < img.numBlocks; b++)
+  {
+    bool usado = (img.bitMap[b / 8] >> (b % 8)) & 0x01;
+    if (usado != (donoDoBloco[b] != -1))
+    {
+      if (usado)
+      {
+        snprintf(mensagem, sizeof(mensagem), "block %d is marked used but no inode points to it", b);
+      }
+      else
+      {
+        snprintf(mensagem, sizeof(mensagem), "block %d is used by inode %d but marked free", b, donoDoBloco[b]);
+      }
+      problemas.push_back(mensagem);
+    }
+  }
+
+  vector<GRUPO> grupos;
+  TOTAIS totais;
+  contarGrupos(img, grupos, totais);
+  for (int g = 0; g < grupos.size(); g++)
+  {
+    if (memcmp(&grupos[g], &img.grupos[g], sizeof(GRUPO)) != 0)
+    {
+      snprintf(mensagem, sizeof(mensagem), "group %d counters are %d/%d/%d (free blocks/free inodes/dirs), expected %d/%d/%d", g,
+               img.grupos[g].blocosLivres, img.grupos[g].inodesLivres, img.grupos[g].diretorios, grupos[g].blocosLivres,
+               grupos[g].inodesLivres, grupos[g].diretorios);
+      problemas.push_back(mensagem);
+    }
+  }
+  const char *nomes[] = {"free blocks", "free inodes", "dirs", "used bytes"};
+  int gravados[] = {img.totais.blocosLivres, img.totais.inodesLivres, img.totais.diretorios, img.totais.bytesUsados};
+  int contados[] = {totais.blocosLivres, totais.inodesLivres, totais.diretorios, totais.bytesUsados};
+  for (int i = 0; i < 4; i++)
+  {
+    if (gravados[i] != contados[i])
+    {
+      snprintf(mensagem, sizeof(mensagem), "%s counter is %d, expected %d", nomes[i], gravados[i], contados[i]);
+      problemas.push_back(mensagem);
+    }
+  }
+}
+
+/**
+ * @brief Percorre uma subárvore em pós-ordem marcando os inodes e blocos a liberar.
+ * Os filhos de um diretório são marcados antes do próprio diretório.
+ * @param img estado da imagem aberta.
+ * @param inode raiz da subárvore.
+ * @param inodesLiberar conjunto de inodes a liberar (indexado pelo número do inode).
+ * @param blocosLiberar referências a soltar de cada bloco (indexado pelo número do bloco).
+ */
+void coletarSubarvore(IMAGEM &img, int inode, vector<bool> &inodesLiberar, vector<int> &blocosLiberar)
+{
+  if (inodesLiberar[inode])
+  {
+    return;
+  }
+
+  if (img.inodes[inode].IS_DIR == 0x01)
+  {
+    for (int i = 0; i < tamanhoInode(img.inodes[inode]); i++)
+    {
+      coletarSubarvore(img, entradaDiretorio(img, inode, i), inodesLiberar, blocosLiberar);
+    }
+  }
+
+  inodesLiberar[inode] = true;
+  for (int j = 0; j < 9; j++)
+  {
+    unsigned char ponteiro = ponteiroBloco(img.inodes[inode], j);
+    if (ponteiro != 0x00)
+    {
+      blocosLiberar[ponteiro]++;
+    }
+  }
+  if (img.folhaExtents[inode] != -1)
+  {
+    blocosLiberar[img.folhaExtents[inode]]++;
+  }
+}
+
+/**
+ * @brief Remove um arquivo ou diretório (recursivamente) em uma única passada.
+ * A subárvore é percorrida uma vez, os inodes e blocos são liberados em lote e o mapa de bits é atualizado em uma passada.
+ * @param img estado da imagem aberta.
+ * @param path caminho completo do arquivo ou diretório a ser removido.
+ * @return false se o caminho não existir ou for a raiz.
+ */
+bool removerCaminho(IMAGEM &img, string_view path)
+{
+  NOME_INODE nome;
+  int inodePai = resolverPai(img, path, nome);
+  int inodeRemover = inodePai == -1 ? -1 : buscarFilho(img, inodePai, nome);
+  if (inodeRemover == -1)
+  {
+    return false;
+  }
+
+  vector<bool> inodesLiberar(img.numInodes, false);
+  vector<int> blocosLiberar(img.numBlocks, 0);
+  coletarSubarvore(img, inodeRemover, inodesLiberar, blocosLiberar);
+
+  desvincularEntrada(img, inodePai, inodeRemover);
+
+  // Zerar os inodes liberados.
+  for (int i = 0; i < img.numInodes; i++)
+  {
+    if (inodesLiberar[i])
+    {
+      liberarInode(img, i);
+    }
+  }
+
+  // Arquivos ainda sem blocos (alocação adiada) que estavam na subárvore são descartados, com a reserva.
+  for (int i = (int)img.pendentes.size() - 1; i >= 0; i--)
+  {
+    if (inodesLiberar[img.pendentes[i].inode])
+    {
+      img.blocosReservados -= img.pendentes[i].reservados;
+      img.pendentes.erase(img.pendentes.begin() + i);
+    }
+  }
+
+  // Uma passada no mapa de bits para liberar os blocos. O conteúdo dos blocos não é apagado.
+  for (int i = 0; i < img.numBlocks; i++)
+  {
+    if (blocosLiberar[i] > 0)
+    {
+      soltarBloco(img, i, blocosLiberar[i]);
+    }
+  }
+  return true;
+}
+
+// Função para gravar um nome no campo NAME do inode, preenchendo com 0x00.
+void gravarNome(INODE &inode, const NOME_INODE &nome)
+{
+  memcpy(inode.NAME, nome.bytes, TAMANHO_NOME);
+}
+
+/**
+ * @brief Move ou renomeia um arquivo ou diretório religando apenas as entradas de diretório.
+ * A entrada sai do bloco do pai de origem e entra no bloco do pai de destino; os blocos de dados nunca são copiados.
+ * @param img estado da imagem aberta.
+ * @param oldPath caminho completo do arquivo ou diretório a ser movido.
+ * @param newPath novo caminho completo do arquivo ou diretório.
+ * @return false se a origem não existir, o destino já existir, o destino estiver dentro da origem, o novo nome tiver
+ * mais de 10 bytes ou faltar espaço.
+ */
+bool moverCaminho(IMAGEM &img, string_view oldPath, string_view newPath)
+{
+  NOME_INODE nomeAntigo, nomeNovo;
+  int paiOrigem = resolverPai(img, oldPath, nomeAntigo);
+  int inodeMover = paiOrigem == -1 ? -1 : buscarFilho(img, paiOrigem, nomeAntigo);
+  if (inodeMover == -1)
+  {
+    return false;
+  }
+
+  // Um diretório não pode ser movido para dentro de si mesmo: o caminho do novo pai não pode passar por ele.
+  int paiDestino = resolverPai(img, newPath, nomeNovo, inodeMover);
+  if (paiDestino == -1)
+  {
+    return false;
+  }
+
+  int existente = buscarFilho(img, paiDestino, nomeNovo);
+  if (existente != -1 && existente != inodeMover)
+  {
+    return false;
+  }
+
+  // Primeiro liga no destino: se faltar espaço, nada foi alterado.
+  if (paiOrigem != paiDestino)
+  {
+    if (!vincularEntrada(img, paiDestino, inodeMover))
+    {
+      return false;
+    }
+    desvincularEntrada(img, paiOrigem, inodeMover);
+    for (int i = 0; i < img.pendentes.size(); i++)
+    {
+      if (img.pendentes[i].inode == inodeMover)
+      {
+        img.pendentes[i].pai = paiDestino;
+      }
+    }
+  }
+
+  if (!mesmoNome(img.inodes[inodeMover].NAME, nomeNovo))
+  {
+    gravarNome(img.inodes[inodeMover], nomeNovo);
+    img.inodeAlterado[inodeMover] = true;
+  }
+  return true;
+}
+
+/**
+ * @brief Faz a inicialização do arquivo EXT3 usando o dispositivo aberto. A imagem é montada em memória e gravada
+ * com uma única escrita.
+ * @param dispositivo dispositivo aberto (vazio) que simula EXT3
+ * @param blockSize tamanho em bytes do bloco
+ * @param numBlocks quantidade de blocos
+ * @param numInodes quantidade de inodes
+ * @param features features do superbloco estendido (0 = layout original, sem extensão)
+ */
+void inicializar(DISPOSITIVO &dispositivo, int blockSize, int numBlocks, int numInodes, int features = 0)
+{
+  vector<unsigned char> arquivo;
+
+  // Gravando os três primeiros bytes do arquivo.
+  acrescentarBytes(arquivo, &blockSize, 1);
+  acrescentarBytes(arquivo, &numBlocks, 1);
+  acrescentarBytes(arquivo, &numInodes, 1);
+
+  // Quantidade de bytes que o Mapa de Bits irá ocupar.
+  int bitMapSize = getBitMapSize(numBlocks);
+
+  // Espaço para o Mapa de Bits.
+  vector<unsigned char> bitMap(bitMapSize);
+
+  // Gravar o mapa de bits no arquivo
+  // Apenas o primeiro bloco está sendo usado, pois é o bloco do diretório raiz.
+  bitMap[0] = 0x01;
+  for (int i = 1; i < bitMapSize; i++)
+  {
+    bitMap[i] = 0x00;
+  }
+  acrescentarBytes(arquivo, &bitMap[0], bitMapSize);
+
+  // Espaço para o vetor de inodes.
+  vector<INODE> inodes(numInodes);
+
+  // Raiz do sistema de arquivos é sempre 0.
+  unsigned char root = 0x00;
+
+  // Primeiro inode = inode do diretório raiz.
+  // O inode do diretório raiz recebe 0x01 em usado, 0x01 em tipo, 0x00 em tamanho, '/' em nome e 0x00 em todos os blocos.
+  // O nome é um char de 10 espaços, então é necessário preencher com 0x00.
+  inodes[root].IS_USED = 0x01;
+  inodes[root].IS_DIR = 0x01;
+  inodes[root].NAME[0] = '/';
+  for (int i = 1; i < 10; i++)
+  {
+    inodes[root].NAME[i] = 0x00;
+  }
+  inodes[root].SIZE = 0x00;
+  for (int i = 0; i < 3; i++)
+  {
+    inodes[root].DIRECT_BLOCKS[i] = 0x00;
+    inodes[root].INDIRECT_BLOCKS[i] = 0x00;
+    inodes[root].DOUBLE_INDIRECT_BLOCKS[i] = 0x00;
+  }
+
+  // Os demais inodes recebem 0x00 em tudo.
+  for (int i = 1; i < numInodes; i++)
+  {
+    inodes[i].IS_USED = 0x00;
+    inodes[i].IS_DIR = 0x00;
+    inodes[i].SIZE = 0x00;
+    for (int j = 0; j < 10; j++)
+    {
+      inodes[i].NAME[j] = 0x00;
+    }
+    for (int j = 0; j < 3; j++)
+    {
+      inodes[i].DIRECT_BLOCKS[j] = 0x00;
+      inodes[i].INDIRECT_BLOCKS[j] = 0x00;
+      inodes[i].DOUBLE_INDIRECT_BLOCKS[j] = 0x00;
+    }
+  }
+
+  // Gravando o vetor de inodes no arquivo após o mapa de bits.
+  acrescentarBytes(arquivo, &inodes[0], numInodes * sizeof(INODE));
+
+  // Gravando o indice do inode do diretório raiz no arquivo após o vetor de inodes.
+  acrescentarBytes(arquivo, &root, 1);
+
+  // Espaço para o vetor de blocos.
+  vector<vector<unsigned char>> blocos(numBlocks, vector<unsigned char>(blockSize));
+
+  // Na inicialização, todos os blocos recebem 0x00.
+  for (int i = 0; i < numBlocks; i++)
+  {
+    for (int j = 0; j < blockSize; j++)
+    {
+      blocos[i][j] = 0x00;
+    }
+  }
+
+  // Gravando o vetor de blocos no arquivo após o indice do inode do diretório raiz.
+  for (int i = 0; i < numBlocks; i++)
+  {
+    acrescentarBytes(arquivo, &blocos[i][0], blockSize);
+  }
+
+  // Superbloco estendido após o vetor de blocos, apenas se alguma feature foi pedida.
+  if (features != 0)
+  {
+    unsigned char featuresByte = features;
+    vector<unsigned char> flagsInode(numInodes, 0x00);
+    acrescentarBytes(arquivo, MAGIC_EXTENSAO, 4);
+    acrescentarBytes(arquivo, &featuresByte, 1);
+    acrescentarBytes(arquivo, &flagsInode[0], numInodes);
+    if (features & FS_FEATURE_DEDUP)
+    {
+      vector<unsigned char> refBloco(numBlocks, 0x00);
+      vector<unsigned long long> hashBloco(numBlocks, 0);
+      acrescentarBytes(arquivo, &refBloco[0], numBlocks);
+      acrescentarBytes(arquivo, &hashBloco[0], numBlocks * sizeof(unsigned long long));
+    }
+    if (features & FS_FEATURE_GROUPS)
+    {
+      // Tudo livre, menos o bloco 0 e o inode da raiz (ambos no grupo 0).
+      int blocosPorGrupo, inodesPorGrupo, numGrupos;
+      geometriaGrupos(blockSize, numBlocks, numInodes, features, blocosPorGrupo, inodesPorGrupo, numGrupos);
+      vector<GRUPO> grupos(numGrupos);
+      for (int g = 0; g < numGrupos; g++)
+      {
+        grupos[g].blocosLivres = min(numBlocks, (g + 1) * blocosPorGrupo) - g * blocosPorGrupo - (g == 0);
+        grupos[g].inodesLivres = max(0, min(numInodes, (g + 1) * inodesPorGrupo) - g * inodesPorGrupo) - (g == 0);
+        grupos[g].diretorios = g == 0;
+      }
+      acrescentarBytes(arquivo, &grupos[0], numGrupos * sizeof(GRUPO));
+    }
+    if (features & FS_FEATURE_COUNTERS)
+    {
+      TOTAIS totais = {numBlocks - 1, numInodes - 1, 1, 0};
+      unsigned char bytes[TAMANHO_TOTAIS];
+      codificarTotais(totais, bytes);
+      acrescentarBytes(arquivo, bytes, TAMANHO_TOTAIS);
+    }
+  }
+  escreverDispositivo(dispositivo, 0, arquivo.data(), arquivo.size());
+}
+
+// Função para calcular o hash de um bloco: os 8 primeiros bytes do SHA-256 do conteúdo.
+unsigned long long hashDeBloco(const unsigned char *dados, int tamanho)
+{
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int tamanhoDigest = 0;
+  EVP_Digest(dados, tamanho, digest, &tamanhoDigest, EVP_sha256(), NULL);
+
+  unsigned long long hash;
+  memcpy(&hash, digest, sizeof(hash));
+  return hash;
+}
+
+// Função para montar o i-ésimo bloco de um conteúdo, completando com 0x00.
+void montarBloco(const IMAGEM &img, const string &conteudo, int i, vector<unsigned char> &bloco)
+{
+  bloco.assign(img.blockSize, 0x00);
+  int inicio = i * img.blockSize;
+  int tamanho = min((int)img.blockSize, (int)conteudo.size() - inicio);
+  memcpy(&bloco[0], conteudo.data() + inicio, tamanho);
+}
+
+// Função para procurar um bloco já gravado com o mesmo conteúdo. O conteúdo é comparado para descartar colisões do hash.
+// Retorna -1 se não houver (ou se o contador de referências do bloco estiver no limite).
+int buscarBlocoIgual(IMAGEM &img, unsigned long long hash, const vector<unsigned char> &bloco)
+{
+  unordered_map<unsigned long long, int>::iterator it = img.indiceHash.find(hash);
+  if (it == img.indiceHash.end())
+  {
+    return -1;
+  }
+  int existente = it->second;
+  if (img.refBloco[existente] == 255 || memcmp(lerBloco(img, existente), &bloco[0], img.blockSize) != 0)
+  {
+    return -1;
+  }
+  return existente;
+}
+
+// Função para contar quantos blocos livres um conteúdo vai consumir. Blocos de zeros (buracos) não contam.
+// Com deduplicação, blocos iguais a blocos já gravados ou a blocos anteriores do mesmo conteúdo também não contam.
+int blocosNovos(IMAGEM &img, const string &conteudo, bool comprimido)
+{
+  int n = blocosNecessarios(img, conteudo.size());
+  int novos = 0;
+  unordered_map<unsigned long long, vector<unsigned char>> vistos;
+  vector<unsigned char> bloco;
+  for (int i = 0; i < n; i++)
+  {
+    if (blocoBuraco(img, conteudo, i, comprimido))
+    {
+      continue;
+    }
+    if (!(img.features & FS_FEATURE_DEDUP))
+    {
+      novos++;
+      continue;
+    }
+    montarBloco(img, conteudo, i, bloco);
+    unsigned long long hash = hashDeBloco(&bloco[0], img.blockSize);
+    if (buscarBlocoIgual(img, hash, bloco) != -1 || (vistos.count(hash) && vistos[hash] == bloco))
+    {
+      continue;
     }
+    vistos[hash] = bloco;
+    novos++;
+  }
+  return novos;
+}
+
+// Função para contar os blocos a reservar para um conteúdo pendente: os que não são buracos. A deduplicação não
+// entra na conta, porque o bloco igual pode ser liberado antes do flush.
+int blocosReserva(const IMAGEM &img, const string &conteudo, bool comprimido)
+{
+  int n = 0;
+  for (int i = 0; i < blocosNecessarios(img, conteudo.size()); i++)
+  {
+    n += !blocoBuraco(img, conteudo, i, comprimido);
+  }
+  return n;
+}
+
+/**
+ * @brief Copia o conteúdo de um arquivo para os blocos escolhidos, completando o último bloco com 0x00,
+ * e grava os ponteiros no inode e os blocos no mapa de bits.
+ * Um bloco só de zeros em arquivo não comprimido vira um buraco: ponteiro 0x00, nada alocado nem escrito.
+ * Com deduplicação, um bloco igual a um já gravado não é escrito: o ponteiro aponta para o existente e a referência é contada.
+ * @param img estado da imagem aberta.
+ * @param inode índice do inode do arquivo (com as flags já definidas).
+ * @param conteudo conteúdo do arquivo.
+ * @param blocos blocos livres que vão receber o conteúdo, em ordem (blocosNovos(conteudo) blocos).
+ */
+void gravarConteudo(IMAGEM &img, int inode, const string &conteudo, const vector<int> &blocos)
+{
+  bool dedup = img.features & FS_FEATURE_DEDUP;
+  bool comprimido = img.flagsInode[inode] & INODE_COMPRIMIDO;
+  int proximo = 0;
+  vector<unsigned char> bloco;
+  for (int i = 0; i < blocosNecessarios(img, conteudo.size()); i++)
+  {
+    if (blocoBuraco(img, conteudo, i, comprimido))
+    {
+      ponteiroBloco(img.inodes[inode], i) = 0x00;
+      continue;
+    }
+    montarBloco(img, conteudo, i, bloco);
+
+    unsigned long long hash = 0;
+    if (dedup)
+    {
+      hash = hashDeBloco(&bloco[0], img.blockSize);
+      int existente = buscarBlocoIgual(img, hash, bloco);
+      if (existente != -1)
+      {
+        ponteiroBloco(img.inodes[inode], i) = existente;
+        img.refBloco[existente]++;
+        img.extensaoAlterada = true;
+        continue;
+      }
+    }
+
+    int livre = blocos[proximo];
+    proximo++;
+    memcpy(escreverBloco(img, livre), &bloco[0], img.blockSize);
+    ponteiroBloco(img.inodes[inode], i) = livre;
+    marcarBloco(img, livre, true);
+
+    if (dedup)
+    {
+      img.refBloco[livre] = 1;
+      img.hashBloco[livre] = hash;
+      img.indiceHash.insert(make_pair(hash, livre));
+      img.extensaoAlterada = true;
+    }
+  }
+  img.inodeAlterado[inode] = true;
+}
+
+// Função para obter o conteúdo como será guardado nos blocos e as flags do inode.
+// Com a feature de compressão, o arquivo é guardado comprimido se isso economizar pelo menos um bloco em relação aos
+// blocos não nulos do original (os blocos de zeros do original viram buracos e não ocupam espaço).
+unsigned char prepararConteudo(const IMAGEM &img, const string &conteudo, string &dados)
+{
+  dados = conteudo;
+  if (img.features & FS_FEATURE_COMPRESSION)
+  {
+    int ocupados = 0;
+    for (int i = 0; i < blocosNecessarios(img, conteudo.size()); i++)
+    {
+      ocupados += !blocoBuraco(img, conteudo, i, false);
+    }
+    vector<unsigned char> comprimido = comprimirLZ(conteudo);
+    if (blocosNecessarios(img, comprimido.size()) < ocupados)
+    {
+      dados.assign(comprimido.begin(), comprimido.end());
+      return INODE_COMPRIMIDO;
+    }
+  }
+  return 0x00;
+}
+
+/**
+ * @brief Adiciona um novo arquivo dentro do sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
+ * Com alocação adiada, o inode e a entrada no pai são criados agora e o conteúdo fica em img.pendentes até alocarPendentes.
+ * @param img estado da imagem aberta.
+ * @param filePath caminho completo novo arquivo dentro sistema de arquivos que simula EXT3.
+ * @param fileContent conteúdo do novo arquivo
+ * @return false se o pai não existir, o nome for vazio, tiver mais de 10 bytes ou já existir, ou faltar inode/bloco.
+ */
+bool adicionarArquivo(IMAGEM &img, string_view filePath, const string &fileContent)
+{
+  // Índice do inode do pai do arquivo e nome já no formato do campo NAME.
+  NOME_INODE nomeArquivo;
+  int inodePai = resolverPai(img, filePath, nomeArquivo);
+  if (inodePai == -1 || buscarFilho(img, inodePai, nomeArquivo) != -1)
+  {
+    return false;
+  }
+
+  // O campo SIZE tem apenas 1 byte.
+  if (fileContent.size() > 255)
+  {
+    return false;
+  }
+
+  string dados;
+  unsigned char flags = prepararConteudo(img, fileContent, dados);
+
+  // Índice do inode livre (o primeiro, ou no grupo do pai).
+  int inodeIndex = escolherInode(img, inodePai, false);
+
+  // Quantidade de blocos necessários para armazenar o conteúdo do arquivo.
+  int blocosArquivo = blocosNecessarios(img, dados.size());
+  if (inodeIndex == -1 || blocosArquivo > 9)
+  {
+    return false;
+  }
+
+  // Atualizar o bloco do pai com o novo inode (pode alocar um novo bloco para o pai).
+  if (!vincularEntrada(img, inodePai, inodeIndex))
+  {
+    return false;
+  }
+
+  // Blocos livres que serão usados para armazenar o conteudo do arquivo. Com alocação adiada, os blocos só são
+  // reservados: o addFile falha agora se não houver espaço, em vez de o arquivo sumir no flush.
+  vector<int> blocosLivres;
+  int objetivo = objetivoDoInode(img, inodeIndex, ponteiroBloco(img.inodes[inodePai], 0));
+  int reserva = img.alocacaoAdiada ? blocosReserva(img, dados, flags & INODE_COMPRIMIDO) : 0;
+  bool semEspaco = img.alocacaoAdiada ? img.totais.blocosLivres - img.blocosReservados < reserva
+                                      : !escolherBlocos(img, blocosNovos(img, dados, flags & INODE_COMPRIMIDO), objetivo, blocosLivres);
+  if (semEspaco)
+  {
+    desvincularEntrada(img, inodePai, inodeIndex);
+    return false;
+  }
+
+  // Preencher o inode livre com os dados do arquivo.
+  ocuparInode(img, inodeIndex, false);
+  definirTamanho(img, inodeIndex, fileContent.size());
+  gravarNome(img.inodes[inodeIndex], nomeArquivo);
+  definirFlagsInode(img, inodeIndex, flags);
+
+  if (img.alocacaoAdiada)
+  {
+    ESCRITA_PENDENTE pendente;
+    pendente.inode = inodeIndex;
+    pendente.pai = inodePai;
+    pendente.conteudo = dados;
+    pendente.reservados = reserva;
+    img.pendentes.push_back(pendente);
+    img.blocosReservados += reserva;
+  }
+  else
+  {
+    gravarConteudo(img, inodeIndex, dados, blocosLivres);
+    mapearExtents(img, inodeIndex);
   }
-  return inodeIndex;
+  return true;
 }
 
-// Função para fazer o mapeamento dos blocos usados
-vector<bool> mappingUsedBlocks(vector<INODE> inodes, unsigned char numBlocks, unsigned char numInodes)
+/**
+ * @brief Junta os bytes guardados nos blocos de um arquivo, na ordem dos ponteiros.
+ * Em arquivos não comprimidos, um ponteiro 0x00 vira um bloco de zeros; em comprimidos, marca o fim dos dados.
+ * @param inode inode do arquivo.
+ * @param comprimido true se o inode estiver marcado como comprimido.
+ * @param blockSize tamanho do bloco.
+ * @param dadosBloco função que devolve o conteúdo de um bloco pelo número.
+ * @param dados bytes guardados.
+ */
+template <typename LEITOR>
+void juntarBlocos(INODE inode, bool comprimido, int blockSize, LEITOR dadosBloco, string &dados)
 {
-  vector<bool> usedBlocks(numBlocks, false);
-  usedBlocks[0] = true;
-
-  for (int i = 0; i < numInodes; i++)
+  // Um arquivo comprimido ocupa uma quantidade de blocos que não depende de SIZE.
+  int numBlocos = comprimido ? 9 : (int)ceil((double)tamanhoInode(inode) / blockSize);
+  dados.clear();
+  for (int j = 0; j < numBlocos; j++)
   {
-    if (inodes[i].IS_USED == 0x01)
+    int bloco = ponteiroBloco(inode, j);
+    if (bloco == 0x00)
     {
-      for (int j = 0; j < 3; j++)
+      if (comprimido)
       {
-        if (inodes[i].DIRECT_BLOCKS[j] != 0x00)
-        {
-          usedBlocks[inodes[i].DIRECT_BLOCKS[j]] = true;
-        }
-        if (inodes[i].INDIRECT_BLOCKS[j] != 0x00)
-        {
-          usedBlocks[inodes[i].INDIRECT_BLOCKS[j]] = true;
-        }
-        if (inodes[i].DOUBLE_INDIRECT_BLOCKS[j] != 0x00)
-        {
-          usedBlocks[inodes[i].DOUBLE_INDIRECT_BLOCKS[j]] = true;
-        }
+        break;
       }
+      dados.append(blockSize, 0x00);
+      continue;
     }
+    dados.append((const char *)dadosBloco(bloco), blockSize);
   }
-  return usedBlocks;
 }
 
-// Função para obter o nome do pai do arquivo ou diretório a ser criado.
-// O pai é o primeiro nome antes do ultimo "/.
-// Ex: /home/usuario/arquivo.txt -> "usuario/"
-string getFatherName(string Path)
+// Função para obter o conteúdo original a partir dos bytes guardados. Retorna false se estiver corrompido.
+bool decodificarConteudo(const string &dados, int tamanho, bool comprimido, string &conteudo)
 {
-  string fatherName = "";
-  int ultimaBarra = Path.find_last_of("/");
+  if (comprimido)
+  {
+    return descomprimirLZ((const unsigned char *)dados.data(), dados.size(), tamanho, conteudo);
+  }
+  conteudo = dados.substr(0, tamanho);
+  return true;
+}
 
-  for (int i = 1; i < ultimaBarra; i++)
+/**
+ * @brief Lê o conteúdo de um arquivo, descomprimindo se o inode estiver marcado como comprimido.
+ * @param img estado da imagem aberta.
+ * @param filePath caminho completo do arquivo.
+ * @param conteudo conteúdo do arquivo.
+ * @return false se o caminho não existir, for um diretório ou o conteúdo estiver corrompido.
+ */
+bool lerArquivo(IMAGEM &img, string_view filePath, string &conteudo)
+{
+  int inode = resolverCaminho(img, filePath);
+  if (inode == -1 || img.inodes[inode].IS_DIR == 0x01)
   {
-    fatherName += Path[i];
+    return false;
   }
-  if (fatherName == "")
+  bool comprimido = img.flagsInode[inode] & INODE_COMPRIMIDO;
+
+  // Conteúdo guardado: na alocação adiada ainda está em memória, senão está nos blocos do inode.
+  for (int i = 0; i < img.pendentes.size(); i++)
   {
-    fatherName = "/";
+    if (img.pendentes[i].inode == inode)
+    {
+      return decodificarConteudo(img.pendentes[i].conteudo, tamanhoInode(img.inodes[inode]), comprimido, conteudo);
+    }
   }
-  return fatherName;
+
+  string dados;
+  carregarBlocos(img, inode);
+  juntarBlocos(img.inodes[inode], comprimido, img.blockSize, [&img](int bloco)
+               { return lerBloco(img, bloco); },
+               dados);
+  return decodificarConteudo(dados, tamanhoInode(img.inodes[inode]), comprimido, conteudo);
 }
 
-// Função para obter o nome do arquivo ou diretório a ser removido
-// Pega o último nome depois da última barra.
-string getName(string Path)
+// Função para aplicar uma escrita ao conteúdo completo de um arquivo. O trecho entre o fim antigo e offset fica com zeros.
+void aplicarEscrita(string &conteudo, int offset, const string &dados)
 {
-  string name = "";
-  int ultimaBarra = Path.find_last_of("/");
-  for (int i = ultimaBarra + 1; i < Path.length(); i++)
+  if (conteudo.size() < offset + dados.size())
   {
-    name += Path[i];
+    conteudo.resize(offset + dados.size(), 0x00);
   }
-  return name;
+  conteudo.replace(offset, dados.size(), dados);
 }
 
-// Função para obter o índice do inode pelo nome.
-int getInodeIndex(string nome, vector<INODE> inodes, int numInodes)
+/**
+ * @brief Regrava todo o conteúdo de um arquivo já alocado (usado nos comprimidos, que não podem ser alterados bloco a
+ * bloco). Os blocos novos são gravados antes de os antigos serem soltos, então uma falta de espaço não altera nada.
+ * @param img estado da imagem aberta.
+ * @param inode arquivo.
+ * @param conteudo novo conteúdo completo.
+ * @return false se o conteúdo não couber em 9 blocos ou não houver blocos livres.
+ */
+bool regravarArquivo(IMAGEM &img, int inode, const string &conteudo)
 {
-  for (int i = 0; i < numInodes; i++)
+  string dados;
+  unsigned char flags = prepararConteudo(img, conteudo, dados);
+  vector<int> blocos;
+  if (blocosNecessarios(img, dados.size()) > 9 ||
+      !escolherBlocos(img, blocosNovos(img, dados, flags & INODE_COMPRIMIDO), objetivoDoInode(img, inode, ponteiroBloco(img.inodes[inode], 0)), blocos))
   {
-    string nomeAux = "";
-    for (int j = 0; j < 10; j++)
+    return false;
+  }
+
+  INODE antigo = img.inodes[inode];
+  bool comprimidoAntigo = img.flagsInode[inode] & INODE_COMPRIMIDO;
+  for (int j = 0; j < 9; j++)
+  {
+    ponteiroBloco(img.inodes[inode], j) = 0x00;
+  }
+  definirFlagsInode(img, inode, flags);
+  gravarConteudo(img, inode, dados, blocos);
+  for (int j = 0; j < 9; j++)
+  {
+    int bloco = ponteiroBloco(antigo, j);
+    if (bloco == 0x00)
     {
-      if (inodes[i].NAME[j] != 0x00)
+      if (comprimidoAntigo)
       {
-        nomeAux += inodes[i].NAME[j];
+        break;
       }
+      continue;
     }
-
-    if (nomeAux == nome)
-    {
-      return i;
-    }
+    soltarBloco(img, bloco, 1);
   }
-  return -1;
+  definirTamanho(img, inode, conteudo.size());
+  mapearExtents(img, inode);
+  return true;
 }
 
 /**
- * @brief Faz a inicialização do arquivo EXT3 usando o arquivo aberto.
- * @param arquivo arquivo aberto que simula EXT3
- * @param blockSize tamanho em bytes do bloco
- * @param numBlocks quantidade de blocos
- * @param numInodes quantidade de inodes
+ * @brief Escreve dados em um arquivo a partir de uma posição, alterando só os blocos que a faixa cobre.
+ * Blocos dentro do arquivo são reescritos no lugar; blocos novos só são alocados para a parte nova, depois do fim
+ * (ou para preencher um buraco). Escrever depois do fim deixa zeros entre o fim antigo e offset, que viram buracos.
+ * Com deduplicação, cada bloco alterado é copiado (copy-on-write): o bloco antigo pode estar em uso por outro arquivo.
+ * Arquivos comprimidos e arquivos ainda pendentes da alocação adiada são regravados inteiros.
+ * @param img estado da imagem aberta.
+ * @param filePath caminho completo do arquivo.
+ * @param offset posição do primeiro byte escrito; -1 escreve no fim do arquivo (append).
+ * @param dados bytes escritos.
+ * @return false se o caminho não existir, for um diretório, o arquivo passar de 255 bytes ou 9 blocos, ou faltar bloco.
  */
-void inicializar(FILE *arquivo, int blockSize, int numBlocks, int numInodes)
+bool escreverEmArquivo(IMAGEM &img, string_view filePath, int offset, const string &dados)
 {
-  // Gravando os três primeiros bytes do arquivo.
-  fwrite(&blockSize, 1, 1, arquivo);
-  fwrite(&numBlocks, 1, 1, arquivo);
-  fwrite(&numInodes, 1, 1, arquivo);
-
-  // Quantidade de bytes que o Mapa de Bits irá ocupar.
-  int bitMapSize = getBitMapSize(numBlocks);
-
-  // Espaço para o Mapa de Bits.
-  vector<unsigned char> bitMap(bitMapSize);
-
-  // Gravar o mapa de bits no arquivo
-  // Apenas o primeiro bloco está sendo usado, pois é o bloco do diretório raiz.
-  bitMap[0] = 0x01;
-  for (int i = 1; i < bitMapSize; i++)
+  int inode = resolverCaminho(img, filePath);
+  if (inode == -1 || img.inodes[inode].IS_DIR == 0x01)
   {
-    bitMap[i] = 0x00;
+    return false;
   }
-  fwrite(&bitMap[0], sizeof(unsigned char), bitMapSize, arquivo);
-
-  // Espaço para o vetor de inodes.
-  vector<INODE> inodes(numInodes);
-
-  // Raiz do sistema de arquivos é sempre 0.
-  unsigned char root = 0x00;
-
-  // Primeiro inode = inode do diretório raiz.
-  // O inode do diretório raiz recebe 0x01 em usado, 0x01 em tipo, 0x00 em tamanho, '/' em nome e 0x00 em todos os blocos.
-  // O nome é um char de 10 espaços, então é necessário preencher com 0x00.
-  inodes[root].IS_USED = 0x01;
-  inodes[root].IS_DIR = 0x01;
-  inodes[root].NAME[0] = '/';
-  for (int i = 1; i < 10; i++)
+  int tamanhoAntigo = tamanhoInode(img.inodes[inode]);
+  if (offset == -1)
   {
-    inodes[root].NAME[i] = 0x00;
+    offset = tamanhoAntigo;
   }
-  inodes[root].SIZE = 0x00;
-  for (int i = 0; i < 3; i++)
+  // O campo SIZE tem apenas 1 byte.
+  if (offset < 0 || dados.size() > 255 || offset + (int)dados.size() > 255)
   {
-    inodes[root].DIRECT_BLOCKS[i] = 0x00;
-    inodes[root].INDIRECT_BLOCKS[i] = 0x00;
-    inodes[root].DOUBLE_INDIRECT_BLOCKS[i] = 0x00;
+    return false;
+  }
+  if (dados.empty())
+  {
+    return true;
   }
+  int tamanhoNovo = max(tamanhoAntigo, offset + (int)dados.size());
+  bool comprimido = img.flagsInode[inode] & INODE_COMPRIMIDO;
 
-  // Os demais inodes recebem 0x00 em tudo.
-  for (int i = 1; i < numInodes; i++)
+  // Conteúdo ainda em memória: a escrita é aplicada ao conteúdo pendente.
+  for (int i = 0; i < img.pendentes.size(); i++)
   {
-    inodes[i].IS_USED = 0x00;
-    inodes[i].IS_DIR = 0x00;
-    inodes[i].SIZE = 0x00;
-    for (int j = 0; j < 10; j++)
+    ESCRITA_PENDENTE &pendente = img.pendentes[i];
+    if (pendente.inode != inode)
     {
-      inodes[i].NAME[j] = 0x00;
+      continue;
     }
-    for (int j = 0; j < 3; j++)
+    string conteudo, guardado;
+    if (!decodificarConteudo(pendente.conteudo, tamanhoAntigo, comprimido, conteudo))
     {
-      inodes[i].DIRECT_BLOCKS[j] = 0x00;
-      inodes[i].INDIRECT_BLOCKS[j] = 0x00;
-      inodes[i].DOUBLE_INDIRECT_BLOCKS[j] = 0x00;
+      return false;
+    }
+    aplicarEscrita(conteudo, offset, dados);
+    unsigned char flags = prepararConteudo(img, conteudo, guardado);
+    int reserva = blocosReserva(img, guardado, flags & INODE_COMPRIMIDO);
+    if (blocosNecessarios(img, guardado.size()) > 9 || img.totais.blocosLivres - img.blocosReservados + pendente.reservados < reserva)
+    {
+      return false;
     }
+    img.blocosReservados += reserva - pendente.reservados;
+    pendente.reservados = reserva;
+    pendente.conteudo = guardado;
+    definirFlagsInode(img, inode, flags);
+    definirTamanho(img, inode, tamanhoNovo);
+    img.inodeAlterado[inode] = true;
+    return true;
   }
 
-  // Gravando o vetor de inodes no arquivo após o mapa de bits.
-  fwrite(&inodes[0], sizeof(INODE), numInodes, arquivo);
-
-  // Gravando o indice do inode do diretório raiz no arquivo após o vetor de inodes.
-  fwrite(&root, sizeof(unsigned char), 1, arquivo);
-
-  // Espaço para o vetor de blocos.
-  vector<vector<unsigned char>> blocos(numBlocks, vector<unsigned char>(blockSize));
-
-  // Na inicialização, todos os blocos recebem 0x00.
-  for (int i = 0; i < numBlocks; i++)
+  if (comprimido)
   {
-    for (int j = 0; j < blockSize; j++)
+    string conteudo;
+    if (!lerArquivo(img, filePath, conteudo))
     {
-      blocos[i][j] = 0x00;
+      return false;
     }
+    aplicarEscrita(conteudo, offset, dados);
+    return regravarArquivo(img, inode, conteudo);
   }
 
-  // Gravando o vetor de blocos no arquivo após o indice do inode do diretório raiz.
-  for (int i = 0; i < numBlocks; i++)
+  if (blocosNecessarios(img, tamanhoNovo) > 9)
   {
-    fwrite(&blocos[i][0], sizeof(unsigned char), blockSize, arquivo);
+    return false;
   }
-}
-
-/**
- * @brief Adiciona um novo arquivo dentro do sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
- * @param arquivo arquivo aberto que contém um sistema de arquivos que simula EXT3.
- * @param filePath caminho completo novo arquivo dentro sistema de arquivos que simula EXT3.
- * @param fileContent conteúdo do novo arquivo
- */
-void adicionarArquivo(FILE *arquivo, string filePath, string fileContent)
-{
-  // blockSize: tamanho do bloco
-  // numBlocks: quantidade de blocos
-  // numInodes: quantidade de inodes
-  // root: inode do diretório raiz
-  unsigned char blockSize, numBlocks, numInodes, root;
-
-  // Posicionamento do ponteiro no inicio do arquivo e leitura dos 3 primeiros bytes.
-  fseek(arquivo, 0, SEEK_SET);
-  fread(&blockSize, sizeof(unsigned char), 1, arquivo);
-  fread(&numBlocks, sizeof(unsigned char), 1, arquivo);
-  fread(&numInodes, sizeof(unsigned char), 1, arquivo);
-
-  // Quantidade de bytes do mapa de bits.
-  unsigned char bitMapSize = getBitMapSize(numBlocks);
-
-  // Espaço para tratamento do mapa de bits
-  vector<unsigned char> bitMap(bitMapSize);
-
-  // Espaço para tratamento dos inodes.
-  vector<INODE> inodes(numInodes);
-
-  // Espaço para o vetor de blocos.
-  vector<vector<unsigned char>> blocos(numBlocks, vector<unsigned char>(blockSize));
-
-  // Leitura dos bytes do mapa de bits, inodes, root e blocos.
-  fread(&bitMap[0], sizeof(unsigned char), bitMapSize, arquivo);
-  fread(&inodes[0], sizeof(INODE), numInodes, arquivo);
-  fread(&root, 1, 1, arquivo);
-  for (int i = 0; i < numBlocks; i++)
+  bool dedup = img.features & FS_FEATURE_DEDUP;
+  int blocosAntigos = blocosNecessarios(img, tamanhoAntigo);
+  int primeiro = offset / img.blockSize;
+  int ultimo = (offset + (int)dados.size() - 1) / img.blockSize;
+  INODE &registro = img.inodes[inode];
+
+  // Novo conteúdo de cada bloco da faixa: o antigo (ou zeros depois do fim antigo) com os dados por cima.
+  // Quantos blocos livres a escrita consome é contado antes de qualquer alteração, como em blocosNovos.
+  int n = ultimo - primeiro + 1;
+  vector<vector<unsigned char>> novos(n, vector<unsigned char>(img.blockSize, 0x00));
+  vector<unsigned long long> hashes(n, 0);
+  unordered_map<unsigned long long, vector<unsigned char>> vistos;
+  int necessarios = 0;
+  for (int k = 0; k < n; k++)
   {
-    fread(&blocos[i][0], sizeof(unsigned char), blockSize, arquivo);
-  }
-
-  // Índice do primeiro inode livre.
-  int inodeIndex = getFreeInode(numInodes, inodes);
-
-  // Vetor de blocos usados - False = livre, True = usado.
-  vector<bool> blocosUsados = mappingUsedBlocks(inodes, numBlocks, numInodes);
-
-  // Quantidade de blocos necessários para armazenar o conteúdo do arquivo.
-  int blocosArquivo = ceil((double)fileContent.size() / (double)blockSize);
+    int j = primeiro + k;
+    int inicio = j * img.blockSize;
+    int antigo = j < blocosAntigos ? ponteiroBloco(registro, j) : 0x00;
+    if (antigo != 0x00)
+    {
+      memcpy(&novos[k][0], lerBloco(img, antigo), max(0, min((int)img.blockSize, tamanhoAntigo - inicio)));
+    }
+    int de = max(offset, inicio);
+    int ate = min(offset + (int)dados.size(), inicio + (int)img.blockSize);
+    memcpy(&novos[k][de - inicio], dados.data() + (de - offset), ate - de);
 
-  // Blocos livres que serão usados para armazenar o conteudo do arquivo.
-  int blocosLivres[blocosArquivo];
-  int contador = 0;
-  for (int i = 0; i < numBlocks; i++)
-  {
-    if (blocosUsados[i] == false)
+    if (faixaZerada(&novos[k][0], img.blockSize))
+    {
+      continue;
+    }
+    if (!dedup)
     {
-      blocosLivres[contador] = i;
-      contador++;
+      necessarios += antigo == 0x00;
+      continue;
     }
-    if (contador == blocosArquivo)
+    // Um bloco igual só é contado como compartilhado se ainda couberem as n referências que a escrita pode somar.
+    hashes[k] = hashDeBloco(&novos[k][0], img.blockSize);
+    int existente = buscarBlocoIgual(img, hashes[k], novos[k]);
+    if ((existente != -1 && img.refBloco[existente] + n < 255) || (vistos.count(hashes[k]) && vistos[hashes[k]] == novos[k]))
     {
-      break;
+      continue;
     }
+    vistos[hashes[k]] = novos[k];
+    necessarios++;
   }
 
-  // Colocar o conteudo do arquivo nos blocos livres.
-  int fileContentSize = fileContent.size();
-  int fileContentAux = 0;
-  for (int i = 0; i < blocosArquivo; i++)
+  // Os blocos novos ficam logo depois do último bloco do arquivo, se a política de alocação usar o objetivo.
+  int objetivo = -1;
+  for (int j = 0; j < blocosAntigos; j++)
   {
-    for (int j = 0; j < blockSize; j++)
+    if (ponteiroBloco(registro, j) != 0x00)
     {
-      if (fileContentAux < fileContentSize)
-      {
-        blocos[blocosLivres[i]][j] = fileContent[fileContentAux];
-        fileContentAux++;
-      }
-      else
-      {
-        blocos[blocosLivres[i]][j] = 0x00;
-      }
+      objetivo = (ponteiroBloco(registro, j) + 1) % img.numBlocks;
     }
   }
+  vector<int> blocos;
+  if (!escolherBlocos(img, necessarios, objetivoDoInode(img, inode, objetivo), blocos))
+  {
+    return false;
+  }
 
-  // Preencher o inode livre com os dados do arquivo.
-  inodes[inodeIndex].IS_USED = 0x01;
-  inodes[inodeIndex].IS_DIR = 0x00;
-  inodes[inodeIndex].SIZE = fileContent.size();
-
-  // Nome do arquivo, preencher com 0x00.
-  string nomeArquivo = filePath.substr(filePath.find_last_of("/") + 1);
-  for (int i = 0; i < 10; i++)
+  // Os blocos entre o fim antigo e a faixa escrita são buracos.
+  for (int j = blocosAntigos; j < primeiro; j++)
+  {
+    ponteiroBloco(registro, j) = 0x00;
+  }
+  bool ponteirosAlterados = false;
+  vector<int> soltar;
+  int proximo = 0;
+  for (int k = 0; k < n; k++)
   {
-    if (i < nomeArquivo.size())
+    int j = primeiro + k;
+    int antigo = j < blocosAntigos ? ponteiroBloco(registro, j) : 0x00;
+    int bloco = antigo;
+    if (faixaZerada(&novos[k][0], img.blockSize))
     {
-      inodes[inodeIndex].NAME[i] = nomeArquivo[i];
+      bloco = 0x00;
     }
-    else
+    else if (!dedup && antigo != 0x00)
     {
-      inodes[inodeIndex].NAME[i] = 0x00;
+      memcpy(escreverBloco(img, antigo), &novos[k][0], img.blockSize);
     }
-  }
-
-  // Blocos livres que serão usados para armazenar o conteudo do arquivo.
-  for (int i = 0; i < blocosArquivo; i++)
-  {
-    inodes[inodeIndex].DIRECT_BLOCKS[i] = blocosLivres[i];
-
-    if (i >= 0 && i < 3)
+    else if (dedup && (bloco = buscarBlocoIgual(img, hashes[k], novos[k])) != -1)
     {
-      inodes[inodeIndex].DIRECT_BLOCKS[i] = blocosLivres[i];
+      img.refBloco[bloco]++;
+      img.extensaoAlterada = true;
     }
-    else if (i >= 3 && i < 6)
+    else
     {
-      inodes[inodeIndex].INDIRECT_BLOCKS[i - 3] = blocosLivres[i];
+      bloco = blocos[proximo];
+      proximo++;
+      memcpy(escreverBloco(img, bloco), &novos[k][0], img.blockSize);
+      marcarBloco(img, bloco, true);
+      if (dedup)
+      {
+        img.refBloco[bloco] = 1;
+        img.hashBloco[bloco] = hashes[k];
+        img.indiceHash.insert(make_pair(hashes[k], bloco));
+        img.extensaoAlterada = true;
+      }
     }
-    else
+    // Com deduplicação a referência antiga só é solta no fim, para que os blocos procurados acima continuem válidos.
+    if (antigo != 0x00 && (dedup || bloco == 0x00))
     {
-      inodes[inodeIndex].DOUBLE_INDIRECT_BLOCKS[i - 6] = blocosLivres[i];
+      soltar.push_back(antigo);
     }
+    ponteirosAlterados = ponteirosAlterados || bloco != antigo;
+    ponteiroBloco(registro, j) = bloco;
+  }
+  for (int i = 0; i < soltar.size(); i++)
+  {
+    soltarBloco(img, soltar[i], 1);
   }
 
-  // Nome do pai do arquivo/diretório.
-  string nomePai = getFatherName(filePath);
+  definirTamanho(img, inode, tamanhoNovo);
+  img.inodeAlterado[inode] = true;
+  if (ponteirosAlterados)
+  {
+    mapearExtents(img, inode);
+  }
+  return true;
+}
 
-  // Índice do inode do pai do arquivo/diretório.
-  int inodePai = getInodeIndex(nomePai, inodes, numInodes);
+// Imagem mapeada em memória, somente leitura. Nada é alterado depois de montada, então pode ser lida por várias threads.
+typedef struct
+{
+  const unsigned char *dados;
+  size_t tamanho;
+  int blockSize, numBlocks, numInodes;
+  long inicioInodes, inicioBlocos;
+  const unsigned char *flagsInode; // NULL em imagens sem superbloco estendido
+} IMAGEM_MAPEADA;
 
-  // Incrementar o tamanho do pai
-  inodes[inodePai].SIZE += 1;
+/**
+ * @brief Interpreta o cabeçalho e o superbloco estendido de uma imagem mapeada.
+ * @param dados início da imagem.
+ * @param tamanho tamanho da imagem em bytes.
+ * @param img estrutura que recebe as posições das tabelas.
+ * @return false se a imagem for menor do que a geometria do cabeçalho.
+ */
+bool interpretarMapeamento(const unsigned char *dados, size_t tamanho, IMAGEM_MAPEADA &img)
+{
+  if (tamanho < 3)
+  {
+    return false;
+  }
+  img.dados = dados;
+  img.tamanho = tamanho;
+  img.blockSize = dados[0];
+  img.numBlocks = dados[1];
+  img.numInodes = dados[2];
+  img.inicioInodes = 3 + getBitMapSize(img.numBlocks);
+  img.inicioBlocos = img.inicioInodes + img.numInodes * (long)sizeof(INODE) + 1;
+
+  long inicioExtensao = img.inicioBlocos + (long)img.numBlocks * img.blockSize;
+  if ((size_t)inicioExtensao > tamanho)
+  {
+    return false;
+  }
+  img.flagsInode = NULL;
+  if ((size_t)inicioExtensao + 5 + img.numInodes <= tamanho && memcmp(dados + inicioExtensao, MAGIC_EXTENSAO, 4) == 0)
+  {
+    img.flagsInode = dados + inicioExtensao + 5;
+  }
+  return true;
+}
 
-  // Atualizar o bloco do pai com o novo inode que foi alocado.
-  for (int i = 0; i < blockSize; i++)
+/**
+ * @brief Lê o conteúdo de um arquivo de uma imagem mapeada, pelo número do inode.
+ * @param img imagem mapeada.
+ * @param inode número do inode.
+ * @param conteudo conteúdo do arquivo.
+ * @return false se o inode não for de um arquivo, apontar para fora da imagem ou o conteúdo estiver corrompido.
+ */
+bool lerArquivoMapeado(const IMAGEM_MAPEADA &img, int inode, string &conteudo)
+{
+  if (inode < 0 || inode >= img.numInodes)
+  {
+    return false;
+  }
+  INODE registro;
+  memcpy(&registro, img.dados + img.inicioInodes + inode * (long)sizeof(INODE), sizeof(INODE));
+  if (registro.IS_USED != 0x01 || registro.IS_DIR == 0x01)
+  {
+    return false;
+  }
+  if (img.flagsInode != NULL && (img.flagsInode[inode] & INODE_EXTENTS))
+  {
+    decodificarInode(registro, img.numBlocks, img.blockSize, [&img](int bloco)
+                     { return img.dados + img.inicioBlocos + (long)bloco * img.blockSize; });
+  }
+  for (int j = 0; j < 9; j++)
   {
-    if (blocos[inodes[inodePai].DIRECT_BLOCKS[0]][i] == 0x00)
+    if (ponteiroBloco(registro, j) >= img.numBlocks)
     {
-      blocos[inodes[inodePai].DIRECT_BLOCKS[0]][i] = inodeIndex;
-      break;
+      return false;
     }
   }
 
-  // Mapear os blocos usados para obter o bitmap.
-  blocosUsados = mappingUsedBlocks(inodes, numBlocks, numInodes);
+  bool comprimido = img.flagsInode != NULL && (img.flagsInode[inode] & INODE_COMPRIMIDO);
+  string dados;
+  juntarBlocos(registro, comprimido, img.blockSize, [&img](int bloco)
+               { return img.dados + img.inicioBlocos + (long)bloco * img.blockSize; },
+               dados);
+  return decodificarConteudo(dados, tamanhoInode(registro), comprimido, conteudo);
+}
+
+/**
+ * @brief Aloca os blocos dos arquivos com alocação adiada e copia o conteúdo para eles.
+ * Os arquivos são agrupados por diretório pai e, se houver uma sequência livre que caiba todos, são colocados um após o outro;
+ * senão cada arquivo procura sua própria sequência contígua e, em último caso, os primeiros blocos livres.
+ * Um arquivo que não couber é retirado do pai e seu inode é liberado.
+ * @param img estado da imagem aberta.
+ * @return false se algum arquivo não pôde ser alocado.
+ */
+bool alocarPendentes(IMAGEM &img)
+{
+  // As reservas viram os blocos alocados abaixo.
+  img.blocosReservados = 0;
+  stable_sort(img.pendentes.begin(), img.pendentes.end(), [](const ESCRITA_PENDENTE &a, const ESCRITA_PENDENTE &b)
+              { return a.pai < b.pai; });
+
+  int total = 0;
+  for (int i = 0; i < img.pendentes.size(); i++)
+  {
+    total += blocosNovos(img, img.pendentes[i].conteudo, img.flagsInode[img.pendentes[i].inode] & INODE_COMPRIMIDO);
+  }
+  int proximo = buscarSequenciaLivre(img, total);
 
-  for (int i = 0; i < numBlocks; i++)
+  bool ok = true;
+  vector<int> blocos, gravados;
+  for (int i = 0; i < img.pendentes.size(); i++)
   {
-    int index = (int)floor(i / 8.0);
+    ESCRITA_PENDENTE &pendente = img.pendentes[i];
+    int n = blocosNovos(img, pendente.conteudo, img.flagsInode[pendente.inode] & INODE_COMPRIMIDO);
 
-    if (blocosUsados[i] == true && i < 8)
+    blocos.clear();
+    if (proximo != -1)
     {
-      bitMap[index] |= (1 << i);
+      for (int j = 0; j < n; j++)
+      {
+        blocos.push_back(proximo + j);
+      }
+      proximo += n;
+    }
+    else
+    {
+      int inicio = buscarSequenciaLivre(img, n);
+      if (inicio != -1)
+      {
+        for (int j = 0; j < n; j++)
+        {
+          blocos.push_back(inicio + j);
+        }
+      }
+      else if (!escolherPrimeirosLivres(img, n, blocos))
+      {
+        desvincularEntrada(img, pendente.pai, pendente.inode);
+        liberarInode(img, pendente.inode);
+        ok = false;
+        continue;
+      }
     }
+    gravarConteudo(img, pendente.inode, pendente.conteudo, blocos);
+    gravados.push_back(pendente.inode);
   }
+  img.pendentes.clear();
 
-  // Posicionar o ponteiro após o numero de inodes e escrever o bitmap e os inodes no arquivo.
-  fseek(arquivo, 3, SEEK_SET);
-  fwrite(&bitMap[0], sizeof(unsigned char), bitMapSize, arquivo);
-  fwrite(&inodes[0], sizeof(INODE), numInodes, arquivo);
-
-  // Pular a raiz e escrever os blocos tratados no arquivo.
-  fseek(arquivo, 1, SEEK_CUR);
-  for (int i = 0; i < numBlocks; i++)
+  // As folhas de extents só são alocadas depois de todos os dados, para não ocupar a sequência reservada acima.
+  for (int i = 0; i < gravados.size(); i++)
   {
-    fwrite(&blocos[i][0], sizeof(unsigned char), blockSize, arquivo);
+    mapearExtents(img, gravados[i]);
   }
+  return ok;
 }
 
 /**
  * @brief Adiciona um novo diretório dentro do sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
- * @param arquivo arquivo aberto que contém um sistema de arquivos que simula EXT3.
+ * @param img estado da imagem aberta.
  * @param dirPath caminho completo novo diretório dentro sistema de arquivos que simula EXT3.
+ * @return false se o pai não existir, o nome for vazio, tiver mais de 10 bytes ou já existir, ou faltar inode/bloco.
  */
-void adicionarDiretorio(FILE *arquivo, string dirPath)
+bool adicionarDiretorio(IMAGEM &img, string_view dirPath)
 {
-  // blockSize: tamanho do bloco
-  // numBlocks: quantidade de blocos
-  // numInodes: quantidade de inodes
-  // root: inode do diretório raiz
-  unsigned char blockSize, numBlocks, numInodes, root;
-
-  // Posicionamento do ponteiro no inicio do arquivo e leitura dos 3 primeiros bytes.
-  fseek(arquivo, 0, SEEK_SET);
-  fread(&blockSize, sizeof(unsigned char), 1, arquivo);
-  fread(&numBlocks, sizeof(unsigned char), 1, arquivo);
-  fread(&numInodes, sizeof(unsigned char), 1, arquivo);
+  // Índice do inode do pai do diretório e nome já no formato do campo NAME.
+  NOME_INODE nomeDiretorio;
+  int inodePai = resolverPai(img, dirPath, nomeDiretorio);
+  if (inodePai == -1 || buscarFilho(img, inodePai, nomeDiretorio) != -1)
+  {
+    return false;
+  }
 
-  // Quantidade de bytes do mapa de bits.
-  unsigned char bitMapSize = getBitMapSize(numBlocks);
+  // Índice do inode livre (o primeiro, ou no grupo com mais blocos livres).
+  int inodeIndex = escolherInode(img, inodePai, true);
+  if (inodeIndex == -1 || !vincularEntrada(img, inodePai, inodeIndex))
+  {
+    return false;
+  }
 
-  // Espaço para tratamento do mapa de bits
-  vector<unsigned char> bitMap(bitMapSize);
+  // Bloco livre que será usado para as entradas do diretório.
+  vector<int> blocoLivre;
+  if (!escolherBlocos(img, 1, objetivoDoInode(img, inodeIndex, ponteiroBloco(img.inodes[inodePai], 0)), blocoLivre))
+  {
+    desvincularEntrada(img, inodePai, inodeIndex);
+    return false;
+  }
 
-  // Espaço para tratamento dos inodes.
-  vector<INODE> inodes(numInodes);
+  // Preencher o inode livre com os dados do diretório.
+  ocuparInode(img, inodeIndex, true);
+  gravarNome(img.inodes[inodeIndex], nomeDiretorio);
+  img.inodes[inodeIndex].DIRECT_BLOCKS[0] = blocoLivre[0];
+  marcarBloco(img, blocoLivre[0], true);
+  return true;
+}
 
-  // Espaço para o vetor de blocos.
-  vector<vector<unsigned char>> blocos(numBlocks, vector<unsigned char>(blockSize));
+/**
+ * @brief Cria em memória o estado de uma imagem vazia (igual ao que inicializar grava), com tudo marcado como alterado.
+ * @param dispositivo dispositivo aberto onde a imagem será gravada.
+ * @param img estrutura que recebe o estado da imagem.
+ * @param blockSize tamanho em bytes do bloco
+ * @param numBlocks quantidade de blocos
+ * @param numInodes quantidade de inodes
+ * @param features features do superbloco estendido
+ */
+void criarImagemVazia(DISPOSITIVO *dispositivo, IMAGEM &img, int blockSize, int numBlocks, int numInodes, int features)
+{
+  img.dispositivo = dispositivo;
+  img.blockSize = blockSize;
+  img.numBlocks = numBlocks;
+  img.numInodes = numInodes;
+  img.root = 0x00;
+  img.bitMapSize = getBitMapSize(numBlocks);
+  img.bitMap.assign(img.bitMapSize, 0x00);
+  img.bitMap[0] = 0x01;
+  img.bitMapAlterado = true;
+
+  img.inodes.assign(numInodes, INODE());
+  memset(&img.inodes[0], 0x00, numInodes * sizeof(INODE));
+  img.inodes[0].IS_USED = 0x01;
+  img.inodes[0].IS_DIR = 0x01;
+  img.inodes[0].NAME[0] = '/';
+  img.inodeAlterado.assign(numInodes, true);
+
+  img.blocos.assign(numBlocks, vector<unsigned char>(blockSize, 0x00));
+  img.blocoCarregado.assign(numBlocks, true);
+  img.blocoAlterado.assign(numBlocks, true);
+
+  img.features = features;
+  img.flagsInode.assign(numInodes, 0x00);
+  img.folhaExtents.assign(numInodes, -1);
+  img.refBloco.assign(numBlocks, 0x00);
+  img.hashBloco.assign(numBlocks, 0);
+  img.indiceHash.clear();
+  img.extensaoAlterada = features != 0;
+  recontarGrupos(img);
+
+  img.alocacaoAdiada = false;
+  img.pendentes.clear();
+  img.blocosReservados = 0;
+  img.politica = FS_ALLOC_FIRST_FIT;
+  img.cursor = 0;
+}
 
-  // Leitura dos bytes do mapa de bits, inodes, root e blocos.
-  fread(&bitMap[0], sizeof(unsigned char), bitMapSize, arquivo);
-  fread(&inodes[0], sizeof(INODE), numInodes, arquivo);
-  fread(&root, 1, 1, arquivo);
-  for (int i = 0; i < numBlocks; i++)
+/**
+ * @brief Distribui um diretório e seus filhos a partir do cursor de blocos: primeiro os blocos do diretório,
+ * depois os blocos dos arquivos filhos e, por fim, cada subdiretório da mesma forma (em profundidade).
+ * Os filhos recebem inodes consecutivos.
+ * @param img estado da imagem sendo montada.
+ * @param dir inode do diretório (já criado).
+ * @param filhos índices (em entradas) dos filhos de cada entrada; a última posição guarda os filhos da raiz.
+ * @param origem índice do diretório em entradas (entradas.size() para a raiz).
+ * @param entradas arquivos e diretórios a importar.
+ * @param dados conteúdo de cada arquivo como será guardado.
+ * @param flags flags de cada arquivo.
+ * @param proximoInode próximo inode livre.
+ * @param cursor próximo bloco livre.
+ * @return false se faltar inode ou bloco ou o diretório tiver filhos demais.
+ */
+bool distribuirDiretorio(IMAGEM &img, int dir, const vector<vector<int>> &filhos, int origem, const vector<FS_IMPORT_ENTRY> &entradas,
+                         const vector<string> &dados, const vector<unsigned char> &flags, int &proximoInode, int &cursor)
+{
+  const vector<int> &lista = filhos[origem];
+  int numFilhos = lista.size();
+  int blocosDir = max(1, blocosNecessarios(img, numFilhos));
+  if (blocosDir > 9 || numFilhos > MAX_ENTRADAS_DIRETORIO || proximoInode + numFilhos > img.numInodes)
   {
-    fread(&blocos[i][0], sizeof(unsigned char), blockSize, arquivo);
+    return false;
   }
 
-  // Índice do primeiro inode livre.
-  int inodeIndex = getFreeInode(numInodes, inodes);
-
-  // Vetor de blocos usados - False = livre, True = usado.
-  vector<bool> blocosUsados = mappingUsedBlocks(inodes, numBlocks, numInodes);
-
-  // Blocos livres que serão usados para armazenar o conteudo do arquivo.
-  int blocosLivres[1];
-  int contador = 0;
-  for (int i = 0; i < numBlocks; i++)
+  // Blocos do diretório (o primeiro bloco da raiz é sempre o bloco 0).
+  for (int j = (dir == img.root ? 1 : 0); j < blocosDir; j++)
   {
-    if (blocosUsados[i] == false)
+    if (cursor >= img.numBlocks)
     {
-      blocosLivres[contador] = i;
-      contador++;
-    }
-    if (contador == 1)
-    {
-      break;
+      return false;
     }
+    ponteiroBloco(img.inodes[dir], j) = cursor;
+    marcarBloco(img, cursor, true);
+    cursor++;
   }
 
-  // Preencher o inode livre com os dados do arquivo
-  inodes[inodeIndex].IS_USED = 0x01;
-  inodes[inodeIndex].IS_DIR = 0x01;
-  inodes[inodeIndex].SIZE = 0x00;
+  // Inodes dos filhos e entradas do diretório.
+  vector<int> inodeFilho(numFilhos);
+  for (int i = 0; i < numFilhos; i++)
+  {
+    const FS_IMPORT_ENTRY &entrada = entradas[lista[i]];
+    inodeFilho[i] = proximoInode;
+    proximoInode++;
+
+    INODE &inode = img.inodes[inodeFilho[i]];
+    inode.IS_USED = 0x01;
+    inode.IS_DIR = entrada.isDir ? 0x01 : 0x00;
+    inode.SIZE = entrada.isDir ? 0 : entrada.content.size();
+    string_view caminhoPai, componente;
+    separarCaminho(entrada.path, caminhoPai, componente);
+    NOME_INODE nome;
+    prepararNome(componente, nome);
+    gravarNome(inode, nome);
+    img.blocos[ponteiroBloco(img.inodes[dir], i / img.blockSize)][i % img.blockSize] = inodeFilho[i];
+  }
+  img.inodes[dir].SIZE = numFilhos;
 
-  // Nome do arquivo, preencher com 0x00
-  string nomeArquivo = dirPath.substr(dirPath.find_last_of("/") + 1);
-  for (int i = 0; i < 10; i++)
+  // Arquivos logo depois dos blocos do diretório.
+  vector<int> blocos;
+  for (int i = 0; i < numFilhos; i++)
   {
-    if (i < nomeArquivo.size())
+    if (entradas[lista[i]].isDir)
     {
-      inodes[inodeIndex].NAME[i] = nomeArquivo[i];
+      continue;
     }
-    else
+    int n = blocosNovos(img, dados[lista[i]], flags[lista[i]] & INODE_COMPRIMIDO);
+    if (cursor + n > img.numBlocks)
+    {
+      return false;
+    }
+    blocos.clear();
+    for (int j = 0; j < n; j++)
     {
-      inodes[inodeIndex].NAME[i] = 0x00;
+      blocos.push_back(cursor + j);
     }
+    cursor += n;
+    definirFlagsInode(img, inodeFilho[i], flags[lista[i]]);
+    gravarConteudo(img, inodeFilho[i], dados[lista[i]], blocos);
   }
 
-  // Blocos livres que serão usados para armazenar o conteudo do arquivo
-  for (int i = 0; i < 1; i++)
+  for (int i = 0; i < numFilhos; i++)
   {
-    inodes[inodeIndex].DIRECT_BLOCKS[i] = blocosLivres[i];
+    if (entradas[lista[i]].isDir && !distribuirDiretorio(img, inodeFilho[i], filhos, lista[i], entradas, dados, flags, proximoInode, cursor))
+    {
+      return false;
+    }
   }
+  return true;
+}
 
-  // Nome do pai do arquivo/diretório.
-  string nomePai = getFatherName(dirPath);
-
-  // Índice do inode do pai do arquivo/diretório.
-  int inodePai = getInodeIndex(nomePai, inodes, numInodes);
-
-  inodes[inodePai].SIZE += 1;
-
-  // Atualizar o bloco do pai com o novo inode que foi alocado.
-  for (int i = 0; i < blockSize; i++)
+/**
+ * @brief Monta uma imagem nova com uma árvore inteira de uma vez: calcula o layout em memória e grava o arquivo em uma passada.
+ * @param dispositivo dispositivo aberto (vazio) onde a imagem será gravada.
+ * @param blockSize tamanho em bytes do bloco
+ * @param numBlocks quantidade de blocos
+ * @param numInodes quantidade de inodes
+ * @param features features do superbloco estendido
+ * @param entradas arquivos e diretórios, cada pai antes dos filhos.
+ * @return false se alguma entrada for inválida ou a árvore não couber na geometria (nada é gravado).
+ */
+bool montarImagem(DISPOSITIVO *dispositivo, int blockSize, int numBlocks, int numInodes, int features, const vector<FS_IMPORT_ENTRY> &entradas)
+{
+  IMAGEM img;
+  criarImagemVazia(dispositivo, img, blockSize, numBlocks, numInodes, features);
+
+  // Filhos de cada entrada, na ordem da lista; a posição entradas.size() é a raiz.
+  int raiz = entradas.size();
+  vector<vector<int>> filhos(entradas.size() + 1);
+  // As chaves apontam para os caminhos de entradas, que não mudam durante a montagem.
+  unordered_map<string_view, int> indice;
+  indice["/"] = raiz;
+  vector<string> dados(entradas.size());
+  vector<unsigned char> flags(entradas.size(), 0x00);
+  for (int i = 0; i < entradas.size(); i++)
   {
-    if (blocos[inodes[inodePai].DIRECT_BLOCKS[0]][i] == 0x00)
+    const FS_IMPORT_ENTRY &entrada = entradas[i];
+    string_view caminhoPai, componente;
+    separarCaminho(entrada.path, caminhoPai, componente);
+    unordered_map<string_view, int>::iterator pai = indice.find(caminhoPai);
+    if (pai == indice.end() || (pai->second != raiz && !entradas[pai->second].isDir) || indice.count(entrada.path) ||
+        componente.size() > 10 || componente.empty() || entrada.content.size() > 255)
     {
-      blocos[inodes[inodePai].DIRECT_BLOCKS[0]][i] = inodeIndex;
-      break;
+      return false;
     }
-  }
+    indice[entrada.path] = i;
+    filhos[pai->second].push_back(i);
 
-  // Mapear os blocos usados para obter o bitmap. bitmap é um unsigned char
-  blocosUsados = mappingUsedBlocks(inodes, numBlocks, numInodes);
+    if (!entrada.isDir)
+    {
+      flags[i] = prepararConteudo(img, entrada.content, dados[i]);
+      if (blocosNecessarios(img, dados[i].size()) > 9)
+      {
+        return false;
+      }
+    }
+  }
 
-  for (int i = 0; i < numBlocks; i++)
+  int proximoInode = 1;
+  int cursor = 1;
+  if (!distribuirDiretorio(img, img.root, filhos, raiz, entradas, dados, flags, proximoInode, cursor))
   {
-    int index = (int)floor(i / 8.0);
-
-    if (blocosUsados[i] == true && i < 8)
+    return false;
+  }
+  for (int i = 0; i < img.numInodes; i++)
+  {
+    if (img.inodes[i].IS_USED == 0x01 && img.inodes[i].IS_DIR != 0x01)
     {
-      bitMap[index] |= (1 << i);
+      mapearExtents(img, i);
     }
   }
 
-  // Posicionar o ponteiro após o numero de inodes e escrever o bitmap e os inodes no arquivo.
-  fseek(arquivo, 3, SEEK_SET);
-  fwrite(&bitMap[0], sizeof(unsigned char), bitMapSize, arquivo);
-  fwrite(&inodes[0], sizeof(INODE), numInodes, arquivo);
+  // Os inodes foram preenchidos direto; os contadores dos grupos são refeitos de uma vez.
+  recontarGrupos(img);
 
-  // Pular a raiz e escrever os blocos tratados no arquivo.
-  fseek(arquivo, 1, SEEK_CUR);
-  for (int i = 0; i < numBlocks; i++)
-  {
-    fwrite(&blocos[i][0], sizeof(unsigned char), blockSize, arquivo);
-  }
+  // Cabeçalho e índice da raiz; o resto sai em uma passada de gravarImagem.
+  unsigned char cabecalho[3] = {img.blockSize, img.numBlocks, img.numInodes};
+  escreverDispositivo(*dispositivo, 0, cabecalho, 3);
+  escreverDispositivo(*dispositivo, offsetBlocos(img) - 1, &img.root, 1);
+  return gravarImagem(img);
 }
 
 #endif /* auxFunction_hpp */
\ No newline at end of file
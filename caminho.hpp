@@ -0,0 +1,111 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Interpretação de caminhos sem alocação. Os componentes são fatias (string_view) do próprio caminho e
+// cada nome é convertido uma vez para o formato do campo NAME do inode (10 bytes completados com 0x00), de modo que a
+// comparação com cada entrada de diretório é um único memcmp. Nomes vazios ou com mais de 10 bytes são rejeitados,
+// em vez de truncados.
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#ifndef caminho_hpp
+#define caminho_hpp
+
+#include <cstring>
+#include <string_view>
+
+// Tamanho do campo NAME do inode.
+const size_t TAMANHO_NOME = 10;
+
+// Nome no formato do campo NAME: até 10 bytes, completado com 0x00.
+typedef struct
+{
+  char bytes[TAMANHO_NOME];
+} NOME_INODE;
+
+// Entradas de um diretório: cada uma ocupa um byte nos blocos do diretório e o SIZE do inode (lido sem sinal) conta
+// quantas são. Os 9 blocos também limitam: um diretório aceita min(MAX_ENTRADAS_DIRETORIO, 9 * blockSize) entradas.
+const int MAX_ENTRADAS_DIRETORIO = 255;
+
+/**
+ * @brief Lê o próximo componente de um caminho. Barras repetidas, iniciais e finais são ignoradas.
+ * @param caminho caminho completo.
+ * @param posicao posição a partir da qual procurar; avança para depois do componente.
+ * @param componente fatia do caminho com o componente.
+ * @return false quando não houver mais componentes.
+ */
+inline bool proximoComponente(std::string_view caminho, size_t &posicao, std::string_view &componente)
+{
+  while (posicao < caminho.size() && caminho[posicao] == '/')
+  {
+    posicao++;
+  }
+  if (posicao >= caminho.size())
+  {
+    return false;
+  }
+  size_t fim = caminho.find('/', posicao);
+  if (fim == std::string_view::npos)
+  {
+    fim = caminho.size();
+  }
+  componente = caminho.substr(posicao, fim - posicao);
+  posicao = fim;
+  return true;
+}
+
+/**
+ * @brief Separa o caminho do pai e o último componente: "/a/b/c" -> "/a/b" e "c"; "/c" e "/c/" -> "/" e "c".
+ * @param caminho caminho completo.
+ * @param pai caminho do pai (fatia de caminho, ou "/").
+ * @param nome último componente (vazio se o caminho for a raiz).
+ */
+inline void separarCaminho(std::string_view caminho, std::string_view &pai, std::string_view &nome)
+{
+  size_t fim = caminho.find_last_not_of('/');
+  if (fim == std::string_view::npos)
+  {
+    pai = "/";
+    nome = std::string_view();
+    return;
+  }
+  size_t barra = caminho.find_last_of('/', fim);
+  nome = barra == std::string_view::npos ? caminho.substr(0, fim + 1) : caminho.substr(barra + 1, fim - barra);
+
+  size_t fimPai = barra == std::string_view::npos ? std::string_view::npos : caminho.find_last_not_of('/', barra);
+  pai = fimPai == std::string_view::npos ? std::string_view("/") : caminho.substr(0, fimPai + 1);
+}
+
+/**
+ * @brief Converte um componente para o formato do campo NAME.
+ * @param componente nome do arquivo ou diretório.
+ * @param nome nome convertido.
+ * @return false se o componente for vazio ou tiver mais de 10 bytes.
+ */
+inline bool prepararNome(std::string_view componente, NOME_INODE &nome)
+{
+  if (componente.empty() || componente.size() > TAMANHO_NOME)
+  {
+    return false;
+  }
+  memset(nome.bytes, 0x00, TAMANHO_NOME);
+  memcpy(nome.bytes, componente.data(), componente.size());
+  return true;
+}
+
+// Compara um campo NAME com um nome convertido. Como strncmp, ignora o que houver no campo depois do primeiro 0x00.
+inline bool mesmoNome(const char *campoNome, const NOME_INODE &nome)
+{
+  for (size_t i = 0; i < TAMANHO_NOME; i++)
+  {
+    if (campoNome[i] != nome.bytes[i])
+    {
+      return false;
+    }
+    if (nome.bytes[i] == 0x00)
+    {
+      return true;
+    }
+  }
+  return true;
+}
+
+#endif /* caminho_hpp */
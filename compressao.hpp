@@ -0,0 +1,198 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Compressor LZ simples (formato de sequências no estilo LZ4) usado na compressão de arquivos.
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#ifndef compressao_hpp
+#define compressao_hpp
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+// Formato: uma lista de sequências. Cada sequência tem
+//   token (1 byte): 4 bits altos = quantidade de literais, 4 bits baixos = tamanho da cópia - 4
+//   bytes extras da quantidade de literais (se o campo for 15, somar bytes até um byte < 255)
+//   literais
+//   deslocamento da cópia (2 bytes, little endian)
+//   bytes extras do tamanho da cópia (mesma regra dos literais)
+// A última sequência tem apenas literais; o descompressor para quando gera o tamanho original.
+
+// Tamanho mínimo de uma cópia.
+const int LZ_COPIA_MINIMA = 4;
+
+// Quantidade de entradas da tabela de busca (potência de 2).
+const int LZ_TABELA = 1 << 12;
+
+// Função para ler 4 bytes como um inteiro (para a tabela de busca).
+unsigned int lzLer32(const unsigned char *p)
+{
+  unsigned int valor;
+  memcpy(&valor, p, 4);
+  return valor;
+}
+
+// Função para gravar um tamanho no formato de bytes extras (255, 255, ..., resto).
+void lzGravarTamanho(std::vector<unsigned char> &saida, int tamanho)
+{
+  while (tamanho >= 255)
+  {
+    saida.push_back(255);
+    tamanho -= 255;
+  }
+  saida.push_back(tamanho);
+}
+
+// Função para gravar uma sequência: literais seguidos de uma cópia (tamanhoCopia == 0 na última sequência).
+void lzGravarSequencia(std::vector<unsigned char> &saida, const unsigned char *literais, int numLiterais, int deslocamento, int tamanhoCopia)
+{
+  int campoLiterais = numLiterais < 15 ? numLiterais : 15;
+  int campoCopia = 0;
+  if (tamanhoCopia > 0)
+  {
+    campoCopia = tamanhoCopia - LZ_COPIA_MINIMA < 15 ? tamanhoCopia - LZ_COPIA_MINIMA : 15;
+  }
+  saida.push_back((campoLiterais << 4) | campoCopia);
+  if (campoLiterais == 15)
+  {
+    lzGravarTamanho(saida, numLiterais - 15);
+  }
+  saida.insert(saida.end(), literais, literais + numLiterais);
+
+  if (tamanhoCopia > 0)
+  {
+    saida.push_back(deslocamento & 0xFF);
+    saida.push_back((deslocamento >> 8) & 0xFF);
+    if (campoCopia == 15)
+    {
+      lzGravarTamanho(saida, tamanhoCopia - LZ_COPIA_MINIMA - 15);
+    }
+  }
+}
+
+/**
+ * @brief Comprime um conteúdo procurando repetições de 4 bytes com uma tabela hash.
+ * @param entrada conteúdo original.
+ * @return conteúdo comprimido.
+ */
+std::vector<unsigned char> comprimirLZ(const std::string &entrada)
+{
+  const unsigned char *dados = (const unsigned char *)entrada.data();
+  int tamanho = entrada.size();
+
+  std::vector<int> tabela(LZ_TABELA, -1);
+  std::vector<unsigned char> saida;
+  int ancora = 0;
+  int i = 0;
+
+  while (i + LZ_COPIA_MINIMA <= tamanho)
+  {
+    unsigned int hash = (lzLer32(dados + i) * 2654435761u) >> 20;
+    int candidato = tabela[hash];
+    tabela[hash] = i;
+
+    if (candidato >= 0 && i - candidato <= 0xFFFF && memcmp(dados + candidato, dados + i, LZ_COPIA_MINIMA) == 0)
+    {
+      int tamanhoCopia = LZ_COPIA_MINIMA;
+      while (i + tamanhoCopia < tamanho && dados[candidato + tamanhoCopia] == dados[i + tamanhoCopia])
+      {
+        tamanhoCopia++;
+      }
+      lzGravarSequencia(saida, dados + ancora, i - ancora, i - candidato, tamanhoCopia);
+      i += tamanhoCopia;
+      ancora = i;
+    }
+    else
+    {
+      i++;
+    }
+  }
+
+  lzGravarSequencia(saida, dados + ancora, tamanho - ancora, 0, 0);
+  return saida;
+}
+
+// Função para ler um tamanho no formato de bytes extras. Retorna false se a entrada acabar.
+bool lzLerTamanho(const unsigned char *entrada, size_t tamanhoEntrada, size_t &posicao, int &tamanho)
+{
+  unsigned char byte;
+  do
+  {
+    if (posicao >= tamanhoEntrada)
+    {
+      return false;
+    }
+    byte = entrada[posicao++];
+    tamanho += byte;
+  } while (byte == 255);
+  return true;
+}
+
+/**
+ * @brief Descomprime um conteúdo gerado por comprimirLZ.
+ * @param entrada conteúdo comprimido (pode ter bytes 0x00 de preenchimento no final).
+ * @param tamanhoEntrada quantidade de bytes da entrada.
+ * @param tamanhoOriginal tamanho do conteúdo original.
+ * @param saida conteúdo original.
+ * @return false se a entrada estiver corrompida.
+ */
+bool descomprimirLZ(const unsigned char *entrada, size_t tamanhoEntrada, size_t tamanhoOriginal, std::string &saida)
+{
+  saida.clear();
+  saida.reserve(tamanhoOriginal);
+  size_t posicao = 0;
+
+  while (saida.size() < tamanhoOriginal)
+  {
+    if (posicao >= tamanhoEntrada)
+    {
+      return false;
+    }
+    unsigned char token = entrada[posicao++];
+
+    int numLiterais = token >> 4;
+    if (numLiterais == 15 && !lzLerTamanho(entrada, tamanhoEntrada, posicao, numLiterais))
+    {
+      return false;
+    }
+    if (posicao + numLiterais > tamanhoEntrada || saida.size() + numLiterais > tamanhoOriginal)
+    {
+      return false;
+    }
+    saida.append((const char *)entrada + posicao, numLiterais);
+    posicao += numLiterais;
+
+    if (saida.size() == tamanhoOriginal)
+    {
+      break;
+    }
+
+    if (posicao + 2 > tamanhoEntrada)
+    {
+      return false;
+    }
+    size_t deslocamento = entrada[posicao] | (entrada[posicao + 1] << 8);
+    posicao += 2;
+
+    int tamanhoCopia = token & 0x0F;
+    if (tamanhoCopia == 15 && !lzLerTamanho(entrada, tamanhoEntrada, posicao, tamanhoCopia))
+    {
+      return false;
+    }
+    tamanhoCopia += LZ_COPIA_MINIMA;
+
+    if (deslocamento == 0 || deslocamento > saida.size() || saida.size() + tamanhoCopia > tamanhoOriginal)
+    {
+      return false;
+    }
+    // A cópia pode sobrepor o que está sendo gerado, então é feita byte a byte.
+    size_t origem = saida.size() - deslocamento;
+    for (int i = 0; i < tamanhoCopia; i++)
+    {
+      saida.push_back(saida[origem + i]);
+    }
+  }
+  return true;
+}
+
+#endif /* compressao_hpp */
@@ -0,0 +1,732 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Dispositivos onde ficam os bytes de uma imagem. Toda leitura e escrita da imagem passa por aqui,
+// por posição em bytes (o cabeçalho, o mapa de bits e os inodes não são alinhados a blocos; um intervalo de blocos é
+// a faixa offsetBlocos + bloco * blockSize).
+//
+//   DISPOSITIVO_STDIO:   FILE* com o buffer do stdio (padrão, o comportamento original)
+//   DISPOSITIVO_PREAD:   descritor com pread/pwrite, sem buffer próprio (a sessão já junta as escritas)
+//   DISPOSITIVO_MMAP:    arquivo mapeado com MAP_SHARED; cresce com ftruncate + novo mapeamento
+//   DISPOSITIVO_MEMORIA: vetor na memória do processo, para imagens com nome começando com FS_MEMORY_PREFIX
+//   DISPOSITIVO_URING:   pread/pwrite para uma faixa; lotes (lerLote/escreverLote) enviados ao io_uring com uma única
+//                        chamada ao sistema (Linux)
+//   DISPOSITIVO_THREADS: pread/pwrite para uma faixa; lotes divididos entre um conjunto de threads (usado também
+//                        quando o io_uring não está disponível)
+// No Windows pread, mmap, io_uring e threads usam o stdio. Nos demais dispositivos um lote é uma faixa após a outra.
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#ifndef dispositivo_hpp
+#define dispositivo_hpp
+
+#include "fsExt.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+enum TIPO_DISPOSITIVO
+{
+  DISPOSITIVO_STDIO,
+  DISPOSITIVO_PREAD,
+  DISPOSITIVO_MMAP,
+  DISPOSITIVO_MEMORIA,
+  DISPOSITIVO_URING,
+  DISPOSITIVO_THREADS
+};
+
+struct ANEL_URING;
+
+typedef struct
+{
+  int tipo;
+  FILE *arquivo;                            // DISPOSITIVO_STDIO
+  int descritor;                            // DISPOSITIVO_PREAD, DISPOSITIVO_MMAP, DISPOSITIVO_URING e DISPOSITIVO_THREADS
+  unsigned char *mapa;                      // DISPOSITIVO_MMAP (NULL enquanto o arquivo estiver vazio)
+  size_t tamanhoMapa;
+  shared_ptr<vector<unsigned char>> memoria; // DISPOSITIVO_MEMORIA
+  ANEL_URING *anel;                         // DISPOSITIVO_URING
+} DISPOSITIVO;
+
+// Faixa de bytes de uma leitura ou gravação em lote.
+typedef struct
+{
+  long posicao;
+  unsigned char *dados;
+  size_t tamanho;
+} FAIXA;
+
+// Imagens em memória, por nome. Cada dispositivo aberto guarda uma referência ao vetor, então descartar uma imagem
+// aberta não invalida a sessão.
+mutex travaMemoria;
+map<string, shared_ptr<vector<unsigned char>>> imagensMemoria;
+
+bool nomeEmMemoria(const string &nome)
+{
+  return nome.compare(0, strlen(FS_MEMORY_PREFIX), FS_MEMORY_PREFIX) == 0;
+}
+
+/**
+ * @brief Busca (ou cria vazia) uma imagem em memória.
+ * @param nome nome da imagem, com o prefixo.
+ * @param criar true: substitui a imagem por uma vazia.
+ * @return vetor da imagem; nulo se não existir e criar for false.
+ */
+shared_ptr<vector<unsigned char>> imagemMemoria(const string &nome, bool criar)
+{
+  lock_guard<mutex> trava(travaMemoria);
+  if (criar)
+  {
+    imagensMemoria[nome] = make_shared<vector<unsigned char>>();
+  }
+  map<string, shared_ptr<vector<unsigned char>>>::iterator imagem = imagensMemoria.find(nome);
+  return imagem == imagensMemoria.end() ? shared_ptr<vector<unsigned char>>() : imagem->second;
+}
+
+#ifndef _WIN32
+// Refaz o mapeamento com o tamanho atual do arquivo.
+bool remapear(DISPOSITIVO &dispositivo, size_t tamanho)
+{
+  if (dispositivo.mapa != NULL)
+  {
+    munmap(dispositivo.mapa, dispositivo.tamanhoMapa);
+    dispositivo.mapa = NULL;
+  }
+  dispositivo.tamanhoMapa = tamanho;
+  if (tamanho == 0)
+  {
+    return true;
+  }
+  void *mapa = mmap(NULL, tamanho, PROT_READ | PROT_WRITE, MAP_SHARED, dispositivo.descritor, 0);
+  if (mapa == MAP_FAILED)
+  {
+    dispositivo.tamanhoMapa = 0;
+    return false;
+  }
+  dispositivo.mapa = (unsigned char *)mapa;
+  return true;
+}
+
+// Lê ou grava uma faixa inteira com pread/pwrite, começando depois dos bytes já transferidos.
+// Na leitura, o que passar do fim do arquivo é preenchido com 0x00.
+bool transferirFaixa(int descritor, const FAIXA &faixa, bool gravar, size_t feitos)
+{
+  while (feitos < faixa.tamanho)
+  {
+    ssize_t n = gravar ? pwrite(descritor, faixa.dados + feitos, faixa.tamanho - feitos, faixa.posicao + feitos)
+                       : pread(descritor, faixa.dados + feitos, faixa.tamanho - feitos, faixa.posicao + feitos);
+    if (n <= 0)
+    {
+      break;
+    }
+    feitos += n;
+  }
+  if (!gravar)
+  {
+    memset(faixa.dados + feitos, 0x00, faixa.tamanho - feitos);
+  }
+  return feitos == faixa.tamanho;
+}
+
+// Conjunto de threads dos lotes de DISPOSITIVO_THREADS. As threads são criadas no primeiro lote e vivem até o fim do
+// processo; cada lote espera todas as suas faixas.
+struct THREADS_IO
+{
+  mutex trava;
+  condition_variable temTarefa;
+  deque<function<void()>> tarefas;
+  vector<thread> threads;
+  bool encerrar;
+
+  THREADS_IO() : encerrar(false) {}
+
+  ~THREADS_IO()
+  {
+    {
+      lock_guard<mutex> guarda(trava);
+      encerrar = true;
+    }
+    temTarefa.notify_all();
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+      threads[i].join();
+    }
+  }
+
+  void trabalhar()
+  {
+    while (true)
+    {
+      function<void()> tarefa;
+      {
+        unique_lock<mutex> guarda(trava);
+        temTarefa.wait(guarda, [this]() { return encerrar || !tarefas.empty(); });
+        if (tarefas.empty())
+        {
+          return;
+        }
+        tarefa = tarefas.front();
+        tarefas.pop_front();
+      }
+      tarefa();
+    }
+  }
+
+  /**
+   * @brief Divide as faixas entre as threads e espera todas terminarem.
+   * @return false se alguma faixa não for transferida inteira.
+   */
+  bool executar(int descritor, const vector<FAIXA> &faixas, bool gravar)
+  {
+    {
+      lock_guard<mutex> guarda(trava);
+      if (threads.empty())
+      {
+        unsigned quantas = max(2u, min(8u, thread::hardware_concurrency()));
+        for (unsigned i = 0; i < quantas; i++)
+        {
+          threads.push_back(thread(&THREADS_IO::trabalhar, this));
+        }
+      }
+    }
+    // Cada tarefa leva uma fatia contígua do lote, então um lote pequeno não paga uma troca de contexto por faixa.
+    size_t fatias = min(faixas.size(), threads.size());
+    size_t restantes = fatias;
+    bool ok = true;
+    mutex travaLote;
+    condition_variable terminou;
+    {
+      lock_guard<mutex> guarda(trava);
+      for (size_t f = 0; f < fatias; f++)
+      {
+        size_t inicio = faixas.size() * f / fatias, fim = faixas.size() * (f + 1) / fatias;
+        tarefas.push_back([&, inicio, fim]() {
+          bool fatiaOk = true;
+          for (size_t i = inicio; i < fim; i++)
+          {
+            fatiaOk = transferirFaixa(descritor, faixas[i], gravar, 0) && fatiaOk;
+          }
+          lock_guard<mutex> guardaLote(travaLote);
+          ok = ok && fatiaOk;
+          if (--restantes == 0)
+          {
+            terminou.notify_one();
+          }
+        });
+      }
+    }
+    temTarefa.notify_all();
+    unique_lock<mutex> guardaLote(travaLote);
+    terminou.wait(guardaLote, [&]() { return restantes == 0; });
+    return ok;
+  }
+} threadsIO;
+#endif
+
+#ifdef __linux__
+// Anel do io_uring, usado direto pelas chamadas ao sistema (sem liburing): a fila de submissão (SQ) recebe uma
+// entrada por faixa e a fila de conclusão (CQ) devolve o resultado de cada uma.
+struct ANEL_URING
+{
+  int descritor;
+  unsigned entradas;
+  unsigned *sqCabeca, *sqCauda, *sqMascara, *sqVetor;
+  struct io_uring_sqe *sqes;
+  unsigned *cqCabeca, *cqCauda, *cqMascara;
+  struct io_uring_cqe *cqes;
+  void *mapaSq, *mapaCq;
+  size_t tamanhoSq, tamanhoCq, tamanhoSqes;
+};
+
+const unsigned ENTRADAS_URING = 64;
+
+void destruirAnel(ANEL_URING *anel)
+{
+  if (anel->sqes != NULL)
+  {
+    munmap(anel->sqes, anel->tamanhoSqes);
+  }
+  if (anel->mapaCq != NULL && anel->mapaCq != anel->mapaSq)
+  {
+    munmap(anel->mapaCq, anel->tamanhoCq);
+  }
+  if (anel->mapaSq != NULL)
+  {
+    munmap(anel->mapaSq, anel->tamanhoSq);
+  }
+  close(anel->descritor);
+  delete anel;
+}
+
+// Cria o anel; NULL se o kernel não tiver io_uring (ou ele estiver bloqueado).
+ANEL_URING *criarAnel()
+{
+  struct io_uring_params parametros;
+  memset(&parametros, 0, sizeof(parametros));
+  int descritor = syscall(__NR_io_uring_setup, ENTRADAS_URING, &parametros);
+  if (descritor < 0)
+  {
+    return NULL;
+  }
+  ANEL_URING *anel = new ANEL_URING();
+  anel->descritor = descritor;
+  anel->entradas = parametros.sq_entries;
+  anel->tamanhoSq = parametros.sq_off.array + parametros.sq_entries * sizeof(unsigned);
+  anel->tamanhoCq = parametros.cq_off.cqes + parametros.cq_entries * sizeof(struct io_uring_cqe);
+  anel->tamanhoSqes = parametros.sq_entries * sizeof(struct io_uring_sqe);
+  if (parametros.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    anel->tamanhoSq = anel->tamanhoCq = max(anel->tamanhoSq, anel->tamanhoCq);
+  }
+
+  void *mapa = mmap(NULL, anel->tamanhoSq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, descritor, IORING_OFF_SQ_RING);
+  if (mapa == MAP_FAILED)
+  {
+    destruirAnel(anel);
+    return NULL;
+  }
+  anel->mapaSq = mapa;
+  if (parametros.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    anel->mapaCq = anel->mapaSq;
+  }
+  else
+  {
+    mapa = mmap(NULL, anel->tamanhoCq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, descritor, IORING_OFF_CQ_RING);
+    if (mapa == MAP_FAILED)
+    {
+      destruirAnel(anel);
+      return NULL;
+    }
+    anel->mapaCq = mapa;
+  }
+  mapa = mmap(NULL, anel->tamanhoSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, descritor, IORING_OFF_SQES);
+  if (mapa == MAP_FAILED)
+  {
+    destruirAnel(anel);
+    return NULL;
+  }
+  anel->sqes = (struct io_uring_sqe *)mapa;
+
+  unsigned char *sq = (unsigned char *)anel->mapaSq, *cq = (unsigned char *)anel->mapaCq;
+  anel->sqCabeca = (unsigned *)(sq + parametros.sq_off.head);
+  anel->sqCauda = (unsigned *)(sq + parametros.sq_off.tail);
+  anel->sqMascara = (unsigned *)(sq + parametros.sq_off.ring_mask);
+  anel->sqVetor = (unsigned *)(sq + parametros.sq_off.array);
+  anel->cqCabeca = (unsigned *)(cq + parametros.cq_off.head);
+  anel->cqCauda = (unsigned *)(cq + parametros.cq_off.tail);
+  anel->cqMascara = (unsigned *)(cq + parametros.cq_off.ring_mask);
+  anel->cqes = (struct io_uring_cqe *)(cq + parametros.cq_off.cqes);
+  return anel;
+}
+
+/**
+ * @brief Envia um lote ao anel, em grupos de até anel->entradas faixas (um io_uring_enter por grupo), e espera as
+ * conclusões. Uma faixa transferida pela metade (ou recusada pelo kernel) é completada com pread/pwrite.
+ * Se io_uring_enter falhar, nada mais é enviado: as entradas que o kernel não consumiu saem do anel, as que ele
+ * consumiu são esperadas até a conclusão (elas apontam para os buffers das faixas) e o resto do lote vai por pread/pwrite.
+ * @return false se alguma faixa não for transferida inteira.
+ */
+bool executarNoAnel(ANEL_URING *anel, int descritor, const vector<FAIXA> &faixas, bool gravar)
+{
+  bool ok = true;
+  bool falhou = false;
+  vector<bool> concluida(faixas.size(), false);
+  for (size_t primeira = 0; primeira < faixas.size() && !falhou; primeira += anel->entradas)
+  {
+    unsigned quantas = min((size_t)anel->entradas, faixas.size() - primeira);
+    unsigned inicio = *anel->sqCauda;
+    unsigned cauda = inicio;
+    for (unsigned i = 0; i < quantas; i++)
+    {
+      const FAIXA &faixa = faixas[primeira + i];
+      unsigned indice = cauda & *anel->sqMascara;
+      struct io_uring_sqe *sqe = &anel->sqes[indice];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = gravar ? IORING_OP_WRITE : IORING_OP_READ;
+      sqe->fd = descritor;
+      sqe->off = faixa.posicao;
+      sqe->addr = (unsigned long)faixa.dados;
+      sqe->len = faixa.tamanho;
+      sqe->user_data = primeira + i;
+      anel->sqVetor[indice] = indice;
+      cauda++;
+    }
+    __atomic_store_n(anel->sqCauda, cauda, __ATOMIC_RELEASE);
+
+    unsigned aEnviar = quantas, concluidas = 0;
+    while (concluidas < quantas)
+    {
+      int n = syscall(__NR_io_uring_enter, anel->descritor, falhou ? 0 : aEnviar, quantas - concluidas, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (n < 0 && errno != EINTR && !falhou)
+      {
+        // Só as entradas já consumidas pelo kernel ainda vão gerar conclusão; as outras são retiradas do anel.
+        falhou = true;
+        unsigned cabecaSq = __atomic_load_n(anel->sqCabeca, __ATOMIC_ACQUIRE);
+        __atomic_store_n(anel->sqCauda, cabecaSq, __ATOMIC_RELEASE);
+        quantas = cabecaSq - inicio;
+      }
+      else if (!falhou)
+      {
+        aEnviar -= n > 0 ? min((unsigned)n, aEnviar) : 0;
+      }
+      unsigned cabeca = *anel->cqCabeca;
+      unsigned caudaCq = __atomic_load_n(anel->cqCauda, __ATOMIC_ACQUIRE);
+      for (; cabeca != caudaCq; cabeca++, concluidas++)
+      {
+        const struct io_uring_cqe &cqe = anel->cqes[cabeca & *anel->cqMascara];
+        ok = transferirFaixa(descritor, faixas[cqe.user_data], gravar, cqe.res > 0 ? cqe.res : 0) && ok;
+        concluida[cqe.user_data] = true;
+      }
+      __atomic_store_n(anel->cqCabeca, cabeca, __ATOMIC_RELEASE);
+    }
+  }
+
+  // Faixas que não passaram pelo anel (depois de uma falha) vão inteiras por pread/pwrite.
+  for (size_t i = 0; i < faixas.size(); i++)
+  {
+    if (!concluida[i])
+    {
+      ok = transferirFaixa(descritor, faixas[i], gravar, 0) && ok;
+    }
+  }
+  return ok;
+}
+#endif
+
+/**
+ * @brief Abre o dispositivo de uma imagem. Nomes com FS_MEMORY_PREFIX sempre usam a memória.
+ * @param dispositivo dispositivo a ser preenchido.
+ * @param nome nome do arquivo (ou da imagem em memória).
+ * @param tipo FS_DEVICE pedido para arquivos.
+ * @param criar true: cria a imagem vazia (apaga a existente); false: a imagem deve existir.
+ * @return false se não puder ser aberto.
+ */
+bool abrirDispositivo(DISPOSITIVO &dispositivo, const string &nome, int tipo, bool criar)
+{
+  dispositivo.arquivo = NULL;
+  dispositivo.descritor = -1;
+  dispositivo.mapa = NULL;
+  dispositivo.tamanhoMapa = 0;
+  dispositivo.memoria.reset();
+  dispositivo.anel = NULL;
+
+  if (nomeEmMemoria(nome))
+  {
+    dispositivo.tipo = DISPOSITIVO_MEMORIA;
+    dispositivo.memoria = imagemMemoria(nome, criar);
+    return dispositivo.memoria != NULL;
+  }
+
+#ifdef _WIN32
+  tipo = FS_DEVICE_STDIO;
+#endif
+  switch (tipo)
+  {
+  case FS_DEVICE_PREAD:
+    dispositivo.tipo = DISPOSITIVO_PREAD;
+    break;
+  case FS_DEVICE_MMAP:
+    dispositivo.tipo = DISPOSITIVO_MMAP;
+    break;
+  case FS_DEVICE_URING:
+    dispositivo.tipo = DISPOSITIVO_URING;
+    break;
+  case FS_DEVICE_THREADS:
+    dispositivo.tipo = DISPOSITIVO_THREADS;
+    break;
+  default:
+    dispositivo.tipo = DISPOSITIVO_STDIO;
+  }
+  if (dispositivo.tipo == DISPOSITIVO_STDIO)
+  {
+    dispositivo.arquivo = fopen(nome.c_str(), criar ? "wb+" : "rb+");
+    return dispositivo.arquivo != NULL;
+  }
+
+#ifndef _WIN32
+  dispositivo.descritor = open(nome.c_str(), criar ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+  if (dispositivo.descritor == -1)
+  {
+    return false;
+  }
+  if (dispositivo.tipo == DISPOSITIVO_MMAP)
+  {
+    struct stat info;
+    if (fstat(dispositivo.descritor, &info) == -1 || !remapear(dispositivo, info.st_size))
+    {
+      close(dispositivo.descritor);
+      return false;
+    }
+  }
+  if (dispositivo.tipo == DISPOSITIVO_URING)
+  {
+#ifdef __linux__
+    dispositivo.anel = criarAnel();
+#endif
+    if (dispositivo.anel == NULL)
+    {
+      dispositivo.tipo = DISPOSITIVO_THREADS;
+    }
+  }
+#endif
+  return true;
+}
+
+/**
+ * @brief Lê uma faixa de bytes. O que passar do fim da imagem é preenchido com 0x00.
+ * @return false se a faixa não existir inteira.
+ */
+bool lerDispositivo(DISPOSITIVO &dispositivo, long posicao, void *dados, size_t tamanho)
+{
+  size_t lidos = 0;
+  switch (dispositivo.tipo)
+  {
+  case DISPOSITIVO_STDIO:
+    if (fseek(dispositivo.arquivo, posicao, SEEK_SET) == 0)
+    {
+      lidos = fread(dados, 1, tamanho, dispositivo.arquivo);
+    }
+    break;
+  case DISPOSITIVO_MEMORIA:
+  case DISPOSITIVO_MMAP:
+  {
+    const unsigned char *inicio = dispositivo.tipo == DISPOSITIVO_MMAP ? dispositivo.mapa : dispositivo.memoria->data();
+    size_t total = dispositivo.tipo == DISPOSITIVO_MMAP ? dispositivo.tamanhoMapa : dispositivo.memoria->size();
+    if ((size_t)posicao < total)
+    {
+      lidos = min(tamanho, total - posicao);
+      memcpy(dados, inicio + posicao, lidos);
+    }
+    break;
+  }
+#ifndef _WIN32
+  case DISPOSITIVO_PREAD:
+  case DISPOSITIVO_URING:
+  case DISPOSITIVO_THREADS:
+    while (lidos < tamanho)
+    {
+      ssize_t n = pread(dispositivo.descritor, (unsigned char *)dados + lidos, tamanho - lidos, posicao + lidos);
+      if (n <= 0)
+      {
+        break;
+      }
+      lidos += n;
+    }
+    break;
+#endif
+  }
+  memset((unsigned char *)dados + lidos, 0x00, tamanho - lidos);
+  return lidos == tamanho;
+}
+
+/**
+ * @brief Grava uma faixa de bytes, aumentando a imagem se a faixa passar do fim.
+ * @return false se a gravação falhar.
+ */
+bool escreverDispositivo(DISPOSITIVO &dispositivo, long posicao, const void *dados, size_t tamanho)
+{
+  if (tamanho == 0)
+  {
+    return true;
+  }
+  switch (dispositivo.tipo)
+  {
+  case DISPOSITIVO_STDIO:
+    return fseek(dispositivo.arquivo, posicao, SEEK_SET) == 0 && fwrite(dados, 1, tamanho, dispositivo.arquivo) == tamanho;
+  case DISPOSITIVO_MEMORIA:
+    if (dispositivo.memoria->size() < posicao + tamanho)
+    {
+      dispositivo.memoria->resize(posicao + tamanho, 0x00);
+    }
+    memcpy(dispositivo.memoria->data() + posicao, dados, tamanho);
+    return true;
+#ifndef _WIN32
+  case DISPOSITIVO_MMAP:
+    if (dispositivo.tamanhoMapa < posicao + tamanho &&
+        (ftruncate(dispositivo.descritor, posicao + tamanho) == -1 || !remapear(dispositivo, posicao + tamanho)))
+    {
+      return false;
+    }
+    memcpy(dispositivo.mapa + posicao, dados, tamanho);
+    return true;
+  case DISPOSITIVO_PREAD:
+  case DISPOSITIVO_URING:
+  case DISPOSITIVO_THREADS:
+    for (size_t gravados = 0; gravados < tamanho;)
+    {
+      ssize_t n = pwrite(dispositivo.descritor, (const unsigned char *)dados + gravados, tamanho - gravados, posicao + gravados);
+      if (n <= 0)
+      {
+        return false;
+      }
+      gravados += n;
+    }
+    return true;
+#endif
+  }
+  return false;
+}
+
+/**
+ * @brief Lê várias faixas de uma vez: uma submissão ao io_uring, ou as faixas divididas entre threads, conforme o
+ * dispositivo. As faixas não podem se sobrepor. O que passar do fim da imagem é preenchido com 0x00.
+ * @return false se alguma faixa não existir inteira.
+ */
+bool lerLote(DISPOSITIVO &dispositivo, const vector<FAIXA> &faixas)
+{
+  switch (dispositivo.tipo)
+  {
+#ifdef __linux__
+  case DISPOSITIVO_URING:
+    return executarNoAnel(dispositivo.anel, dispositivo.descritor, faixas, false);
+#endif
+#ifndef _WIN32
+  case DISPOSITIVO_THREADS:
+    if (faixas.size() > 1)
+    {
+      return threadsIO.executar(dispositivo.descritor, faixas, false);
+    }
+    // Com uma faixa só, a transferência é direta, como nos outros dispositivos.
+    [[fallthrough]];
+#endif
+  default:
+    bool ok = true;
+    for (size_t i = 0; i < faixas.size(); i++)
+    {
+      ok = lerDispositivo(dispositivo, faixas[i].posicao, faixas[i].dados, faixas[i].tamanho) && ok;
+    }
+    return ok;
+  }
+}
+
+/**
+ * @brief Grava várias faixas de uma vez (veja lerLote). A ordem entre as faixas de um lote não é garantida; quem
+ * precisa de uma ordem no disco grava lotes separados.
+ * @return false se alguma gravação falhar.
+ */
+bool escreverLote(DISPOSITIVO &dispositivo, const vector<FAIXA> &faixas)
+{
+  switch (dispositivo.tipo)
+  {
+#ifdef __linux__
+  case DISPOSITIVO_URING:
+    return executarNoAnel(dispositivo.anel, dispositivo.descritor, faixas, true);
+#endif
+#ifndef _WIN32
+  case DISPOSITIVO_THREADS:
+    if (faixas.size() > 1)
+    {
+      return threadsIO.executar(dispositivo.descritor, faixas, true);
+    }
+    // Com uma faixa só, a transferência é direta, como nos outros dispositivos.
+    [[fallthrough]];
+#endif
+  default:
+    bool ok = true;
+    for (size_t i = 0; i < faixas.size(); i++)
+    {
+      ok = escreverDispositivo(dispositivo, faixas[i].posicao, faixas[i].dados, faixas[i].tamanho) && ok;
+    }
+    return ok;
+  }
+}
+
+// Entrega ao sistema o que estiver no buffer do processo (só o stdio tem buffer próprio). Retorna false se falhar.
+bool descarregarDispositivo(DISPOSITIVO &dispositivo)
+{
+  if (dispositivo.tipo == DISPOSITIVO_STDIO)
+  {
+    return fflush(dispositivo.arquivo) == 0;
+  }
+  return true;
+}
+
+// Leva ao disco tudo o que já foi gravado no dispositivo. Não faz nada na memória. Retorna false se falhar.
+bool sincronizarDispositivo(DISPOSITIVO &dispositivo)
+{
+  switch (dispositivo.tipo)
+  {
+  case DISPOSITIVO_STDIO:
+    if (fflush(dispositivo.arquivo) != 0)
+    {
+      return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(dispositivo.arquivo)) == 0;
+#else
+    return fsync(fileno(dispositivo.arquivo)) == 0;
+#endif
+#ifndef _WIN32
+  case DISPOSITIVO_MMAP:
+    if (dispositivo.mapa != NULL && msync(dispositivo.mapa, dispositivo.tamanhoMapa, MS_SYNC) != 0)
+    {
+      return false;
+    }
+    return fsync(dispositivo.descritor) == 0;
+  case DISPOSITIVO_PREAD:
+  case DISPOSITIVO_URING:
+  case DISPOSITIVO_THREADS:
+    return fsync(dispositivo.descritor) == 0;
+#endif
+  default:
+    return true;
+  }
+}
+
+void fecharDispositivo(DISPOSITIVO &dispositivo)
+{
+  switch (dispositivo.tipo)
+  {
+  case DISPOSITIVO_STDIO:
+    fclose(dispositivo.arquivo);
+    break;
+#ifndef _WIN32
+  case DISPOSITIVO_MMAP:
+    remapear(dispositivo, 0);
+    close(dispositivo.descritor);
+    break;
+  case DISPOSITIVO_PREAD:
+  case DISPOSITIVO_THREADS:
+    close(dispositivo.descritor);
+    break;
+  case DISPOSITIVO_URING:
+#ifdef __linux__
+    destruirAnel(dispositivo.anel);
+    dispositivo.anel = NULL;
+#endif
+    close(dispositivo.descritor);
+    break;
+#endif
+  }
+  dispositivo.memoria.reset();
+}
+
+// Função para acrescentar bytes ao fim de um buffer (montagem de uma imagem antes de uma única gravação).
+void acrescentarBytes(vector<unsigned char> &saida, const void *dados, size_t tamanho)
+{
+  saida.insert(saida.end(), (const unsigned char *)dados, (const unsigned char *)dados + tamanho);
+}
+
+#endif /* dispositivo_hpp */
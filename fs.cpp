@@ -5,6 +5,218 @@
 // Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
 
 #include "auxFunction.hpp"
+#include "fsExt.h"
+#include "indice.hpp"
+#include "traco.hpp"
+#include <atomic>
+#include <chrono>
+#include <list>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct IMAGEM_POOL;
+
+// Sessão: a imagem fica carregada e as alterações só vão para o arquivo no flush.
+struct FS_SESSION
+{
+	DISPOSITIVO dispositivo;
+	IMAGEM img;
+	FS_OPTIONS options;
+
+	// Alterações desde o último flush, para o flush automático (syncEveryOps/syncIntervalMs).
+	int alteracoes;
+	chrono::steady_clock::time_point ultimoFlush;
+
+	// Índice de caminhos: montado na primeira consulta (ou no openSession com pathIndex) e atualizado a cada alteração.
+	INDICE indice;
+	string nomeImagem;
+
+	// Imagem do pool dona da sessão, liberada com releaseSession; NULL nas sessões de openSession.
+	IMAGEM_POOL *imagemPool;
+};
+
+// Imagem mapeada: imagens em memória e, no Windows, arquivos são copiados para um buffer; nos demais casos é um
+// mmap do arquivo.
+struct FS_MAPPED
+{
+	IMAGEM_MAPEADA img;
+	vector<unsigned char> copia;
+#ifndef _WIN32
+	void *base;                        // NULL quando a cópia é usada
+	size_t tamanho;
+#endif
+};
+
+// Imagem do pool. A trava da imagem fica com a requisição do acquireSession até o releaseSession.
+struct IMAGEM_POOL
+{
+	FS_SESSION *session;               // NULL até a primeira requisição terminar de abrir a imagem
+	mutex trava;
+	int usuarios;                      // requisições com a imagem adquirida ou esperando por ela
+	size_t memoria;                    // estimativa feita no último releaseSession
+	list<string>::iterator posicaoLru;
+	atomic<bool> obsoleta{false};      // o arquivo foi substituído com a imagem adquirida: a sessão é descartada sem flush
+};
+
+// Pool de imagens abertas. A trava do pool protege o mapa, a lista LRU e os contadores.
+struct POOL_SESSOES
+{
+	mutex trava;
+	atomic<size_t> limite{0};
+	FS_OPTIONS options = FS_OPTIONS();
+	map<string, unique_ptr<IMAGEM_POOL>> imagens;
+	list<string> lru;                  // a usada mais recentemente na frente
+	size_t memoria = 0;
+	long hits = 0;
+	long misses = 0;
+	long evictions = 0;
+
+	// No fim do processo as alterações que ainda estiverem no pool são gravadas.
+	~POOL_SESSOES()
+	{
+		clearHandlePool();
+	}
+};
+
+POOL_SESSOES pool;
+
+// Memória estimada de uma sessão: metadados, blocos já carregados, conteúdo pendente e índice de caminhos.
+size_t memoriaDaSessao(const FS_SESSION *session)
+{
+	const IMAGEM &img = session->img;
+	size_t total = sizeof(FS_SESSION) + img.bitMap.size() + img.inodes.size() * sizeof(INODE) + img.flagsInode.size() +
+				   img.folhaExtents.size() * sizeof(int) + img.refBloco.size() + img.hashBloco.size() * sizeof(unsigned long long) +
+				   img.indiceHash.size() * 4 * sizeof(unsigned long long) + img.blocos.size() * sizeof(vector<unsigned char>);
+	for (int b = 0; b < img.blocos.size(); b++)
+	{
+		total += img.blocos[b].capacity();
+	}
+	for (int i = 0; i < img.pendentes.size(); i++)
+	{
+		total += sizeof(ESCRITA_PENDENTE) + img.pendentes[i].conteudo.capacity();
+	}
+	for (map<string, ENTRADA_INDICE>::const_iterator i = session->indice.caminhos.begin(); i != session->indice.caminhos.end(); i++)
+	{
+		// Entrada do mapa, com os ponteiros do nó, e o caminho guardado também em caminhoDoInode.
+		total += sizeof(ENTRADA_INDICE) + 4 * sizeof(void *) + 2 * (sizeof(string) + i->first.capacity());
+	}
+	return total;
+}
+
+// Reserva para fechamento uma imagem do pool que não esteja adquirida: ela deixa de contar na memória e fica
+// adquirida até fecharReservadas. Chamada com a trava do pool.
+void reservarParaFechar(IMAGEM_POOL *imagem, vector<IMAGEM_POOL *> &fechar)
+{
+	pool.memoria -= imagem->memoria;
+	imagem->memoria = 0;
+	imagem->usuarios++;
+	fechar.push_back(imagem);
+}
+
+// Faz o flush e fecha as imagens reservadas, fora da trava do pool. Uma requisição que chegar enquanto isso espera
+// pela trava da imagem e lê o arquivo já gravado; as imagens que ninguém abriu de novo saem do pool.
+void fecharReservadas(const vector<IMAGEM_POOL *> &fechar)
+{
+	for (int i = 0; i < fechar.size(); i++)
+	{
+		IMAGEM_POOL *imagem = fechar[i];
+		imagem->trava.lock();
+		closeSession(imagem->session);
+		imagem->session = NULL;
+		imagem->trava.unlock();
+
+		// Uma requisição pode ter aberto a imagem de novo depois do fechamento: então ela continua no pool.
+		lock_guard<mutex> trava(pool.trava);
+		imagem->usuarios--;
+		if (imagem->usuarios == 0 && imagem->session == NULL)
+		{
+			string nome = *imagem->posicaoLru;
+			pool.lru.erase(imagem->posicaoLru);
+			pool.imagens.erase(nome);
+		}
+	}
+}
+
+// Reserva para fechamento as imagens menos usadas recentemente (que não estejam adquiridas) até a memória estimada
+// caber no limite. Chamada com a trava do pool.
+void descartarExcedente(vector<IMAGEM_POOL *> &fechar)
+{
+	list<string>::iterator i = pool.lru.end();
+	while (pool.memoria > pool.limite && i != pool.lru.begin())
+	{
+		i--;
+		IMAGEM_POOL *imagem = pool.imagens[*i].get();
+		if (imagem->usuarios == 0)
+		{
+			reservarParaFechar(imagem, fechar);
+			pool.evictions++;
+		}
+	}
+}
+
+// Tira do pool uma imagem que vai ser substituída (initFs, buildFs, writeMemoryImage, freeMemoryImage) ou gravada
+// por uma sessão de openSession.
+// Se estiver adquirida, fica marcada como obsoleta: nenhum flush dela chega ao arquivo novo, o último releaseSession
+// a descarta e uma requisição que estava esperando por ela lê o arquivo de novo.
+void descartarDoPool(const string &nome)
+{
+	vector<IMAGEM_POOL *> fechar;
+	{
+		lock_guard<mutex> trava(pool.trava);
+		map<string, unique_ptr<IMAGEM_POOL>>::iterator imagem = pool.imagens.find(nome);
+		if (imagem == pool.imagens.end())
+		{
+			return;
+		}
+		if (imagem->second->usuarios == 0)
+		{
+			reservarParaFechar(imagem->second.get(), fechar);
+		}
+		else
+		{
+			imagem->second->obsoleta = true;
+		}
+	}
+	fecharReservadas(fechar);
+}
+
+// Trace ativo das chamadas de fs.h. A trava protege o arquivo; ativo evita a trava quando não há trace.
+struct TRACO
+{
+	mutex trava;
+	atomic<bool> ativo{false};
+	FILE *arquivo = NULL;
+	bool conteudo = true;
+	chrono::steady_clock::time_point inicio;
+
+	// O trace é fechado (com o buffer gravado) no fim do processo.
+	~TRACO()
+	{
+		stopTrace();
+	}
+};
+
+TRACO traco;
+
+// Grava uma chamada de fs.h no trace ativo, com o tempo e a latência contados a partir do início da chamada.
+void registrarNoTraco(FS_TRACE_RECORD &registro, chrono::steady_clock::time_point inicio)
+{
+	chrono::steady_clock::time_point fim = chrono::steady_clock::now();
+	lock_guard<mutex> trava(traco.trava);
+	if (traco.arquivo == NULL)
+	{
+		return;
+	}
+	registro.timeUs = max(0L, (long)chrono::duration_cast<chrono::microseconds>(inicio - traco.inicio).count());
+	registro.latencyUs = chrono::duration_cast<chrono::microseconds>(fim - inicio).count();
+	string linha = linhaDoTraco(registro, traco.conteudo);
+	fwrite(linha.data(), sizeof(char), linha.size(), traco.arquivo);
+}
 
 /**
  * @brief Inicializa um sistema de arquivos que simula EXT3
@@ -15,353 +227,1006 @@
  */
 void initFs(string fsFileName, int blockSize, int numBlocks, int numInodes)
 {
-	// Arquivo a ser aberto no modo wb+ (escrita e leitura)
-	FILE *arquivo = fopen(fsFileName.c_str(), "wb+");
-	if (arquivo == NULL)
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+
+	// Arquivo a ser criado vazio (escrita e leitura)
+	descartarDoPool(fsFileName);
+	DISPOSITIVO dispositivo;
+	if (!abrirDispositivo(dispositivo, fsFileName, FS_DEVICE_STDIO, true))
 	{
 		printf("Error opening file!\n");
 		exit(1);
 	}
 
-	inicializar(arquivo, blockSize, numBlocks, numInodes);
+	inicializar(dispositivo, blockSize, numBlocks, numInodes);
 
 	// Fechando o arquivo
-	fclose(arquivo);
+	fecharDispositivo(dispositivo);
+
+	if (traco.ativo)
+	{
+		FS_TRACE_RECORD registro = novoRegistro(FS_TRACE_INIT, fsFileName, true);
+		registro.blockSize = blockSize;
+		registro.numBlocks = numBlocks;
+		registro.numInodes = numInodes;
+		registrarNoTraco(registro, inicio);
+	}
 }
 
 /**
- * @brief Adiciona um novo arquivo dentro do sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
- * @param fsFileName arquivo que contém um sistema de arquivos que simula EXT3.
- * @param filePath caminho completo novo arquivo dentro sistema de arquivos que simula EXT3.
- * @param fileContent conteúdo do novo arquivo
+ * @brief Inicializa um sistema de arquivos que simula EXT3 com um superbloco estendido.
+ * @param fsFileName nome do arquivo que contém sistema de arquivos que simula EXT3.
+ * @param blockSize tamanho em bytes do bloco
+ * @param numBlocks quantidade de blocos
+ * @param numInodes quantidade de inodes
+ * @param features combinação de FS_FEATURE_* (0 gera o mesmo arquivo que initFs de fs.h)
  */
-void addFile(string fsFileName, string filePath, string fileContent)
+void initFs(string fsFileName, int blockSize, int numBlocks, int numInodes, int features)
 {
-	// Arquivo a ser aberto no modo r+
-	FILE *arquivo = fopen(fsFileName.c_str(), "r+");
-	if (arquivo == NULL)
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	descartarDoPool(fsFileName);
+	DISPOSITIVO dispositivo;
+	if (!abrirDispositivo(dispositivo, fsFileName, FS_DEVICE_STDIO, true))
 	{
 		printf("Error opening file!\n");
 		exit(1);
 	}
 
-	adicionarArquivo(arquivo, filePath, fileContent);
+	inicializar(dispositivo, blockSize, numBlocks, numInodes, features);
 
-	fclose(arquivo);
+	fecharDispositivo(dispositivo);
+
+	if (traco.ativo)
+	{
+		FS_TRACE_RECORD registro = novoRegistro(FS_TRACE_INIT, fsFileName, true);
+		registro.blockSize = blockSize;
+		registro.numBlocks = numBlocks;
+		registro.numInodes = numInodes;
+		registro.features = features;
+		registrarNoTraco(registro, inicio);
+	}
 }
 
 /**
- * @brief Adiciona um novo diretório dentro do sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
- * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
- * @param dirPath caminho completo novo diretório dentro sistema de arquivos que simula EXT3.
+ * @brief Cria um sistema de arquivos que simula EXT3 já com uma árvore inteira, gravando o arquivo em uma única passada.
+ * @param fsFileName nome do arquivo que contém sistema de arquivos que simula EXT3.
+ * @param blockSize tamanho em bytes do bloco
+ * @param numBlocks quantidade de blocos
+ * @param numInodes quantidade de inodes
+ * @param features combinação de FS_FEATURE_*
+ * @param entries arquivos e diretórios, cada pai antes dos filhos.
+ * @return false se alguma entrada for inválida ou a árvore não couber na geometria.
  */
-void addDir(string fsFileName, string dirPath)
+bool buildFs(string fsFileName, int blockSize, int numBlocks, int numInodes, int features, const vector<FS_IMPORT_ENTRY> &entries)
 {
-	// Arquivo a ser aberto no modo r+
-	FILE *arquivo = fopen(fsFileName.c_str(), "r+");
-	if (arquivo == NULL)
+	descartarDoPool(fsFileName);
+	DISPOSITIVO dispositivo;
+	if (!abrirDispositivo(dispositivo, fsFileName, FS_DEVICE_STDIO, true))
 	{
 		printf("Error opening file!\n");
 		exit(1);
 	}
 
-	adicionarDiretorio(arquivo, dirPath);
+	bool ok = montarImagem(&dispositivo, blockSize, numBlocks, numInodes, features, entries);
 
-	fclose(arquivo);
+	fecharDispositivo(dispositivo);
+	return ok;
 }
 
-/**
- * @brief Remove um arquivo ou diretório (recursivamente) de um sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
- * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
- * @param path caminho completo do arquivo ou diretório a ser removido.
- */
-void remove(string fsFileName, string path)
+// Abre a sessão de uma imagem sem passar pelo pool.
+FS_SESSION *abrirSessao(const string &fsFileName, FS_OPTIONS options)
 {
-	// Arquivo a ser aberto no modo r+
-	FILE *arquivo = fopen(fsFileName.c_str(), "r+");
-	if (arquivo == NULL)
+	// Imagem aberta para leitura e escrita, no dispositivo escolhido nas opções.
+	FS_SESSION *session = new FS_SESSION;
+	if (!abrirDispositivo(session->dispositivo, fsFileName, options.device, false))
 	{
 		printf("Error opening file!\n");
 		exit(1);
 	}
 
-	if (path.find(".") != string::npos)
-	{
-		// remover arquivo
-
-		// blockSize: tamanho do bloco
-		// numBlocks: quantidade de blocos
-		// numInodes: quantidade de inodes
-		// root: inode do diretório raiz
-		unsigned char blockSize, numBlocks, numInodes, root;
-
-		// Posicionamento do ponteiro no inicio do arquivo e leitura dos 3 primeiros bytes.
-		fseek(arquivo, 0, SEEK_SET);
-		fread(&blockSize, sizeof(unsigned char), 1, arquivo);
-		fread(&numBlocks, sizeof(unsigned char), 1, arquivo);
-		fread(&numInodes, sizeof(unsigned char), 1, arquivo);
-
-		// Quantidade de bytes do mapa de bits.
-		unsigned char bitMapSize = getBitMapSize(numBlocks);
-
-		// Espaço para tratamento do mapa de bits
-		vector<unsigned char> bitMap(bitMapSize);
-
-		// Espaço para tratamento dos inodes.
-		vector<INODE> inodes(numInodes);
-
-		// Espaço para o vetor de blocos.
-		vector<vector<unsigned char>> blocos(numBlocks, vector<unsigned char>(blockSize));
-
-		// Leitura dos bytes do mapa de bits, inodes, root e blocos.
-		fread(&bitMap[0], sizeof(unsigned char), bitMapSize, arquivo);
-		fread(&inodes[0], sizeof(INODE), numInodes, arquivo);
-		fread(&root, 1, 1, arquivo);
-		for (int i = 0; i < numBlocks; i++)
-		{
-			fread(&blocos[i][0], sizeof(unsigned char), blockSize, arquivo);
-		}
-		// Vetor de blocos usados - False = livre, True = usado.
-		vector<bool> blocosUsados = mappingUsedBlocks(inodes, numBlocks, numInodes);
+	session->options = options;
+	carregarImagem(&session->dispositivo, session->img);
+	session->img.alocacaoAdiada = options.delayedAllocation;
+	session->img.politica = options.allocationPolicy;
+	session->alteracoes = 0;
+	session->ultimoFlush = chrono::steady_clock::now();
 
-		// Nome do arquivo a ser removido.
-		string arquivoNome_remove = getName(path);
+	session->nomeImagem = fsFileName;
+	session->imagemPool = NULL;
+	session->indice.carregado = false;
+	session->indice.alterado = false;
+	session->indice.assinatura = {-1, -1, 0};
+	if (options.pathIndex && (session->dispositivo.tipo == DISPOSITIVO_MEMORIA ||
+							  !lerIndice(session->indice, fsFileName + ".idx", assinaturaDaImagem(session->img, fsFileName), session->img.numInodes)))
+	{
+		construirIndice(session->indice, session->img);
+	}
+	return session;
+}
 
-		// Índice do inode do arquivo a ser removido.
-		int inode_remove = getInodeIndex(arquivoNome_remove, inodes, numInodes);
+/**
+ * @brief Abre uma sessão sobre um sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @param options opções da sessão.
+ * @return sessão aberta; deve ser fechada com closeSession.
+ */
+FS_SESSION *openSession(string fsFileName, FS_OPTIONS options)
+{
+	// O que o pool ainda não gravou da imagem vai para o arquivo antes da leitura.
+	descartarDoPool(fsFileName);
+	return abrirSessao(fsFileName, options);
+}
 
-		// Lista de blocos a serem liberados.
-		vector<unsigned char> blocosLiberar;
-		for (int i = 0; i < 3; i++)
+/**
+ * @brief Aloca os blocos pendentes e grava na imagem tudo o que foi alterado na sessão.
+ * @param session sessão aberta.
+ * @return false se alguma alteração não chegou ao arquivo.
+ */
+bool flushSession(FS_SESSION *session)
+{
+	// A imagem do pool foi substituída: gravar a sessão sobrescreveria o arquivo novo.
+	if (session->imagemPool != NULL && session->imagemPool->obsoleta)
+	{
+		return false;
+	}
+	// Uma sessão de openSession grava por cima da cópia que o pool tiver aberto da mesma imagem.
+	if (session->imagemPool == NULL)
+	{
+		descartarDoPool(session->nomeImagem);
+	}
+	IMAGEM &img = session->img;
+	vector<int> pendentes;
+	for (int i = 0; i < img.pendentes.size(); i++)
+	{
+		pendentes.push_back(img.pendentes[i].inode);
+	}
+	bool ok = alocarPendentes(img);
+	if (!ok)
+	{
+		printf("Error allocating delayed blocks!\n");
+	}
+	if (session->indice.carregado)
+	{
+		// Os arquivos adiados recebem os blocos agora; os que não couberam foram desfeitos.
+		for (int i = 0; i < pendentes.size(); i++)
 		{
-			if (inodes[inode_remove].DIRECT_BLOCKS[i] != 0x00)
+			if (img.inodes[pendentes[i]].IS_USED == 0x01)
 			{
-				blocosLiberar.push_back(inodes[inode_remove].DIRECT_BLOCKS[i]);
+				atualizarBlocosIndice(session->indice, img, pendentes[i]);
 			}
-			for (int j = 0; j < 3; j++)
+			else
 			{
-				if (inodes[inode_remove].INDIRECT_BLOCKS[i] != 0x00)
+				int pai = removerDoIndice(session->indice, pendentes[i]);
+				if (pai != -1)
 				{
-					blocosLiberar.push_back(inodes[inode_remove].INDIRECT_BLOCKS[i]);
-					for (int k = 0; k < 3; k++)
-					{
-						if (inodes[inode_remove].DOUBLE_INDIRECT_BLOCKS[i] != 0x00)
-						{
-							blocosLiberar.push_back(inodes[inode_remove].DOUBLE_INDIRECT_BLOCKS[i]);
-						}
-					}
+					atualizarBlocosIndice(session->indice, img, pai);
 				}
 			}
 		}
+	}
 
-		// Atribuir 0x00 para os campos do inode do arquivo a ser removido.
-		inodes[inode_remove].IS_USED = 0x00;
-		inodes[inode_remove].IS_DIR = 0x00;
-		inodes[inode_remove].SIZE = 0x00;
-		for (int i = 0; i < 10; i++)
+	if (session->options.durability == FS_DURABILITY_NONE)
+	{
+		ok = gravarImagem(img) && ok;
+		ok = descarregarDispositivo(session->dispositivo) && ok;
+	}
+	else
+	{
+		// Os dados chegam ao disco antes dos metadados que apontam para eles.
+		bool blocos;
+		ok = gravarBlocos(img, blocos) && ok;
+		if (blocos)
+		{
+			ok = sincronizarDispositivo(session->dispositivo) && ok;
+		}
+		bool metadados;
+		ok = gravarMetadados(img, metadados) && ok;
+		if (metadados && session->options.durability == FS_DURABILITY_FULL)
 		{
-			inodes[inode_remove].NAME[i] = 0x00;
+			ok = sincronizarDispositivo(session->dispositivo) && ok;
 		}
-		for (int i = 0; i < 3; i++)
+		else
 		{
-			inodes[inode_remove].DIRECT_BLOCKS[i] = 0x00;
-			inodes[inode_remove].INDIRECT_BLOCKS[i] = 0x00;
-			inodes[inode_remove].DOUBLE_INDIRECT_BLOCKS[i] = 0x00;
+			ok = descarregarDispositivo(session->dispositivo) && ok;
 		}
+	}
+
+	// O índice gravado fica marcado com a versão do arquivo que acabou de ser gravada. Imagens em memória não
+	// têm arquivo de índice.
+	if (session->options.pathIndex && session->dispositivo.tipo != DISPOSITIVO_MEMORIA)
+	{
+		ASSINATURA_IMAGEM assinatura = assinaturaDaImagem(img, session->nomeImagem);
+		bool desatualizado = session->indice.alterado || !mesmaAssinatura(assinatura, session->indice.assinatura);
+		if (desatualizado && !gravarIndice(session->indice, session->nomeImagem + ".idx", assinatura))
+		{
+			printf("Error writing path index!\n");
+		}
+	}
 
-		// Nome do pai do arquivo a ser removido.
-		string arquivoNome_pai = getFatherName(path);
+	session->alteracoes = 0;
+	session->ultimoFlush = chrono::steady_clock::now();
+	return ok;
+}
+
+// Fecha uma sessão sem flush (a imagem dela foi substituída).
+void descartarSessao(FS_SESSION *session)
+{
+	fecharDispositivo(session->dispositivo);
+	delete session;
+}
 
-		// Índice do inode do pai do arquivo a ser removido.
-		int inode_pai = getInodeIndex(arquivoNome_pai, inodes, numInodes);
+/**
+ * @brief Faz o flush da sessão, fecha a imagem e libera a sessão.
+ * @param session sessão aberta.
+ */
+void closeSession(FS_SESSION *session)
+{
+	flushSession(session);
+	if (session->options.durability != FS_DURABILITY_NONE)
+	{
+		sincronizarDispositivo(session->dispositivo);
+	}
+	fecharDispositivo(session->dispositivo);
+	delete session;
+}
 
-		// Decrementar o tamanho do pai do arquivo a ser removido.
-		inodes[inode_pai].SIZE -= 1;
+void configureHandlePool(size_t memoryBudget, FS_OPTIONS options)
+{
+	vector<IMAGEM_POOL *> fechar;
+	{
+		lock_guard<mutex> trava(pool.trava);
+		pool.limite = memoryBudget;
+		pool.options = options;
+		descartarExcedente(fechar);
+	}
+	fecharReservadas(fechar);
+}
 
-		// Lista de filhos do pai do arquivo a ser removido na região dos blocos.
-		vector<vector<unsigned char>> filhos_pai;
-		if (arquivoNome_pai == "/")
+FS_SESSION *acquireSession(string fsFileName)
+{
+	IMAGEM_POOL *imagem;
+	FS_OPTIONS options;
+	{
+		lock_guard<mutex> trava(pool.trava);
+		unique_ptr<IMAGEM_POOL> &entrada = pool.imagens[fsFileName];
+		if (entrada == NULL)
 		{
-			filhos_pai.push_back(blocos[0]);
-			for (int i = 0; i < 2; i++)
+			entrada.reset(new IMAGEM_POOL);
+			entrada->session = NULL;
+			entrada->usuarios = 0;
+			entrada->memoria = 0;
+			pool.lru.push_front(fsFileName);
+			entrada->posicaoLru = pool.lru.begin();
+			pool.misses++;
+		}
+		else
+		{
+			pool.lru.splice(pool.lru.begin(), pool.lru, entrada->posicaoLru);
+			pool.hits++;
+		}
+		entrada->usuarios++;
+		imagem = entrada.get();
+		options = pool.options;
+	}
+
+	// A espera pela imagem e a abertura são feitas fora da trava do pool, sem atrasar as outras imagens.
+	imagem->trava.lock();
+	if (imagem->obsoleta)
+	{
+		// O arquivo foi substituído enquanto outra requisição tinha a imagem: a sessão antiga é descartada.
+		if (imagem->session != NULL)
+		{
+			descartarSessao(imagem->session);
+			imagem->session = NULL;
+		}
+		imagem->obsoleta = false;
+	}
+	if (imagem->session == NULL)
+	{
+		imagem->session = abrirSessao(fsFileName, options);
+		imagem->session->imagemPool = imagem;
+	}
+	return imagem->session;
+}
+
+void releaseSession(FS_SESSION *session)
+{
+	if (session->imagemPool == NULL)
+	{
+		closeSession(session);
+		return;
+	}
+	size_t memoria = memoriaDaSessao(session);
+
+	vector<IMAGEM_POOL *> fechar;
+	{
+		lock_guard<mutex> trava(pool.trava);
+		IMAGEM_POOL *imagem = session->imagemPool;
+		imagem->trava.unlock();
+		pool.memoria = pool.memoria - imagem->memoria + memoria;
+		imagem->memoria = memoria;
+		imagem->usuarios--;
+		if (imagem->obsoleta && imagem->usuarios == 0)
+		{
+			// Ninguém espera pela imagem substituída: ela sai do pool sem flush.
+			pool.memoria -= imagem->memoria;
+			pool.lru.erase(imagem->posicaoLru);
+			pool.imagens.erase(session->nomeImagem);
+			descartarSessao(session);
+		}
+		descartarExcedente(fechar);
+	}
+	fecharReservadas(fechar);
+}
+
+void flushHandlePool()
+{
+	// As imagens são adquiridas como numa requisição, e o flush de cada uma é feito fora da trava do pool.
+	vector<IMAGEM_POOL *> imagens;
+	{
+		lock_guard<mutex> trava(pool.trava);
+		for (map<string, unique_ptr<IMAGEM_POOL>>::iterator i = pool.imagens.begin(); i != pool.imagens.end(); i++)
+		{
+			if (i->second->usuarios == 0)
 			{
-				if (inodes[inode_pai].DIRECT_BLOCKS[i] != 0x00)
-				{
-					filhos_pai.push_back(blocos[inodes[inode_pai].DIRECT_BLOCKS[i]]);
-				}
+				i->second->usuarios++;
+				imagens.push_back(i->second.get());
 			}
 		}
-		else
+	}
+	for (int i = 0; i < imagens.size(); i++)
+	{
+		imagens[i]->trava.lock();
+		FS_SESSION *session = imagens[i]->session;
+		flushSession(session);
+		releaseSession(session);
+	}
+}
+
+void clearHandlePool()
+{
+	vector<IMAGEM_POOL *> fechar;
+	{
+		lock_guard<mutex> trava(pool.trava);
+		for (map<string, unique_ptr<IMAGEM_POOL>>::iterator i = pool.imagens.begin(); i != pool.imagens.end(); i++)
 		{
-			for (int i = 0; i < 3; i++)
+			if (i->second->usuarios == 0)
 			{
-				if (inodes[inode_pai].DIRECT_BLOCKS[i] != 0x00)
-				{
-					filhos_pai.push_back(blocos[inodes[inode_pai].DIRECT_BLOCKS[i]]);
-				}
+				reservarParaFechar(i->second.get(), fechar);
 			}
 		}
+	}
+	fecharReservadas(fechar);
+}
 
-		// Se o inode removido não for o último filho do pai, mover o último filho para o lugar do removido.
-		// Se B[k] = F e 0 ≤ k < P.SIZE -1 (ou seja, F não é o último filho de P), faça B[j] = B[j+1] para j=k, k+1, …, P.SIZE - 2
+FS_POOL_STATS handlePoolStats()
+{
+	lock_guard<mutex> trava(pool.trava);
+	FS_POOL_STATS stats;
+	stats.hits = pool.hits;
+	stats.misses = pool.misses;
+	stats.evictions = pool.evictions;
+	stats.images = pool.imagens.size();
+	stats.memory = pool.memoria;
+	return stats;
+}
 
-		vector<vector<unsigned char>> filhos_pai_aux(2, vector<unsigned char>(2, 0x00));
+// Sessão de uma função de fs.h: a do pool, se ativo, ou uma sessão só para a operação.
+FS_SESSION *sessaoDaOperacao(const string &fsFileName)
+{
+	return pool.limite > 0 ? acquireSession(fsFileName) : openSession(fsFileName);
+}
 
-		// inicializar filhos_pai_aux com B1={0x01,0x02}, B2={0x07,0x0}.
-		filhos_pai_aux[0][0] = 0x01;
-		filhos_pai_aux[0][1] = 0x02;
-		filhos_pai_aux[1][0] = 0x07;
-		filhos_pai_aux[1][1] = 0x00;
+// Encerra a sessão de uma função de fs.h. No pool o flush é feito na hora, então o arquivo fica como ficaria sem ele.
+void encerrarOperacao(FS_SESSION *session)
+{
+	if (session->imagemPool != NULL)
+	{
+		flushSession(session);
+		releaseSession(session);
+	}
+	else
+	{
+		closeSession(session);
+	}
+}
 
-		inode_remove = 0x01;
+// Conta uma alteração e faz o flush automático quando a sessão tiver acumulado syncEveryOps alterações ou
+// quando syncIntervalMs tiver passado desde o último flush.
+bool registrarAlteracao(FS_SESSION *session, bool alterou)
+{
+	if (!alterou)
+	{
+		return false;
+	}
+	session->alteracoes++;
+	const FS_OPTIONS &options = session->options;
+	bool porOperacoes = options.syncEveryOps > 0 && session->alteracoes >= options.syncEveryOps;
+	bool porTempo = options.syncIntervalMs > 0 &&
+					chrono::steady_clock::now() - session->ultimoFlush >= chrono::milliseconds(options.syncIntervalMs);
+	if (porOperacoes || porTempo)
+	{
+		flushSession(session);
+	}
+	return true;
+}
 
-		// Se o inode removido não for o último filho do pai, mover o último filho para o lugar do removido.
-		// Se B[k] = F e 0 ≤ k < P.SIZE -1 (ou seja, F não é o último filho de P), faça B[j] = B[j+1] para j=k, k+1, …, P.SIZE - 2
+// Indexa um caminho recém-criado e recalcula os blocos do pai (vincularEntrada pode ter alocado um bloco).
+void indexarCriacao(FS_SESSION *session, const string &path)
+{
+	if (!session->indice.carregado)
+	{
+		return;
+	}
+	NOME_INODE nome;
+	int pai = resolverPai(session->img, path, nome);
+	indexarInode(session->indice, session->img, pai, buscarFilho(session->img, pai, nome));
+	atualizarBlocosIndice(session->indice, session->img, pai);
+}
+
+bool addFile(FS_SESSION *session, string filePath, string fileContent)
+{
+	bool ok = adicionarArquivo(session->img, filePath, fileContent);
+	if (ok)
+	{
+		indexarCriacao(session, filePath);
+	}
+	return registrarAlteracao(session, ok);
+}
 
-		// Remover o primeiro de três filhos do inode X cujos do blocos de dados
-		// B1={0x01,0x02}, B2={0x07,0x0}.
-		// Resultado: B1={0x02,0x07}, B2={0x07,0x0}
-		
+bool addDir(FS_SESSION *session, string dirPath)
+{
+	bool ok = adicionarDiretorio(session->img, dirPath);
+	if (ok)
+	{
+		indexarCriacao(session, dirPath);
+	}
+	return registrarAlteracao(session, ok);
+}
 
-		// Liberar os blocos do arquivo a ser removido.
-		for (int i = 0; i < blocosLiberar.size(); i++)
+bool remove(FS_SESSION *session, string path)
+{
+	int inode = session->indice.carregado ? resolverCaminho(session->img, path) : -1;
+	bool ok = removerCaminho(session->img, path);
+	if (ok && inode != -1)
+	{
+		int pai = removerDoIndice(session->indice, inode);
+		if (pai != -1)
 		{
-			blocosUsados[blocosLiberar[i]] = false;
+			atualizarBlocosIndice(session->indice, session->img, pai);
 		}
+	}
+	return registrarAlteracao(session, ok);
+}
 
-		// Mapear os blocos usados para obter o bitmap.
-		blocosUsados = mappingUsedBlocks(inodes, numBlocks, numInodes);
+bool move(FS_SESSION *session, string oldPath, string newPath)
+{
+	int inode = session->indice.carregado ? resolverCaminho(session->img, oldPath) : -1;
+	bool ok = moverCaminho(session->img, oldPath, newPath);
+	if (ok && inode != -1)
+	{
+		NOME_INODE nome;
+		moverNoIndice(session->indice, session->img, inode, resolverPai(session->img, newPath, nome));
+	}
+	return registrarAlteracao(session, ok);
+}
 
-		for (int i = 0; i < numBlocks; i++)
-		{
-			int index = (int)floor(i / 8.0);
+bool readFile(FS_SESSION *session, string filePath, string &fileContent)
+{
+	return lerArquivo(session->img, filePath, fileContent);
+}
 
-			if (blocosUsados[i] == true && i < 8)
-			{
-				bitMap[index] |= (1 << i);
-			}
-		}
+bool writeAt(FS_SESSION *session, string filePath, int offset, string data)
+{
+	bool ok = offset >= 0 && escreverEmArquivo(session->img, filePath, offset, data);
+	if (ok && session->indice.carregado)
+	{
+		atualizarBlocosIndice(session->indice, session->img, resolverCaminho(session->img, filePath));
+	}
+	return registrarAlteracao(session, ok);
+}
+
+bool append(FS_SESSION *session, string filePath, string data)
+{
+	bool ok = escreverEmArquivo(session->img, filePath, -1, data);
+	if (ok && session->indice.carregado)
+	{
+		atualizarBlocosIndice(session->indice, session->img, resolverCaminho(session->img, filePath));
+	}
+	return registrarAlteracao(session, ok);
+}
+
+bool openDir(FS_SESSION *session, string dirPath, FS_DIR &dir)
+{
+	int inode = resolverCaminho(session->img, dirPath);
+	if (inode == -1 || session->img.inodes[inode].IS_DIR != 0x01)
+	{
+		return false;
+	}
+	dir.session = session;
+	dir.dir = inode;
+	dir.position = 0;
+	return true;
+}
+
+bool readDir(FS_DIR &dir, FS_DIRENT &entry)
+{
+	IMAGEM &img = dir.session->img;
+	if (dir.position >= tamanhoInode(img.inodes[dir.dir]))
+	{
+		return false;
+	}
+	preencherEntrada(img, entradaDiretorio(img, dir.dir, dir.position), entry);
+	dir.position++;
+	return true;
+}
 
-		// Posicionar o ponteiro após o numero de inodes e escrever o bitmap e os inodes no arquivo.
-		fseek(arquivo, 3, SEEK_SET);
-		fwrite(&bitMap[0], sizeof(unsigned char), bitMapSize, arquivo);
-		fwrite(&inodes[0], sizeof(INODE), numInodes, arquivo);
+bool walkTree(FS_SESSION *session, string dirPath, FS_WALK_CALLBACK enter, FS_WALK_CALLBACK leave, void *context)
+{
+	int inode = resolverCaminho(session->img, dirPath);
+	if (inode == -1 || session->img.inodes[inode].IS_DIR != 0x01)
+	{
+		return false;
+	}
+	return percorrerArvore(session->img, inode, enter, leave, context);
+}
 
-		// Pular a raiz e escrever os blocos tratados no arquivo.
-		fseek(arquivo, 1, SEEK_CUR);
-		for (int i = 0; i < numBlocks; i++)
+FS_MAPPED *mapImage(string fsFileName)
+{
+	FS_MAPPED *image = new FS_MAPPED;
+	if (nomeEmMemoria(fsFileName))
+	{
+		shared_ptr<vector<unsigned char>> memoria = imagemMemoria(fsFileName, false);
+		if (memoria == NULL)
+		{
+			delete image;
+			return NULL;
+		}
+		image->copia = *memoria;
+#ifndef _WIN32
+		image->base = NULL;
+#endif
+		if (!interpretarMapeamento(image->copia.data(), image->copia.size(), image->img))
 		{
-			fwrite(&blocos[i][0], sizeof(unsigned char), blockSize, arquivo);
+			delete image;
+			return NULL;
 		}
+		return image;
 	}
-	else
+#ifdef _WIN32
+	FILE *arquivo = fopen(fsFileName.c_str(), "rb");
+	if (arquivo == NULL)
 	{
-		// Remover diretório
-		// Se existir arquivo dentro do diretório retorna um erro.
+		delete image;
+		return NULL;
 	}
-
+	fseek(arquivo, 0, SEEK_END);
+	image->copia.assign(ftell(arquivo), 0x00);
+	fseek(arquivo, 0, SEEK_SET);
+	fread(image->copia.data(), sizeof(unsigned char), image->copia.size(), arquivo);
 	fclose(arquivo);
+	if (!interpretarMapeamento(image->copia.data(), image->copia.size(), image->img))
+	{
+		delete image;
+		return NULL;
+	}
+#else
+	int descritor = open(fsFileName.c_str(), O_RDONLY);
+	struct stat info;
+	if (descritor == -1 || fstat(descritor, &info) == -1 || info.st_size == 0)
+	{
+		if (descritor != -1)
+		{
+			close(descritor);
+		}
+		delete image;
+		return NULL;
+	}
+	image->tamanho = info.st_size;
+	image->base = mmap(NULL, image->tamanho, PROT_READ, MAP_SHARED, descritor, 0);
+	close(descritor);
+	if (image->base == MAP_FAILED)
+	{
+		delete image;
+		return NULL;
+	}
+	if (!interpretarMapeamento((const unsigned char *)image->base, image->tamanho, image->img))
+	{
+		munmap(image->base, image->tamanho);
+		delete image;
+		return NULL;
+	}
+#endif
+	return image;
 }
 
-/**
- * @brief Move um arquivo ou diretório em um sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
- * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
- * @param oldPath caminho completo do arquivo ou diretório a ser movido.
- * @param newPath novo caminho completo do arquivo ou diretório.
- */
-void move(string fsFileName, string oldPath, string newPath)
+bool readFileMapped(FS_MAPPED *image, int inode, string &fileContent)
 {
-	FILE *arquivo = fopen(fsFileName.c_str(), "r+");
-	if (arquivo == NULL)
+	return lerArquivoMapeado(image->img, inode, fileContent);
+}
+
+void unmapImage(FS_MAPPED *image)
+{
+#ifndef _WIN32
+	if (image->base != NULL)
+	{
+		munmap(image->base, image->tamanho);
+	}
+#endif
+	delete image;
+}
+
+FS_FRAG_STATS fragmentationStats(FS_SESSION *session)
+{
+	FS_FRAG_STATS stats;
+	medirFragmentacao(session->img, stats);
+	return stats;
+}
+
+void groupInfo(FS_SESSION *session, vector<FS_GROUP_INFO> &groups)
+{
+	IMAGEM &img = session->img;
+	groups.resize(img.grupos.size());
+	for (int g = 0; g < img.grupos.size(); g++)
+	{
+		groups[g].firstBlock = g * img.blocosPorGrupo;
+		groups[g].numBlocks = min((int)img.numBlocks, (g + 1) * img.blocosPorGrupo) - groups[g].firstBlock;
+		groups[g].firstInode = min((int)img.numInodes, g * img.inodesPorGrupo);
+		groups[g].numInodes = min((int)img.numInodes, (g + 1) * img.inodesPorGrupo) - groups[g].firstInode;
+		groups[g].freeBlocks = img.grupos[g].blocosLivres;
+		groups[g].freeInodes = img.grupos[g].inodesLivres;
+		groups[g].dirs = img.grupos[g].diretorios;
+	}
+}
+
+// Totais da imagem no formato de statFs.
+FS_STATFS totaisDaImagem(int blockSize, int numBlocks, int numInodes, const TOTAIS &totais)
+{
+	FS_STATFS stats;
+	stats.blockSize = blockSize;
+	stats.numBlocks = numBlocks;
+	stats.numInodes = numInodes;
+	stats.freeBlocks = totais.blocosLivres;
+	stats.freeInodes = totais.inodesLivres;
+	stats.dirs = totais.diretorios;
+	stats.files = numInodes - totais.inodesLivres - totais.diretorios;
+	stats.usedBytes = totais.bytesUsados;
+	return stats;
+}
+
+FS_STATFS statFs(FS_SESSION *session)
+{
+	IMAGEM &img = session->img;
+	return totaisDaImagem(img.blockSize, img.numBlocks, img.numInodes, img.totais);
+}
+
+FS_STATFS statFs(string fsFileName)
+{
+	DISPOSITIVO dispositivo;
+	if (!abrirDispositivo(dispositivo, fsFileName, FS_DEVICE_STDIO, false))
 	{
 		printf("Error opening file!\n");
 		exit(1);
 	}
+	unsigned char cabecalho[3];
+	TOTAIS totais;
+	bool gravados = lerTotais(dispositivo, cabecalho, totais);
+	fecharDispositivo(dispositivo);
+	if (gravados)
+	{
+		return totaisDaImagem(cabecalho[0], cabecalho[1], cabecalho[2], totais);
+	}
 
-	unsigned char blockSize, numBlocks, numInodes, raiz, bitmap;
+	// Sem os totais gravados, eles são contados ao abrir a imagem.
+	FS_SESSION *session = sessaoDaOperacao(fsFileName);
+	FS_STATFS stats = statFs(session);
+	encerrarOperacao(session);
+	return stats;
+}
 
-	// Lendo o tamanho do bloco, número de blocos e número de inodes do arquivo.
-	fseek(arquivo, 0, SEEK_SET);
-	fread(&blockSize, sizeof(unsigned char), 1, arquivo);
-	fread(&numBlocks, sizeof(unsigned char), 1, arquivo);
-	fread(&numInodes, sizeof(unsigned char), 1, arquivo);
+bool checkFs(string fsFileName, vector<string> &problems)
+{
+	problems.clear();
+	FS_SESSION *session = openSession(fsFileName);
+	verificarImagem(session->img, problems);
+	closeSession(session);
+	return problems.empty();
+}
+
+bool startTrace(string traceFileName, bool withContent)
+{
+	stopTrace();
+	FILE *arquivo = fopen(traceFileName.c_str(), "wb");
+	if (arquivo == NULL)
+	{
+		return false;
+	}
+	lock_guard<mutex> trava(traco.trava);
+	traco.arquivo = arquivo;
+	traco.conteudo = withContent;
+	traco.inicio = chrono::steady_clock::now();
+	traco.ativo = true;
+	return true;
+}
+
+void stopTrace()
+{
+	lock_guard<mutex> trava(traco.trava);
+	traco.ativo = false;
+	if (traco.arquivo != NULL)
+	{
+		fclose(traco.arquivo);
+		traco.arquivo = NULL;
+	}
+}
+
+bool readTrace(string traceFileName, vector<FS_TRACE_RECORD> &records)
+{
+	records.clear();
+	ifstream entrada(traceFileName, ios::binary);
+	if (!entrada)
+	{
+		return false;
+	}
+	string linha;
+	while (getline(entrada, linha))
+	{
+		FS_TRACE_RECORD registro;
+		if (linha.empty())
+		{
+			continue;
+		}
+		if (!registroDaLinha(linha, registro))
+		{
+			return false;
+		}
+		records.push_back(registro);
+	}
+	return true;
+}
+
+// Monta o índice na primeira consulta de uma sessão aberta sem pathIndex.
+INDICE &indiceDaSessao(FS_SESSION *session)
+{
+	if (!session->indice.carregado)
+	{
+		construirIndice(session->indice, session->img);
+	}
+	return session->indice;
+}
 
-	// Quantidade de bytes do mapa de bits.
-	unsigned char bitmapSize = getBitMapSize(numBlocks);
-	fread(&bitmap, sizeof(unsigned char), 1, arquivo);
+bool findFiles(FS_SESSION *session, string dirPath, int largerThan, vector<FS_INDEX_ENTRY> &entries)
+{
+	INDICE &indice = indiceDaSessao(session);
+	entries.clear();
+	string caminho = normalizarCaminho(dirPath);
+	map<string, ENTRADA_INDICE>::iterator dir = indice.caminhos.find(caminho);
+	if (dir == indice.caminhos.end() || !dir->second.dir)
+	{
+		return false;
+	}
 
-	// Espaço para o vetor de inodes
-	vector<INODE> inodes(numInodes);
-	fread(&inodes[0], sizeof(INODE), numInodes, arquivo);
+	// Só o intervalo da subárvore é visitado.
+	map<string, ENTRADA_INDICE>::iterator inicio, fim;
+	intervaloSubarvore(indice, caminho, inicio, fim);
+	for (map<string, ENTRADA_INDICE>::iterator i = inicio; i != fim; i++)
+	{
+		const ENTRADA_INDICE &e = i->second;
+		if (!e.dir && e.tamanho > largerThan)
+		{
+			entries.push_back({i->first, e.inode, e.tamanho, e.blocos});
+		}
+	}
+	return true;
+}
 
-	fread(&raiz, 1, 1, arquivo);
+bool diskUsage(FS_SESSION *session, string path, FS_USAGE &usage)
+{
+	INDICE &indice = indiceDaSessao(session);
+	map<string, ENTRADA_INDICE>::iterator entrada = indice.caminhos.find(normalizarCaminho(path));
+	if (entrada == indice.caminhos.end())
+	{
+		return false;
+	}
+	const ENTRADA_INDICE &e = entrada->second;
+	usage.bytes = e.dir ? e.bytesSubarvore : e.tamanho;
+	usage.blocks = e.dir ? e.blocosSubarvore : e.blocos;
+	usage.files = e.dir ? e.arquivosSubarvore : 1;
+	usage.dirs = e.dir ? e.diretoriosSubarvore : 0;
+	return true;
+}
 
-	// Espaço para o vetor de blocos
-	vector<vector<unsigned char>> blocos(numBlocks, vector<unsigned char>(blockSize));
-	for (int i = 0; i < numBlocks; i++)
+bool readMemoryImage(string fsFileName, vector<unsigned char> &content)
+{
+	shared_ptr<vector<unsigned char>> memoria = imagemMemoria(fsFileName, false);
+	if (memoria == NULL)
 	{
-		fread(&blocos[i][0], sizeof(unsigned char), blockSize, arquivo);
+		return false;
 	}
+	content = *memoria;
+	return true;
+}
 
-	// verificar se o pai do oldPath e do newPath são iguais
-	string nomePai_newPath = "";
-	string nomePai_oldPath = "";
+void writeMemoryImage(string fsFileName, const vector<unsigned char> &content)
+{
+	descartarDoPool(fsFileName);
+	*imagemMemoria(fsFileName, true) = content;
+}
 
-	int ultimaBarra_new = newPath.find_last_of("/");
-	int ultimaBarra_old = oldPath.find_last_of("/");
+void freeMemoryImage(string fsFileName)
+{
+	descartarDoPool(fsFileName);
+	lock_guard<mutex> trava(travaMemoria);
+	imagensMemoria.erase(fsFileName);
+}
 
-	for (int i = 1; i < ultimaBarra_new; i++)
+/**
+ * @brief Lê o conteúdo de um arquivo de um sistema de arquivos que simula EXT3.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @param filePath caminho completo do arquivo.
+ * @return conteúdo do arquivo (vazio se o arquivo não existir).
+ */
+string readFile(string fsFileName, string filePath)
+{
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	string conteudo;
+	FS_SESSION *session = sessaoDaOperacao(fsFileName);
+	bool ok = readFile(session, filePath, conteudo);
+	if (!ok)
 	{
-		nomePai_newPath += newPath[i];
+		printf("Error reading file %s!\n", filePath.c_str());
 	}
-	if (nomePai_newPath == "")
+	encerrarOperacao(session);
+
+	if (traco.ativo)
 	{
-		nomePai_newPath = "/";
+		FS_TRACE_RECORD registro = novoRegistro(FS_TRACE_READ_FILE, fsFileName, ok);
+		registro.path = filePath;
+		registro.size = conteudo.size();
+		registrarNoTraco(registro, inicio);
 	}
+	return conteudo;
+}
 
-	for (int i = 1; i < ultimaBarra_old; i++)
+/**
+ * @brief Adiciona um novo arquivo dentro do sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
+ * @param fsFileName arquivo que contém um sistema de arquivos que simula EXT3.
+ * @param filePath caminho completo novo arquivo dentro sistema de arquivos que simula EXT3.
+ * @param fileContent conteúdo do novo arquivo
+ */
+void addFile(string fsFileName, string filePath, string fileContent)
+{
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	FS_SESSION *session = sessaoDaOperacao(fsFileName);
+	bool ok = addFile(session, filePath, fileContent);
+	if (!ok)
 	{
-		nomePai_oldPath += oldPath[i];
+		printf("Error adding file %s!\n", filePath.c_str());
 	}
-	if (nomePai_oldPath == "")
+	encerrarOperacao(session);
+
+	if (traco.ativo)
 	{
-		nomePai_oldPath = "/";
+		FS_TRACE_RECORD registro = novoRegistro(FS_TRACE_ADD_FILE, fsFileName, ok);
+		registro.path = filePath;
+		registro.size = fileContent.size();
+		registro.hasContent = true;
+		registro.content = fileContent;
+		registrarNoTraco(registro, inicio);
 	}
+}
 
-	if (nomePai_newPath == nomePai_oldPath)
+/**
+ * @brief Adiciona um novo diretório dentro do sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @param dirPath caminho completo novo diretório dentro sistema de arquivos que simula EXT3.
+ */
+void addDir(string fsFileName, string dirPath)
+{
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	FS_SESSION *session = sessaoDaOperacao(fsFileName);
+	bool ok = addDir(session, dirPath);
+	if (!ok)
 	{
-		// Pegar o nome do oldPath
-		string nome_oldPath = oldPath.substr(oldPath.find_last_of("/") + 1);
+		printf("Error adding directory %s!\n", dirPath.c_str());
+	}
+	encerrarOperacao(session);
 
-		// Verificar qual é o inode do oldPath
-		int inode_oldPath = 0;
-		for (int i = 0; i < numInodes; i++)
-		{
-			if (inodes[i].NAME == nome_oldPath)
-			{
-				inode_oldPath = i;
-				break;
-			}
-		}
+	if (traco.ativo)
+	{
+		FS_TRACE_RECORD registro = novoRegistro(FS_TRACE_ADD_DIR, fsFileName, ok);
+		registro.path = dirPath;
+		registrarNoTraco(registro, inicio);
+	}
+}
 
-		// Substituir o nome do oldPath pelo newPath
-		string nome_newPath = newPath.substr(newPath.find_last_of("/") + 1);
-		for (int i = 0; i < 10; i++)
-		{
-			if (i < nome_newPath.size())
-			{
-				inodes[inode_oldPath].NAME[i] = nome_newPath[i];
-			}
-			else
-			{
-				inodes[inode_oldPath].NAME[i] = 0x00;
-			}
-		}
+/**
+ * @brief Remove um arquivo ou diretório (recursivamente) de um sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @param path caminho completo do arquivo ou diretório a ser removido.
+ */
+void remove(string fsFileName, string path)
+{
+	// Uma única leitura dos metadados e uma única gravação com tudo o que foi alterado.
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	FS_SESSION *session = sessaoDaOperacao(fsFileName);
+	bool ok = remove(session, path);
+	if (!ok)
+	{
+		printf("Error removing %s!\n", path.c_str());
 	}
+	encerrarOperacao(session);
 
-	// Atualiza o inode
-	fseek(arquivo, 3 + bitmapSize, SEEK_SET);
-	fwrite(&inodes[0], sizeof(INODE), numInodes, arquivo);
+	if (traco.ativo)
+	{
+		FS_TRACE_RECORD registro = novoRegistro(FS_TRACE_REMOVE, fsFileName, ok);
+		registro.path = path;
+		registrarNoTraco(registro, inicio);
+	}
+}
 
-	fclose(arquivo);
+/**
+ * @brief Move um arquivo ou diretório em um sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @param oldPath caminho completo do arquivo ou diretório a ser movido.
+ * @param newPath novo caminho completo do arquivo ou diretório.
+ */
+void move(string fsFileName, string oldPath, string newPath)
+{
+	// Grava somente os dois blocos de diretório, o inode movido e o mapa de bits, se alterados.
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	FS_SESSION *session = sessaoDaOperacao(fsFileName);
+	bool ok = move(session, oldPath, newPath);
+	if (!ok)
+	{
+		printf("Error moving %s to %s!\n", oldPath.c_str(), newPath.c_str());
+	}
+	encerrarOperacao(session);
+
+	if (traco.ativo)
+	{
+		FS_TRACE_RECORD registro = novoRegistro(FS_TRACE_MOVE, fsFileName, ok);
+		registro.path = oldPath;
+		registro.newPath = newPath;
+		registrarNoTraco(registro, inicio);
+	}
+}
+
+bool writeAt(string fsFileName, string filePath, int offset, string data)
+{
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	FS_SESSION *session = sessaoDaOperacao(fsFileName);
+	bool ok = writeAt(session, filePath, offset, data);
+	encerrarOperacao(session);
+
+	if (traco.ativo)
+	{
+		FS_TRACE_RECORD registro = novoRegistro(FS_TRACE_WRITE_AT, fsFileName, ok);
+		registro.path = filePath;
+		registro.offset = offset;
+		registro.size = data.size();
+		registro.hasContent = true;
+		registro.content = data;
+		registrarNoTraco(registro, inicio);
+	}
+	return ok;
+}
+
+bool append(string fsFileName, string filePath, string data)
+{
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	FS_SESSION *session = sessaoDaOperacao(fsFileName);
+	bool ok = append(session, filePath, data);
+	encerrarOperacao(session);
+
+	if (traco.ativo)
+	{
+		FS_TRACE_RECORD registro = novoRegistro(FS_TRACE_APPEND, fsFileName, ok);
+		registro.path = filePath;
+		registro.size = data.size();
+		registro.hasContent = true;
+		registro.content = data;
+		registrarNoTraco(registro, inicio);
+	}
+	return ok;
 }
@@ -0,0 +1,467 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Extensões da API de fs.h (fs.h não deve ser modificado).
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#ifndef fsExt_h
+#define fsExt_h
+#include "fs.h"
+#include <string>
+#include <vector>
+
+// Features do superbloco estendido (gravado após o vetor de blocos).
+#define FS_FEATURE_COMPRESSION 0x01    // arquivos comprimidos com LZ quando economiza blocos
+#define FS_FEATURE_DEDUP       0x02    // blocos de arquivo iguais são compartilhados (SHA-256 + contador de referências)
+#define FS_FEATURE_GROUPS      0x04    // grupos de blocos: inode e dados de um arquivo ficam no mesmo grupo
+#define FS_FEATURE_COUNTERS    0x08    // totais de blocos e inodes livres, diretórios e bytes gravados no superbloco
+#define FS_FEATURE_EXTENTS     0x10    // arquivos mapeados por extensões (início, quantidade) no lugar de um ponteiro por bloco
+
+// Imagens cujo nome começa com este prefixo ("mem:teste") ficam só na memória do processo, sem arquivo. Todas as
+// funções que recebem fsFileName as aceitam.
+#define FS_MEMORY_PREFIX "mem:"
+
+/**
+ * @brief Inicializa um sistema de arquivos que simula EXT3 com um superbloco estendido.
+ * @param fsFileName nome do arquivo que contém sistema de arquivos que simula EXT3.
+ * @param blockSize tamanho em bytes do bloco
+ * @param numBlocks quantidade de blocos
+ * @param numInodes quantidade de inodes
+ * @param features combinação de FS_FEATURE_* (0 gera o mesmo arquivo que initFs de fs.h)
+ */
+void initFs(std::string fsFileName, int blockSize, int numBlocks, int numInodes, int features);
+
+// Imagem aberta por várias operações. As alterações ficam em memória até flushSession/closeSession.
+typedef struct FS_SESSION FS_SESSION;
+
+// Política de escolha dos blocos livres. Todas encontram blocos sempre que houver a quantidade pedida livre.
+typedef enum {
+    FS_ALLOC_FIRST_FIT,                // primeiros blocos livres a partir do bloco 0 (padrão, layout de fs.h)
+    FS_ALLOC_NEXT_FIT,                 // continua a partir do último bloco alocado na sessão
+    FS_ALLOC_BEST_FIT,                 // menor sequência livre em que o arquivo cabe inteiro
+    FS_ALLOC_GOAL                      // perto do bloco do diretório pai, de preferência contíguo
+} FS_ALLOC_POLICY;
+
+// Quando o que foi gravado no flush chega ao disco.
+typedef enum {
+    FS_DURABILITY_NONE,                // fica no cache do sistema; o disco é atualizado quando o sistema quiser
+    FS_DURABILITY_ORDERED,             // os blocos de dados vão ao disco antes dos metadados que apontam para eles
+    FS_DURABILITY_FULL                 // como ordered, e cada flush só termina com tudo no disco
+} FS_DURABILITY;
+
+// Como os bytes da imagem são lidos e gravados. Imagens com nome começando com FS_MEMORY_PREFIX ignoram esta opção.
+typedef enum {
+    FS_DEVICE_STDIO,                   // FILE* com o buffer do stdio (padrão)
+    FS_DEVICE_PREAD,                   // pread/pwrite no descritor, sem buffer intermediário (stdio no Windows)
+    FS_DEVICE_MMAP,                    // arquivo mapeado na memória (stdio no Windows)
+    FS_DEVICE_URING,                   // pread/pwrite; as escritas de um flush e as leituras antecipadas vão ao
+                                       // io_uring em lote (Linux; sem io_uring, FS_DEVICE_THREADS; stdio no Windows)
+    FS_DEVICE_THREADS                  // pread/pwrite; os lotes são divididos entre threads (stdio no Windows)
+} FS_DEVICE;
+
+typedef struct {
+    bool delayedAllocation;            // true: blocos dos arquivos são alocados só no flush
+    FS_ALLOC_POLICY allocationPolicy;  // ignorada pelos blocos de arquivos com alocação adiada
+    FS_DURABILITY durability;
+    int syncEveryOps;                  // > 0: flush automático a cada syncEveryOps alterações
+    int syncIntervalMs;                // > 0: flush automático na primeira alteração depois de syncIntervalMs do último flush
+    bool pathIndex;                    // true: o índice de caminhos é lido de <imagem>.idx (ou reconstruído) e gravado no flush
+    FS_DEVICE device;
+} FS_OPTIONS;
+
+/**
+ * @brief Abre uma sessão sobre um sistema de arquivos que simula EXT3. O sistema já deve ter sido inicializado.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @param options opções da sessão.
+ * @return sessão aberta; deve ser fechada com closeSession.
+ */
+FS_SESSION *openSession(std::string fsFileName, FS_OPTIONS options = FS_OPTIONS());
+
+/**
+ * @brief Aloca os blocos pendentes e grava na imagem tudo o que foi alterado na sessão, conforme options.durability.
+ * @param session sessão aberta.
+ * @return false se alguma alteração não chegou ao arquivo (gravação ou sincronização falhou, blocos adiados sem
+ * espaço, ou imagem do pool substituída).
+ */
+bool flushSession(FS_SESSION *session);
+
+/**
+ * @brief Faz o flush da sessão, fecha a imagem e libera a sessão.
+ * @param session sessão aberta.
+ */
+void closeSession(FS_SESSION *session);
+
+// Versões de addFile, addDir, remove e move que operam sobre uma sessão aberta.
+// Retornam false (sem alterar a imagem) se a operação não puder ser feita.
+bool addFile(FS_SESSION *session, std::string filePath, std::string fileContent);
+bool addDir(FS_SESSION *session, std::string dirPath);
+bool remove(FS_SESSION *session, std::string path);
+bool move(FS_SESSION *session, std::string oldPath, std::string newPath);
+
+/**
+ * @brief Lê o conteúdo de um arquivo de um sistema de arquivos que simula EXT3.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @param filePath caminho completo do arquivo.
+ * @return conteúdo do arquivo (vazio se o arquivo não existir).
+ */
+std::string readFile(std::string fsFileName, std::string filePath);
+bool readFile(FS_SESSION *session, std::string filePath, std::string &fileContent);
+
+/**
+ * @brief Escreve dados em um arquivo existente a partir de uma posição, sem regravar o arquivo inteiro: só os blocos
+ * que a faixa cobre são alterados e blocos novos só são alocados depois do fim. Escrever depois do fim deixa zeros
+ * (buracos) entre o fim antigo e offset. Arquivos comprimidos são regravados inteiros.
+ * @param fsFileName arquivo que contém um sistema de arquivos que simula EXT3.
+ * @param filePath caminho completo do arquivo.
+ * @param offset posição do primeiro byte escrito (0 a 255).
+ * @param data bytes escritos.
+ * @return false (sem alterar a imagem) se o arquivo não existir, for um diretório, passar de 255 bytes ou faltar bloco.
+ */
+bool writeAt(std::string fsFileName, std::string filePath, int offset, std::string data);
+bool writeAt(FS_SESSION *session, std::string filePath, int offset, std::string data);
+
+/**
+ * @brief Acrescenta dados ao fim de um arquivo existente (writeAt na posição SIZE).
+ * @param fsFileName arquivo que contém um sistema de arquivos que simula EXT3.
+ * @param filePath caminho completo do arquivo.
+ * @param data bytes acrescentados.
+ * @return false (sem alterar a imagem) se o arquivo não existir, for um diretório, passar de 255 bytes ou faltar bloco.
+ */
+bool append(std::string fsFileName, std::string filePath, std::string data);
+bool append(FS_SESSION *session, std::string filePath, std::string data);
+
+// Imagem mapeada somente para leitura. Pode ser lida por várias threads ao mesmo tempo.
+typedef struct FS_MAPPED FS_MAPPED;
+
+/**
+ * @brief Mapeia em memória um sistema de arquivos que simula EXT3 para leitura (mmap; no Windows a imagem é lida inteira).
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @return imagem mapeada (NULL se não puder ser aberta); deve ser liberada com unmapImage.
+ */
+FS_MAPPED *mapImage(std::string fsFileName);
+
+/**
+ * @brief Lê o conteúdo de um arquivo pelo número do inode, direto dos blocos da imagem mapeada. Thread-safe.
+ * @param image imagem mapeada.
+ * @param inode número do inode (ex. FS_DIRENT::inode obtido com walkTree).
+ * @param fileContent conteúdo do arquivo.
+ * @return false se o inode não for de um arquivo ou se os dados estiverem corrompidos.
+ */
+bool readFileMapped(FS_MAPPED *image, int inode, std::string &fileContent);
+
+/**
+ * @brief Desfaz o mapeamento e libera a imagem.
+ * @param image imagem mapeada.
+ */
+void unmapImage(FS_MAPPED *image);
+
+// Entrada de diretório. name aponta para o NAME do inode (não termina em '\0' se tiver 10 caracteres: use nameLength).
+typedef struct {
+    int inode;
+    const char *name;
+    int nameLength;
+    bool isDir;
+    int size;                          // bytes do arquivo ou quantidade de entradas do diretório
+} FS_DIRENT;
+
+// Iterador de diretório. Não deve ser usado depois de alterar o diretório na mesma sessão.
+typedef struct {
+    FS_SESSION *session;
+    int dir;
+    int position;
+} FS_DIR;
+
+/**
+ * @brief Abre um diretório para leitura das entradas com readDir.
+ * @param session sessão aberta.
+ * @param dirPath caminho completo do diretório.
+ * @param dir iterador a ser preenchido.
+ * @return false se o caminho não existir ou não for um diretório.
+ */
+bool openDir(FS_SESSION *session, std::string dirPath, FS_DIR &dir);
+
+/**
+ * @brief Lê a próxima entrada de um diretório, na ordem das entradas. Não aloca memória.
+ * @param dir iterador aberto com openDir.
+ * @param entry entrada lida.
+ * @return false quando não houver mais entradas.
+ */
+bool readDir(FS_DIR &dir, FS_DIRENT &entry);
+
+// Resposta do callback de walkTree.
+typedef enum {
+    FS_WALK_CONTINUE,                  // segue normalmente
+    FS_WALK_SKIP,                      // não desce neste diretório
+    FS_WALK_STOP                       // encerra o percurso
+} FS_WALK_ACTION;
+
+typedef FS_WALK_ACTION (*FS_WALK_CALLBACK)(const FS_DIRENT &entry, int depth, void *context);
+
+/**
+ * @brief Percorre em profundidade a árvore abaixo de um diretório, sem alocar memória por entrada.
+ * @param session sessão aberta.
+ * @param dirPath caminho completo do diretório inicial (ele mesmo não é visitado).
+ * @param enter chamado para cada entrada antes dos filhos (pré-ordem); pode podar com FS_WALK_SKIP.
+ * @param leave chamado para cada diretório depois dos filhos (pós-ordem); pode ser NULL.
+ * @param context ponteiro repassado aos callbacks.
+ * @return false se o caminho não for um diretório ou se um callback pedir FS_WALK_STOP.
+ */
+bool walkTree(FS_SESSION *session, std::string dirPath, FS_WALK_CALLBACK enter, FS_WALK_CALLBACK leave, void *context);
+
+// Fragmentação da imagem. Uma extensão é uma sequência de ponteiros de um arquivo para blocos consecutivos.
+typedef struct {
+    int files;                         // arquivos com pelo menos um bloco
+    int fileBlocks;
+    int extents;
+    double averageExtentLength;        // fileBlocks / extents
+    int fragmentedFiles;               // arquivos com mais de uma extensão
+    int freeBlocks;
+    int freeRuns;                      // sequências máximas de blocos livres
+    int largestFreeRun;
+    int freeRunHistogram[8];           // posição k: sequências livres com 2^k a 2^(k+1) - 1 blocos
+} FS_FRAG_STATS;
+
+/**
+ * @brief Mede a fragmentação dos arquivos e do espaço livre.
+ * @param session sessão aberta.
+ * @return métricas de fragmentação.
+ */
+FS_FRAG_STATS fragmentationStats(FS_SESSION *session);
+
+// Grupo de blocos. Sem FS_FEATURE_GROUPS a imagem inteira é um único grupo.
+typedef struct {
+    int firstBlock;
+    int numBlocks;                     // 8 * blockSize (o mapa de bits do grupo ocupa um bloco), menos no último grupo
+    int firstInode;
+    int numInodes;
+    int freeBlocks;
+    int freeInodes;
+    int dirs;
+} FS_GROUP_INFO;
+
+// Ocupação da imagem. Os totais são mantidos a cada alteração, então statFs não percorre a imagem.
+typedef struct {
+    int blockSize;
+    int numBlocks;
+    int numInodes;
+    int freeBlocks;
+    int freeInodes;
+    int files;
+    int dirs;                          // inclui a raiz
+    long usedBytes;                    // soma do tamanho dos arquivos
+} FS_STATFS;
+
+/**
+ * @brief Ocupação de uma imagem aberta, em tempo constante.
+ * @param session sessão aberta.
+ * @return totais da imagem, incluindo as alterações ainda não gravadas.
+ */
+FS_STATFS statFs(FS_SESSION *session);
+
+/**
+ * @brief Ocupação de uma imagem. Com FS_FEATURE_COUNTERS lê só o cabecalho e os totais do superbloco; sem, abre a
+ * imagem e conta.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @return totais da imagem.
+ */
+FS_STATFS statFs(std::string fsFileName);
+
+/**
+ * @brief Confere uma imagem (fsck): o mapa de bits contra os blocos usados pelos inodes e os contadores dos grupos e
+ * os totais contra uma contagem completa.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @param problems uma mensagem por divergência encontrada.
+ * @return true se nenhuma divergência foi encontrada.
+ */
+bool checkFs(std::string fsFileName, std::vector<std::string> &problems);
+
+/**
+ * @brief Lê os descritores dos grupos de blocos.
+ * @param session sessão aberta.
+ * @param groups um descritor por grupo.
+ */
+void groupInfo(FS_SESSION *session, std::vector<FS_GROUP_INFO> &groups);
+
+// Consultas pelo índice de caminhos. O índice é montado uma vez por sessão (ou lido de <imagem>.idx com
+// FS_OPTIONS::pathIndex) e atualizado por addFile/addDir/remove/move, sem percorrer a imagem a cada consulta.
+typedef struct {
+    std::string path;
+    int inode;
+    int size;
+    int blocks;                        // 0 enquanto o arquivo esperar a alocação adiada
+} FS_INDEX_ENTRY;
+
+typedef struct {
+    long bytes;                        // soma do tamanho dos arquivos
+    int blocks;                        // blocos dos arquivos e dos diretórios, incluindo o próprio caminho
+    int files;
+    int dirs;                          // subdiretórios (o próprio caminho não conta)
+} FS_USAGE;
+
+/**
+ * @brief Lista os arquivos da subárvore de um diretório maiores que um tamanho. Visita só as entradas da subárvore.
+ * @param session sessão aberta.
+ * @param dirPath caminho completo do diretório.
+ * @param largerThan tamanho mínimo exclusivo em bytes (-1 lista todos).
+ * @param entries arquivos encontrados, em ordem de caminho.
+ * @return false se o caminho não existir ou não for um diretório.
+ */
+bool findFiles(FS_SESSION *session, std::string dirPath, int largerThan, std::vector<FS_INDEX_ENTRY> &entries);
+
+/**
+ * @brief Espaço usado e quantidade de arquivos e diretórios abaixo de um caminho, em O(log n).
+ * @param session sessão aberta.
+ * @param path caminho completo de um arquivo ou diretório.
+ * @param usage totais do caminho.
+ * @return false se o caminho não existir.
+ */
+bool diskUsage(FS_SESSION *session, std::string path, FS_USAGE &usage);
+
+// Entrada para buildFs.
+typedef struct {
+    std::string path;                  // caminho completo dentro da imagem
+    bool isDir;
+    std::string content;               // conteúdo (apenas arquivos)
+} FS_IMPORT_ENTRY;
+
+/**
+ * @brief Cria um sistema de arquivos que simula EXT3 já com uma árvore inteira, gravando o arquivo em uma única passada.
+ * Cada diretório é seguido pelos blocos dos seus arquivos e depois pelos subdiretórios.
+ * @param fsFileName nome do arquivo que contém sistema de arquivos que simula EXT3.
+ * @param blockSize tamanho em bytes do bloco
+ * @param numBlocks quantidade de blocos
+ * @param numInodes quantidade de inodes
+ * @param features combinação de FS_FEATURE_*
+ * @param entries arquivos e diretórios, cada pai antes dos filhos.
+ * @return false se alguma entrada for inválida ou a árvore não couber na geometria.
+ */
+bool buildFs(std::string fsFileName, int blockSize, int numBlocks, int numInodes, int features, const std::vector<FS_IMPORT_ENTRY> &entries);
+
+/**
+ * @brief Copia o conteúdo de uma imagem em memória.
+ * @param fsFileName nome da imagem, com FS_MEMORY_PREFIX.
+ * @param content bytes da imagem.
+ * @return false se a imagem não existir.
+ */
+bool readMemoryImage(std::string fsFileName, std::vector<unsigned char> &content);
+
+/**
+ * @brief Cria (ou substitui) uma imagem em memória com o conteúdo dado, por exemplo lido de um arquivo.
+ * @param fsFileName nome da imagem, com FS_MEMORY_PREFIX.
+ * @param content bytes da imagem.
+ */
+void writeMemoryImage(std::string fsFileName, const std::vector<unsigned char> &content);
+
+/**
+ * @brief Descarta uma imagem em memória. Sessões ainda abertas sobre ela continuam válidas até closeSession.
+ * @param fsFileName nome da imagem, com FS_MEMORY_PREFIX.
+ */
+void freeMemoryImage(std::string fsFileName);
+
+// Pool de imagens abertas, compartilhado pelo processo. Cada imagem fica aberta e interpretada entre as requisições
+// até ser descartada pela menos usada recentemente (com flush antes) quando a memória estimada do pool passar do
+// limite. Requisições simultâneas para a mesma imagem usam a mesma sessão, uma de cada vez. Com o limite maior que 0,
+// as funções de fs.h também usam o pool (e fazem o flush a cada alteração, como antes). O pool supõe que as imagens
+// só são alteradas por este processo; initFs, buildFs, writeMemoryImage, openSession e o flush de uma sessão de
+// openSession descartam a imagem do pool.
+typedef struct {
+    long hits;                         // requisições atendidas por uma imagem já aberta
+    long misses;
+    long evictions;
+    int images;                        // imagens abertas no pool
+    size_t memory;                     // memória estimada das imagens abertas, em bytes
+} FS_POOL_STATS;
+
+/**
+ * @brief Configura o pool de imagens abertas. Imagens além do novo limite são descartadas.
+ * @param memoryBudget limite de memória estimada em bytes (0 desativa o pool: cada sessão é fechada ao ser liberada).
+ * @param options opções das sessões abertas pelo pool.
+ */
+void configureHandlePool(size_t memoryBudget, FS_OPTIONS options = FS_OPTIONS());
+
+/**
+ * @brief Obtém a sessão de uma imagem do pool, abrindo-a se necessário, e a reserva para a thread atual.
+ * Outras requisições para a mesma imagem esperam até releaseSession. Se a imagem for substituída enquanto adquirida
+ * (initFs, buildFs, writeMemoryImage, freeMemoryImage), as alterações da sessão são descartadas sem flush e a
+ * próxima acquireSession lê a imagem nova.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @return sessão da imagem; deve ser liberada com releaseSession pela mesma thread (não com closeSession).
+ */
+FS_SESSION *acquireSession(std::string fsFileName);
+
+/**
+ * @brief Devolve ao pool uma sessão obtida com acquireSession. As alterações ficam na sessão até o próximo flush.
+ * @param session sessão adquirida.
+ */
+void releaseSession(FS_SESSION *session);
+
+/**
+ * @brief Faz o flush de todas as imagens do pool que não estiverem adquiridas.
+ */
+void flushHandlePool();
+
+/**
+ * @brief Faz o flush e fecha todas as imagens do pool que não estiverem adquiridas. Também é chamada no fim do processo.
+ */
+void clearHandlePool();
+
+FS_POOL_STATS handlePoolStats();
+
+// Trace das chamadas de fs.h (initFs, addFile, addDir, remove, move, readFile) e de writeAt/append por nome de
+// arquivo, uma linha JSON por chamada, para repetir a carga depois (tools/fsReplay.cpp). As chamadas por sessão não
+// são registradas.
+typedef enum {
+    FS_TRACE_INIT,
+    FS_TRACE_ADD_FILE,
+    FS_TRACE_ADD_DIR,
+    FS_TRACE_REMOVE,
+    FS_TRACE_MOVE,
+    FS_TRACE_READ_FILE,
+    FS_TRACE_WRITE_AT,
+    FS_TRACE_APPEND,
+    FS_TRACE_NUM_OPS
+} FS_TRACE_OP;
+
+// Nome de cada FS_TRACE_OP no campo "op" do trace.
+inline const char *const FS_TRACE_OP_NAMES[FS_TRACE_NUM_OPS] = {"initFs", "addFile", "addDir", "remove", "move", "readFile",
+                                                                "writeAt", "append"};
+
+typedef struct {
+    FS_TRACE_OP op;
+    long timeUs;                       // início da chamada, em microssegundos desde startTrace
+    long latencyUs;
+    bool ok;
+    std::string image;
+    std::string path;
+    std::string newPath;               // move
+    int size;                          // addFile, writeAt, append: tamanho do conteúdo; readFile: tamanho lido
+    bool hasContent;                   // addFile, writeAt, append: false se o trace foi gravado sem o conteúdo
+    std::string content;
+    int offset;                        // writeAt
+    int blockSize;                     // initFs
+    int numBlocks;
+    int numInodes;
+    int features;
+} FS_TRACE_RECORD;
+
+/**
+ * @brief Começa a registrar as chamadas de fs.h em um arquivo de trace (substitui o trace ativo, se houver).
+ * @param traceFileName arquivo do trace (JSON lines).
+ * @param withContent false: registra só o tamanho do conteúdo de addFile, writeAt e append.
+ * @return false se o arquivo não puder ser criado.
+ */
+bool startTrace(std::string traceFileName, bool withContent = true);
+
+/**
+ * @brief Para de registrar e fecha o arquivo de trace.
+ */
+void stopTrace();
+
+/**
+ * @brief Lê um trace gravado por startTrace.
+ * @param traceFileName arquivo do trace.
+ * @param records chamadas, na ordem em que terminaram.
+ * @return false se o arquivo não puder ser lido ou tiver uma linha inválida.
+ */
+bool readTrace(std::string traceFileName, std::vector<FS_TRACE_RECORD> &records);
+
+#endif /* fsExt_h */
@@ -0,0 +1,528 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Imagem com geometria fixa em tempo de compilação (blockSize, numBlocks e numInodes como parâmetros
+// de template). As posições das tabelas são constexpr, o armazenamento é std::array e os laços sobre o mapa de bits e
+// os inodes são desenrolados pelo compilador. O arquivo gravado é idêntico ao das funções de fs.h para a mesma
+// sequência de operações, então as duas formas podem ser usadas sobre a mesma imagem.
+// Apenas imagens sem superbloco estendido (features == 0) são aceitas.
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#ifndef fsFixed_h
+#define fsFixed_h
+#include "fs.h"
+#include "caminho.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+template <size_t BlockSize, size_t NumBlocks, size_t NumInodes>
+struct FS_FIXED_IMAGE
+{
+    static_assert(BlockSize >= 1 && BlockSize <= 255, "blockSize is stored in 1 byte");
+    static_assert(NumBlocks >= 1 && NumBlocks <= 255, "numBlocks is stored in 1 byte");
+    static_assert(NumInodes >= 1 && NumInodes <= 255, "numInodes is stored in 1 byte");
+
+    // Layout do arquivo: cabeçalho (3 bytes) | mapa de bits | inodes | raiz (1 byte) | blocos.
+    static constexpr size_t BIT_MAP_SIZE = (NumBlocks + 7) / 8;
+    static constexpr size_t INODES_OFFSET = 3 + BIT_MAP_SIZE;
+    static constexpr size_t ROOT_OFFSET = INODES_OFFSET + NumInodes * sizeof(INODE);
+    static constexpr size_t BLOCKS_OFFSET = ROOT_OFFSET + 1;
+    static constexpr size_t IMAGE_SIZE = BLOCKS_OFFSET + NumBlocks * BlockSize;
+
+    std::array<unsigned char, BIT_MAP_SIZE> bitMap;
+    std::array<INODE, NumInodes> inodes;
+    unsigned char root;
+    std::array<std::array<unsigned char, BlockSize>, NumBlocks> blocks;
+};
+
+// Executa f(0), f(1), ..., f(N - 1) desenrolado em tempo de compilação, parando no primeiro que retornar true.
+template <typename F, size_t... I>
+bool algumIndice(F f, std::index_sequence<I...>)
+{
+  return (f(I) || ...);
+}
+
+template <size_t N, typename F>
+bool algumIndice(F f)
+{
+  return algumIndice(f, std::make_index_sequence<N>());
+}
+
+template <size_t B, size_t N, size_t I>
+void marcarBlocoFixo(FS_FIXED_IMAGE<B, N, I> &img, int bloco, bool usado)
+{
+  if (usado)
+  {
+    img.bitMap[bloco / 8] |= (1 << (bloco % 8));
+  }
+  else
+  {
+    img.bitMap[bloco / 8] &= ~(1 << (bloco % 8));
+  }
+}
+
+// Escolhe os n primeiros blocos livres (first-fit), um byte do mapa de bits por vez. Retorna quantos encontrou.
+template <size_t B, size_t N, size_t I>
+int escolherLivresFixo(const FS_FIXED_IMAGE<B, N, I> &img, int n, int *blocos)
+{
+  int encontrados = 0;
+  algumIndice<FS_FIXED_IMAGE<B, N, I>::BIT_MAP_SIZE>([&](size_t k)
+                                                      {
+    // Bytes cheios são pulados inteiros; os bits além de numBlocks nunca são marcados.
+    unsigned int livres = ~img.bitMap[k] & 0xFF;
+    while (livres != 0 && encontrados < n)
+    {
+      int bloco = k * 8 + __builtin_ctz(livres);
+      if (bloco >= (int)N)
+      {
+        break;
+      }
+      blocos[encontrados++] = bloco;
+      livres &= livres - 1;
+    }
+    return encontrados == n; });
+  return encontrados;
+}
+
+template <size_t B, size_t N, size_t I>
+int inodeLivreFixo(const FS_FIXED_IMAGE<B, N, I> &img)
+{
+  int livre = -1;
+  algumIndice<I>([&](size_t i)
+                 {
+    if (img.inodes[i].IS_USED == 0x00)
+    {
+      livre = i;
+      return true;
+    }
+    return false; });
+  return livre;
+}
+
+// O j-ésimo dos 9 ponteiros de bloco do inode (DIRECT, INDIRECT e DOUBLE_INDIRECT em sequência).
+inline unsigned char &ponteiroFixo(INODE &inode, int j)
+{
+  return j < 3 ? inode.DIRECT_BLOCKS[j] : j < 6 ? inode.INDIRECT_BLOCKS[j - 3] : inode.DOUBLE_INDIRECT_BLOCKS[j - 6];
+}
+
+template <size_t B, size_t N, size_t I>
+int entradaFixa(FS_FIXED_IMAGE<B, N, I> &img, int dir, int i)
+{
+  return img.blocks[ponteiroFixo(img.inodes[dir], i / B)][i % B];
+}
+
+template <size_t B, size_t N, size_t I>
+int buscarFilhoFixo(FS_FIXED_IMAGE<B, N, I> &img, int dir, const NOME_INODE &nome)
+{
+  for (int i = 0; i < (unsigned char)img.inodes[dir].SIZE; i++)
+  {
+    int filho = entradaFixa(img, dir, i);
+    if (mesmoNome(img.inodes[filho].NAME, nome))
+    {
+      return filho;
+    }
+  }
+  return -1;
+}
+
+// Índice do inode de um caminho absoluto; -1 se algum componente não existir ou o caminho atravessar evitar.
+template <size_t B, size_t N, size_t I>
+int resolverCaminhoFixo(FS_FIXED_IMAGE<B, N, I> &img, std::string_view path, int evitar = -1)
+{
+  int atual = img.root;
+  size_t posicao = 0;
+  std::string_view componente;
+  NOME_INODE nome;
+  while (proximoComponente(path, posicao, componente))
+  {
+    if (img.inodes[atual].IS_DIR != 0x01 || !prepararNome(componente, nome))
+    {
+      return -1;
+    }
+    atual = buscarFilhoFixo(img, atual, nome);
+    if (atual == -1 || atual == evitar)
+    {
+      return -1;
+    }
+  }
+  return atual;
+}
+
+// Diretório pai de um caminho e último componente convertido; -1 como em resolverPai.
+template <size_t B, size_t N, size_t I>
+int resolverPaiFixo(FS_FIXED_IMAGE<B, N, I> &img, std::string_view path, NOME_INODE &nome, int evitar = -1)
+{
+  std::string_view caminhoPai, componente;
+  separarCaminho(path, caminhoPai, componente);
+  if (!prepararNome(componente, nome))
+  {
+    return -1;
+  }
+  int pai = resolverCaminhoFixo(img, caminhoPai, evitar);
+  return pai == -1 || pai == evitar || img.inodes[pai].IS_DIR != 0x01 ? -1 : pai;
+}
+
+// Acrescenta uma entrada ao diretório, alocando um bloco se o último estiver cheio (mesma regra de vincularEntrada).
+template <size_t B, size_t N, size_t I>
+bool vincularFixo(FS_FIXED_IMAGE<B, N, I> &img, int pai, int filho)
+{
+  int tamanho = (unsigned char)img.inodes[pai].SIZE;
+  int j = tamanho / B;
+  if (j >= 9 || tamanho >= MAX_ENTRADAS_DIRETORIO)
+  {
+    return false;
+  }
+  unsigned char &ponteiro = ponteiroFixo(img.inodes[pai], j);
+  if (j > 0 && ponteiro == 0x00)
+  {
+    int novoBloco;
+    if (escolherLivresFixo(img, 1, &novoBloco) != 1)
+    {
+      return false;
+    }
+    marcarBlocoFixo(img, novoBloco, true);
+    ponteiro = novoBloco;
+  }
+  img.blocks[ponteiro][tamanho % B] = filho;
+  img.inodes[pai].SIZE = tamanho + 1;
+  return true;
+}
+
+// Retira uma entrada do diretório, deslocando as seguintes e liberando o último bloco se sobrar (mesma regra de desvincularEntrada).
+template <size_t B, size_t N, size_t I>
+void desvincularFixo(FS_FIXED_IMAGE<B, N, I> &img, int pai, int filho)
+{
+  int tamanho = (unsigned char)img.inodes[pai].SIZE;
+  int k = 0;
+  while (k < tamanho && entradaFixa(img, pai, k) != filho)
+  {
+    k++;
+  }
+  if (k == tamanho)
+  {
+    return;
+  }
+  for (int j = k; j < tamanho - 1; j++)
+  {
+    img.blocks[ponteiroFixo(img.inodes[pai], j / B)][j % B] = entradaFixa(img, pai, j + 1);
+  }
+  tamanho--;
+  img.inodes[pai].SIZE = tamanho;
+
+  int blocosDiretorio = tamanho == 0 ? 1 : (tamanho + B - 1) / B;
+  for (int j = blocosDiretorio; j < 9; j++)
+  {
+    unsigned char &ponteiro = ponteiroFixo(img.inodes[pai], j);
+    if (ponteiro != 0x00)
+    {
+      marcarBlocoFixo(img, ponteiro, false);
+      ponteiro = 0x00;
+    }
+  }
+}
+
+// Marca em pós-ordem os inodes e blocos de uma subárvore.
+template <size_t B, size_t N, size_t I>
+void coletarFixo(FS_FIXED_IMAGE<B, N, I> &img, int inode, std::array<bool, I> &inodesLiberar, std::array<bool, N> &blocosLiberar)
+{
+  if (inodesLiberar[inode])
+  {
+    return;
+  }
+  if (img.inodes[inode].IS_DIR == 0x01)
+  {
+    for (int i = 0; i < (unsigned char)img.inodes[inode].SIZE; i++)
+    {
+      coletarFixo(img, entradaFixa(img, inode, i), inodesLiberar, blocosLiberar);
+    }
+  }
+  inodesLiberar[inode] = true;
+  for (int j = 0; j < 9; j++)
+  {
+    unsigned char ponteiro = ponteiroFixo(img.inodes[inode], j);
+    if (ponteiro != 0x00)
+    {
+      blocosLiberar[ponteiro] = true;
+    }
+  }
+}
+
+/**
+ * @brief Inicializa em memória um sistema de arquivos vazio com a geometria do tipo (o mesmo conteúdo de initFs).
+ * @param image imagem a ser inicializada.
+ */
+template <size_t B, size_t N, size_t I>
+void initFs(FS_FIXED_IMAGE<B, N, I> &image)
+{
+  image.bitMap.fill(0x00);
+  image.bitMap[0] = 0x01;
+  memset(image.inodes.data(), 0x00, sizeof(INODE) * I);
+  image.root = 0x00;
+  image.inodes[0].IS_USED = 0x01;
+  image.inodes[0].IS_DIR = 0x01;
+  image.inodes[0].NAME[0] = '/';
+  for (size_t i = 0; i < N; i++)
+  {
+    image.blocks[i].fill(0x00);
+  }
+}
+
+/**
+ * @brief Lê um sistema de arquivos que simula EXT3 para uma imagem de geometria fixa.
+ * @param fsFileName arquivo que contém um sistema sistema de arquivos que simula EXT3.
+ * @param image imagem que recebe o conteúdo.
+ * @return false se o arquivo não puder ser lido, a geometria for outra ou houver superbloco estendido.
+ */
+template <size_t B, size_t N, size_t I>
+bool loadFs(std::string fsFileName, FS_FIXED_IMAGE<B, N, I> &image)
+{
+  FILE *arquivo = fopen(fsFileName.c_str(), "rb");
+  if (arquivo == NULL)
+  {
+    return false;
+  }
+  unsigned char cabecalho[3];
+  bool ok = fread(cabecalho, 1, 3, arquivo) == 3 && cabecalho[0] == B && cabecalho[1] == N && cabecalho[2] == I;
+  ok = ok && fread(image.bitMap.data(), 1, image.BIT_MAP_SIZE, arquivo) == image.BIT_MAP_SIZE;
+  ok = ok && fread(image.inodes.data(), sizeof(INODE), I, arquivo) == I;
+  ok = ok && fread(&image.root, 1, 1, arquivo) == 1;
+  ok = ok && fread(image.blocks.data(), B, N, arquivo) == N;
+
+  // Nada depois dos blocos: imagens com features usam o caminho dinâmico.
+  unsigned char extra;
+  ok = ok && fread(&extra, 1, 1, arquivo) == 0;
+  fclose(arquivo);
+  return ok;
+}
+
+/**
+ * @brief Grava a imagem inteira no arquivo, com o layout de fs.h.
+ * @param fsFileName arquivo a ser gravado.
+ * @param image imagem a ser gravada.
+ * @return false se o arquivo não puder ser gravado.
+ */
+template <size_t B, size_t N, size_t I>
+bool saveFs(std::string fsFileName, const FS_FIXED_IMAGE<B, N, I> &image)
+{
+  FILE *arquivo = fopen(fsFileName.c_str(), "wb");
+  if (arquivo == NULL)
+  {
+    return false;
+  }
+  const unsigned char cabecalho[3] = {(unsigned char)B, (unsigned char)N, (unsigned char)I};
+  bool ok = fwrite(cabecalho, 1, 3, arquivo) == 3;
+  ok = ok && fwrite(image.bitMap.data(), 1, image.BIT_MAP_SIZE, arquivo) == image.BIT_MAP_SIZE;
+  ok = ok && fwrite(image.inodes.data(), sizeof(INODE), I, arquivo) == I;
+  ok = ok && fwrite(&image.root, 1, 1, arquivo) == 1;
+  ok = ok && fwrite(image.blocks.data(), B, N, arquivo) == N;
+  return fclose(arquivo) == 0 && ok;
+}
+
+// Um pedaço do conteúdo só de zeros vira um buraco (ponteiro 0x00, sem bloco), como em addFile.
+inline bool pedacoZerado(const std::string &conteudo, size_t inicio, size_t tamanho)
+{
+  unsigned char acumulado = 0;
+  for (size_t i = inicio; i < inicio + tamanho && i < conteudo.size(); i++)
+  {
+    acumulado |= (unsigned char)conteudo[i];
+  }
+  return acumulado == 0;
+}
+
+/**
+ * @brief Adiciona um arquivo, com a mesma alocação (first-fit) e os mesmos buracos de addFile.
+ * @return false se o pai não existir, o nome já existir ou faltar inode/bloco.
+ */
+template <size_t B, size_t N, size_t I>
+bool addFile(FS_FIXED_IMAGE<B, N, I> &image, std::string filePath, std::string fileContent)
+{
+  NOME_INODE nome;
+  int pai = resolverPaiFixo(image, filePath, nome);
+  if (pai == -1 || buscarFilhoFixo(image, pai, nome) != -1 || fileContent.size() > 255)
+  {
+    return false;
+  }
+
+  int inode = inodeLivreFixo(image);
+  int numBlocos = (fileContent.size() + B - 1) / B;
+  if (inode == -1 || numBlocos > 9 || !vincularFixo(image, pai, inode))
+  {
+    return false;
+  }
+  int ocupados = 0;
+  for (int j = 0; j < numBlocos; j++)
+  {
+    ocupados += !pedacoZerado(fileContent, j * B, B);
+  }
+  int blocos[9];
+  if (escolherLivresFixo(image, ocupados, blocos) != ocupados)
+  {
+    desvincularFixo(image, pai, inode);
+    return false;
+  }
+
+  INODE &registro = image.inodes[inode];
+  memset(&registro, 0x00, sizeof(INODE));
+  registro.IS_USED = 0x01;
+  registro.SIZE = fileContent.size();
+  memcpy(registro.NAME, nome.bytes, TAMANHO_NOME);
+  for (int j = 0, k = 0; j < numBlocos; j++)
+  {
+    size_t inicio = j * B;
+    size_t resto = fileContent.size() - inicio;
+    if (pedacoZerado(fileContent, inicio, B))
+    {
+      continue;
+    }
+    image.blocks[blocos[k]].fill(0x00);
+    memcpy(image.blocks[blocos[k]].data(), fileContent.data() + inicio, resto < B ? resto : B);
+    ponteiroFixo(registro, j) = blocos[k];
+    marcarBlocoFixo(image, blocos[k], true);
+    k++;
+  }
+  return true;
+}
+
+/**
+ * @brief Adiciona um diretório vazio, com a mesma alocação de addDir.
+ * @return false se o pai não existir, o nome já existir ou faltar inode/bloco.
+ */
+template <size_t B, size_t N, size_t I>
+bool addDir(FS_FIXED_IMAGE<B, N, I> &image, std::string dirPath)
+{
+  NOME_INODE nome;
+  int pai = resolverPaiFixo(image, dirPath, nome);
+  if (pai == -1 || buscarFilhoFixo(image, pai, nome) != -1)
+  {
+    return false;
+  }
+
+  int inode = inodeLivreFixo(image);
+  if (inode == -1 || !vincularFixo(image, pai, inode))
+  {
+    return false;
+  }
+  int bloco;
+  if (escolherLivresFixo(image, 1, &bloco) != 1)
+  {
+    desvincularFixo(image, pai, inode);
+    return false;
+  }
+
+  INODE &registro = image.inodes[inode];
+  memset(&registro, 0x00, sizeof(INODE));
+  registro.IS_USED = 0x01;
+  registro.IS_DIR = 0x01;
+  memcpy(registro.NAME, nome.bytes, TAMANHO_NOME);
+  registro.DIRECT_BLOCKS[0] = bloco;
+  marcarBlocoFixo(image, bloco, true);
+  return true;
+}
+
+/**
+ * @brief Remove um arquivo ou diretório (recursivamente), como remove.
+ * @return false se o caminho não existir ou for a raiz.
+ */
+template <size_t B, size_t N, size_t I>
+bool remove(FS_FIXED_IMAGE<B, N, I> &image, std::string path)
+{
+  NOME_INODE nome;
+  int pai = resolverPaiFixo(image, path, nome);
+  int inode = pai == -1 ? -1 : buscarFilhoFixo(image, pai, nome);
+  if (inode == -1)
+  {
+    return false;
+  }
+
+  std::array<bool, I> inodesLiberar;
+  std::array<bool, N> blocosLiberar;
+  inodesLiberar.fill(false);
+  blocosLiberar.fill(false);
+  coletarFixo(image, inode, inodesLiberar, blocosLiberar);
+  desvincularFixo(image, pai, inode);
+
+  algumIndice<I>([&](size_t i)
+                 {
+    if (inodesLiberar[i])
+    {
+      memset(&image.inodes[i], 0x00, sizeof(INODE));
+    }
+    return false; });
+  algumIndice<N>([&](size_t i)
+                 {
+    if (blocosLiberar[i])
+    {
+      marcarBlocoFixo(image, i, false);
+    }
+    return false; });
+  return true;
+}
+
+/**
+ * @brief Move ou renomeia um arquivo ou diretório, como move.
+ * @return false se a origem não existir, o destino já existir ou um diretório for movido para dentro de si.
+ */
+template <size_t B, size_t N, size_t I>
+bool move(FS_FIXED_IMAGE<B, N, I> &image, std::string oldPath, std::string newPath)
+{
+  NOME_INODE nomeAntigo, nome;
+  int paiOrigem = resolverPaiFixo(image, oldPath, nomeAntigo);
+  int inode = paiOrigem == -1 ? -1 : buscarFilhoFixo(image, paiOrigem, nomeAntigo);
+  if (inode == -1)
+  {
+    return false;
+  }
+  int paiDestino = resolverPaiFixo(image, newPath, nome, inode);
+  if (paiDestino == -1)
+  {
+    return false;
+  }
+  int existente = buscarFilhoFixo(image, paiDestino, nome);
+  if (existente != -1 && existente != inode)
+  {
+    return false;
+  }
+
+  if (paiOrigem != paiDestino)
+  {
+    if (!vincularFixo(image, paiDestino, inode))
+    {
+      return false;
+    }
+    desvincularFixo(image, paiOrigem, inode);
+  }
+  memcpy(image.inodes[inode].NAME, nome.bytes, TAMANHO_NOME);
+  return true;
+}
+
+/**
+ * @brief Lê o conteúdo de um arquivo.
+ * @return false se o caminho não existir ou for um diretório.
+ */
+template <size_t B, size_t N, size_t I>
+bool readFile(FS_FIXED_IMAGE<B, N, I> &image, std::string filePath, std::string &fileContent)
+{
+  int inode = resolverCaminhoFixo(image, filePath);
+  if (inode == -1 || image.inodes[inode].IS_DIR == 0x01)
+  {
+    return false;
+  }
+  int tamanho = (unsigned char)image.inodes[inode].SIZE;
+  fileContent.assign(tamanho, 0x00);
+  for (int j = 0; j * (int)B < tamanho; j++)
+  {
+    int bloco = ponteiroFixo(image.inodes[inode], j);
+    int resto = tamanho - j * (int)B;
+    if (bloco != 0x00)
+    {
+      memcpy(&fileContent[j * B], image.blocks[bloco].data(), resto < (int)B ? resto : B);
+    }
+  }
+  return true;
+}
+
+#endif /* fsFixed_h */
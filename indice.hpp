@@ -0,0 +1,447 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Índice de caminhos de uma imagem (caminho, pai, tamanho e blocos de cada inode) para responder
+// find/du/count sem percorrer os inodes e os blocos de diretório.
+//
+// O índice é um mapa ordenado por caminho: a subárvore de /x é o intervalo de chaves que começam com "/x/".
+// Cada diretório guarda os totais da sua subárvore, atualizados nos ancestrais a cada alteração (O(profundidade)).
+// Ele pode ser gravado ao lado da imagem (<imagem>.idx), junto com uma assinatura da imagem no momento da gravação
+// (tamanho, data de modificação e hash do mapa de bits e dos inodes): se a imagem mudar por fora do índice, o arquivo
+// é descartado e o índice é reconstruído. O hash cobre as alterações feitas dentro da resolução do relógio do sistema.
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#ifndef indice_hpp
+#define indice_hpp
+
+#include "auxFunction.hpp"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+// Entrada do índice. Os totais só valem para diretórios e incluem a subárvore inteira (e o próprio diretório
+// em blocosSubarvore).
+typedef struct
+{
+  int inode;
+  int pai;
+  int tamanho;
+  int blocos;
+  bool dir;
+  long bytesSubarvore;
+  int blocosSubarvore;
+  int arquivosSubarvore;
+  int diretoriosSubarvore;
+} ENTRADA_INDICE;
+
+// Identifica a versão da imagem que o índice gravado descreve.
+typedef struct
+{
+  long long tamanho;
+  long long modificacao;
+  unsigned long long metadados;
+} ASSINATURA_IMAGEM;
+
+typedef struct
+{
+  bool carregado;
+  bool alterado;                      // diferente do que está gravado em <imagem>.idx
+  map<string, ENTRADA_INDICE> caminhos;
+  vector<string> caminhoDoInode;      // vazio se o inode não estiver no índice
+  ASSINATURA_IMAGEM assinatura;       // da imagem quando o índice foi gravado
+} INDICE;
+
+const char CABECALHO_INDICE[] = "FSIDX 1";
+
+// Assinatura atual da imagem aberta ({-1, -1, 0} se o arquivo não existir).
+ASSINATURA_IMAGEM assinaturaDaImagem(const IMAGEM &img, const string &nomeArquivo)
+{
+  error_code erro;
+  ASSINATURA_IMAGEM assinatura = {-1, -1, 0};
+  long long tamanho = filesystem::file_size(nomeArquivo, erro);
+  if (erro)
+  {
+    return assinatura;
+  }
+  filesystem::file_time_type modificacao = filesystem::last_write_time(nomeArquivo, erro);
+  if (erro)
+  {
+    return assinatura;
+  }
+  vector<unsigned char> metadados(img.bitMap);
+  const unsigned char *inodes = (const unsigned char *)img.inodes.data();
+  metadados.insert(metadados.end(), inodes, inodes + img.inodes.size() * sizeof(INODE));
+
+  assinatura.tamanho = tamanho;
+  assinatura.modificacao = modificacao.time_since_epoch().count();
+  assinatura.metadados = hashDeBloco(metadados.data(), metadados.size());
+  return assinatura;
+}
+
+bool mesmaAssinatura(const ASSINATURA_IMAGEM &a, const ASSINATURA_IMAGEM &b)
+{
+  return a.tamanho == b.tamanho && a.modificacao == b.modificacao && a.metadados == b.metadados;
+}
+
+// Remove barras repetidas e a barra final: "//a/b/" -> "/a/b". A raiz é "/".
+string normalizarCaminho(const string &caminho)
+{
+  string normalizado = "/";
+  for (int i = 0; i < caminho.size(); i++)
+  {
+    if (caminho[i] != '/' || normalizado.back() != '/')
+    {
+      normalizado += caminho[i];
+    }
+  }
+  if (normalizado.size() > 1 && normalizado.back() == '/')
+  {
+    normalizado.pop_back();
+  }
+  return normalizado;
+}
+
+string caminhoFilho(const string &pai, const string &nome)
+{
+  return pai == "/" ? "/" + nome : pai + "/" + nome;
+}
+
+// Primeira e última (exclusiva) chave da subárvore de um diretório. Inclui o próprio diretório no caso da raiz.
+void intervaloSubarvore(INDICE &indice, const string &caminho, map<string, ENTRADA_INDICE>::iterator &inicio,
+                        map<string, ENTRADA_INDICE>::iterator &fim)
+{
+  string prefixo = caminho == "/" ? "/" : caminho + "/";
+  string limite = prefixo;
+  limite.back()++;
+  inicio = indice.caminhos.lower_bound(prefixo);
+  fim = indice.caminhos.lower_bound(limite);
+}
+
+// Blocos ocupados pelo próprio inode: os blocos de entradas de um diretório (ao menos um) ou os ponteiros do arquivo
+// (mais a folha de extents, se houver).
+int blocosDoInode(IMAGEM &img, int inode)
+{
+  if (img.inodes[inode].IS_DIR == 0x01)
+  {
+    return max(1, blocosNecessarios(img, tamanhoInode(img.inodes[inode])));
+  }
+  int blocos = img.folhaExtents[inode] != -1;
+  for (int j = 0; j < 9; j++)
+  {
+    blocos += ponteiroBloco(img.inodes[inode], j) != 0x00;
+  }
+  return blocos;
+}
+
+// Soma os deltas nos totais de um diretório e de todos os seus ancestrais, até a raiz.
+void somarNosAncestrais(INDICE &indice, int pai, long bytes, int blocos, int arquivos, int diretorios)
+{
+  while (pai != -1)
+  {
+    map<string, ENTRADA_INDICE>::iterator ancestral = indice.caminhos.find(indice.caminhoDoInode[pai]);
+    if (ancestral == indice.caminhos.end())
+    {
+      return;
+    }
+    ancestral->second.bytesSubarvore += bytes;
+    ancestral->second.blocosSubarvore += blocos;
+    ancestral->second.arquivosSubarvore += arquivos;
+    ancestral->second.diretoriosSubarvore += diretorios;
+    pai = ancestral->second.pai;
+  }
+}
+
+/**
+ * @brief Soma (sinal 1) ou subtrai (sinal -1) a contribuição de uma entrada, com a sua subárvore, nos ancestrais.
+ * @param indice índice carregado.
+ * @param entrada entrada cuja contribuição muda; pai indica o primeiro ancestral.
+ * @param sinal 1 ou -1.
+ */
+void propagarTotais(INDICE &indice, const ENTRADA_INDICE &entrada, int sinal)
+{
+  if (entrada.dir)
+  {
+    somarNosAncestrais(indice, entrada.pai, sinal * entrada.bytesSubarvore, sinal * entrada.blocosSubarvore,
+                       sinal * entrada.arquivosSubarvore, sinal * (entrada.diretoriosSubarvore + 1));
+  }
+  else
+  {
+    somarNosAncestrais(indice, entrada.pai, sinal * entrada.tamanho, sinal * entrada.blocos, sinal, 0);
+  }
+}
+
+/**
+ * @brief Coloca no índice uma entrada nova (sem filhos) e soma os seus totais nos ancestrais.
+ * @param indice índice carregado.
+ * @param caminho caminho normalizado.
+ * @param inode, pai, tamanho, blocos, dir dados do inode (pai = -1 na raiz).
+ */
+void inserirNoIndice(INDICE &indice, const string &caminho, int inode, int pai, int tamanho, int blocos, bool dir)
+{
+  if (indice.caminhos.count(caminho) > 0)
+  {
+    return;
+  }
+  ENTRADA_INDICE entrada = {inode, pai, tamanho, blocos, dir, 0, dir ? blocos : 0, 0, 0};
+  indice.caminhos[caminho] = entrada;
+  indice.caminhoDoInode[inode] = caminho;
+  propagarTotais(indice, entrada, 1);
+  indice.alterado = true;
+}
+
+// Nome do inode (até 10 caracteres), como aparece no caminho.
+string nomeDoInode(const INODE &inode)
+{
+  return string(inode.NAME, strnlen(inode.NAME, 10));
+}
+
+/**
+ * @brief Indexa um inode recém-ligado a um diretório já indexado (arquivo ou diretório vazio).
+ * @param indice índice carregado.
+ * @param img estado da imagem aberta.
+ * @param pai inode do diretório.
+ * @param inode inode novo.
+ */
+void indexarInode(INDICE &indice, IMAGEM &img, int pai, int inode)
+{
+  const INODE &dados = img.inodes[inode];
+  string caminho = caminhoFilho(indice.caminhoDoInode[pai], nomeDoInode(dados));
+  inserirNoIndice(indice, caminho, inode, pai, tamanhoInode(dados), blocosDoInode(img, inode), dados.IS_DIR == 0x01);
+}
+
+// Percurso usado por construirIndice: inodes dos diretórios abertos, por profundidade.
+typedef struct
+{
+  INDICE *indice;
+  IMAGEM *img;
+  vector<int> niveis;
+} CONSTRUCAO_INDICE;
+
+FS_WALK_ACTION indexarEntrada(const FS_DIRENT &entry, int depth, void *context)
+{
+  CONSTRUCAO_INDICE *construcao = (CONSTRUCAO_INDICE *)context;
+  construcao->niveis.resize(depth + 1);
+  indexarInode(*construcao->indice, *construcao->img, construcao->niveis[depth], entry.inode);
+  if (entry.isDir)
+  {
+    construcao->niveis.push_back(entry.inode);
+  }
+  return FS_WALK_CONTINUE;
+}
+
+/**
+ * @brief Monta o índice inteiro percorrendo a árvore da imagem uma vez.
+ * @param indice índice a ser preenchido.
+ * @param img estado da imagem aberta.
+ */
+void construirIndice(INDICE &indice, IMAGEM &img)
+{
+  indice.caminhos.clear();
+  indice.caminhoDoInode.assign(img.numInodes, "");
+  indice.carregado = true;
+  inserirNoIndice(indice, "/", img.root, -1, tamanhoInode(img.inodes[img.root]), blocosDoInode(img, img.root), true);
+
+  CONSTRUCAO_INDICE construcao = {&indice, &img, vector<int>(1, img.root)};
+  percorrerArvore(img, img.root, indexarEntrada, NULL, &construcao);
+  indice.alterado = true;
+}
+
+/**
+ * @brief Tira do índice um caminho e toda a sua subárvore.
+ * @param indice índice carregado.
+ * @param inode inode do caminho removido.
+ * @return inode do pai (-1 se o inode não estiver no índice).
+ */
+int removerDoIndice(INDICE &indice, int inode)
+{
+  map<string, ENTRADA_INDICE>::iterator entrada = indice.caminhos.find(indice.caminhoDoInode[inode]);
+  if (entrada == indice.caminhos.end() || entrada->second.pai == -1)
+  {
+    return -1;
+  }
+  int pai = entrada->second.pai;
+  propagarTotais(indice, entrada->second, -1);
+
+  map<string, ENTRADA_INDICE>::iterator inicio, fim;
+  intervaloSubarvore(indice, entrada->first, inicio, fim);
+  for (map<string, ENTRADA_INDICE>::iterator i = inicio; i != fim; i++)
+  {
+    indice.caminhoDoInode[i->second.inode] = "";
+  }
+  indice.caminhos.erase(inicio, fim);
+  indice.caminhoDoInode[inode] = "";
+  indice.caminhos.erase(entrada);
+  indice.alterado = true;
+  return pai;
+}
+
+/**
+ * @brief Recalcula os blocos de um inode indexado (ex. diretório que ganhou ou perdeu um bloco de entradas,
+ * arquivo que recebeu os blocos no flush) e corrige os totais dos ancestrais.
+ * @param indice índice carregado.
+ * @param img estado da imagem aberta.
+ * @param inode inode a ser atualizado.
+ */
+void atualizarBlocosIndice(INDICE &indice, IMAGEM &img, int inode)
+{
+  map<string, ENTRADA_INDICE>::iterator entrada = indice.caminhos.find(indice.caminhoDoInode[inode]);
+  if (entrada == indice.caminhos.end())
+  {
+    return;
+  }
+  ENTRADA_INDICE &dados = entrada->second;
+  int blocos = blocosDoInode(img, inode);
+  int tamanho = tamanhoInode(img.inodes[inode]);
+  if (blocos == dados.blocos && tamanho == dados.tamanho)
+  {
+    return;
+  }
+
+  // O tamanho de um diretório é a quantidade de entradas, que não entra na soma de bytes.
+  somarNosAncestrais(indice, dados.pai, dados.dir ? 0 : tamanho - dados.tamanho, blocos - dados.blocos, 0, 0);
+  if (dados.dir)
+  {
+    dados.blocosSubarvore += blocos - dados.blocos;
+  }
+  dados.blocos = blocos;
+  dados.tamanho = tamanho;
+  indice.alterado = true;
+}
+
+/**
+ * @brief Atualiza o índice depois de mover ou renomear um inode: a subárvore inteira troca de prefixo.
+ * @param indice índice carregado.
+ * @param img estado da imagem aberta (já com o nome novo).
+ * @param inode inode movido.
+ * @param paiDestino inode do novo pai.
+ */
+void moverNoIndice(INDICE &indice, IMAGEM &img, int inode, int paiDestino)
+{
+  map<string, ENTRADA_INDICE>::iterator entrada = indice.caminhos.find(indice.caminhoDoInode[inode]);
+  if (entrada == indice.caminhos.end())
+  {
+    return;
+  }
+  string antigo = entrada->first;
+  string novo = caminhoFilho(indice.caminhoDoInode[paiDestino], nomeDoInode(img.inodes[inode]));
+  ENTRADA_INDICE dados = entrada->second;
+  int paiOrigem = dados.pai;
+
+  propagarTotais(indice, dados, -1);
+  vector<pair<string, ENTRADA_INDICE>> subarvore;
+  map<string, ENTRADA_INDICE>::iterator inicio, fim;
+  intervaloSubarvore(indice, antigo, inicio, fim);
+  for (map<string, ENTRADA_INDICE>::iterator i = inicio; i != fim; i++)
+  {
+    subarvore.push_back(make_pair(novo + i->first.substr(antigo.size()), i->second));
+  }
+  indice.caminhos.erase(inicio, fim);
+  indice.caminhos.erase(antigo);
+
+  dados.pai = paiDestino;
+  indice.caminhos[novo] = dados;
+  indice.caminhoDoInode[inode] = novo;
+  for (int i = 0; i < subarvore.size(); i++)
+  {
+    indice.caminhos[subarvore[i].first] = subarvore[i].second;
+    indice.caminhoDoInode[subarvore[i].second.inode] = subarvore[i].first;
+  }
+  propagarTotais(indice, dados, 1);
+  indice.alterado = true;
+
+  atualizarBlocosIndice(indice, img, paiOrigem);
+  atualizarBlocosIndice(indice, img, paiDestino);
+}
+
+/**
+ * @brief Grava o índice em um arquivo texto: cabeçalho, assinatura da imagem e uma linha por caminho
+ * (inode, pai, tamanho, blocos, diretório, caminho), em ordem de caminho.
+ * @param indice índice carregado.
+ * @param nomeArquivo arquivo do índice.
+ * @param assinatura assinatura atual da imagem.
+ * @return false se o arquivo não puder ser gravado.
+ */
+bool gravarIndice(INDICE &indice, const string &nomeArquivo, ASSINATURA_IMAGEM assinatura)
+{
+  // Grava em um arquivo temporário e renomeia, para nunca deixar um índice pela metade.
+  string temporario = nomeArquivo + ".tmp";
+  ofstream saida(temporario, ios::trunc);
+  saida << CABECALHO_INDICE << "\n" << assinatura.tamanho << " " << assinatura.modificacao << " " << assinatura.metadados << "\n"
+        << indice.caminhos.size() << "\n";
+  for (map<string, ENTRADA_INDICE>::iterator i = indice.caminhos.begin(); i != indice.caminhos.end(); i++)
+  {
+    const ENTRADA_INDICE &e = i->second;
+    saida << e.inode << " " << e.pai << " " << e.tamanho << " " << e.blocos << " " << e.dir << " " << i->first << "\n";
+  }
+  saida.close();
+  error_code erro;
+  if (saida)
+  {
+    filesystem::rename(temporario, nomeArquivo, erro);
+  }
+  if (!saida || erro)
+  {
+    filesystem::remove(temporario, erro);
+    return false;
+  }
+  indice.assinatura = assinatura;
+  indice.alterado = false;
+  return true;
+}
+
+/**
+ * @brief Carrega o índice gravado, se ele descrever exatamente a imagem atual. Os totais são recalculados.
+ * @param indice índice a ser preenchido.
+ * @param nomeArquivo arquivo do índice.
+ * @param assinatura assinatura atual da imagem.
+ * @param numInodes quantidade de inodes da imagem.
+ * @return false se o arquivo não existir, estiver corrompido ou for de outra versão da imagem.
+ */
+bool lerIndice(INDICE &indice, const string &nomeArquivo, ASSINATURA_IMAGEM assinatura, int numInodes)
+{
+  ifstream entrada(nomeArquivo);
+  string cabecalho;
+  ASSINATURA_IMAGEM gravada;
+  size_t quantidade;
+  if (!getline(entrada, cabecalho) || cabecalho != CABECALHO_INDICE ||
+      !(entrada >> gravada.tamanho >> gravada.modificacao >> gravada.metadados >> quantidade) ||
+      !mesmaAssinatura(gravada, assinatura))
+  {
+    return false;
+  }
+
+  indice.caminhos.clear();
+  indice.caminhoDoInode.assign(numInodes, "");
+  indice.carregado = true;
+  // Em ordem de caminho cada pai aparece antes dos filhos, então os totais são somados na leitura.
+  string linha;
+  getline(entrada, linha);
+  for (size_t n = 0; n < quantidade; n++)
+  {
+    int inode, pai, tamanho, blocos, dir;
+    string caminho;
+    istringstream campos;
+    if (!getline(entrada, linha))
+    {
+      break;
+    }
+    campos.str(linha);
+    if (!(campos >> inode >> pai >> tamanho >> blocos >> dir) || !getline(campos >> ws, caminho) ||
+        inode < 0 || inode >= numInodes || pai < -1 || pai >= numInodes || (pai != -1 && indice.caminhoDoInode[pai].empty()))
+    {
+      break;
+    }
+    inserirNoIndice(indice, caminho, inode, pai, tamanho, blocos, dir != 0);
+  }
+  if (indice.caminhos.size() != quantidade || indice.caminhos.count("/") == 0)
+  {
+    indice.carregado = false;
+    indice.caminhos.clear();
+    return false;
+  }
+  indice.assinatura = gravada;
+  indice.alterado = false;
+  return true;
+}
+
+#endif /* indice_hpp */
@@ -1,8 +1,11 @@
 #include "gtest/gtest.h"
 #include "fs.h"
+#include "fsExt.h"
+#include "fsFixed.h"
 #include "sha256.h"
 
 #include <fstream>
+#include <thread>
 #include <stdio.h>
 
 void duplicate(std::string fsrc, std::string fdest)
@@ -106,6 +109,812 @@ TEST(FsTest, case12){
     rename("fs-case12.bin.back", "fs-case12.bin");
 }
 
+TEST(FsTest, removeDirRecursivo){
+    duplicate("fs-case7.bin", "fs-case7-rec.bin.solucao");
+
+    // Remover /dec7556 com t2.txt dentro deve liberar os dois inodes e os três blocos de uma vez.
+    remove("fs-case7-rec.bin.solucao", "/dec7556");
+    ASSERT_EQ(printSha256("fs-case7-rec.bin.solucao"),std::string("D4:63:6C:09:AD:B9:D3:68:6F:1B:02:79:78:38:50:C2:31:7D:E2:F1:C1:50:C9:13:7D:D9:0A:77:B5:27:4E:36"));
+}
+
+TEST(FsTest, moveDirParaDentroDeSi){
+    duplicate("fs-case9.bin", "fs-case9-ciclo.bin.solucao");
+
+    // Mover um diretório para dentro dele mesmo é recusado e a imagem não muda.
+    move("fs-case9-ciclo.bin.solucao", "/dec7556", "/dec7556/dec7556");
+    ASSERT_EQ(printSha256("fs-case9-ciclo.bin.solucao"),std::string("C5:D5:15:D8:2F:09:15:49:D9:A2:B5:58:36:E7:DC:28:E5:C4:14:02:1D:03:0E:A8:4E:40:EE:76:BF:05:F0:C6"));
+}
+
+TEST(FsTest, alocacaoAdiada){
+    initFs("fs-adiada.bin.solucao", 2, 16, 8);
+
+    // Os arquivos de /a são alocados juntos no flush, mesmo intercalados com os de /b.
+    FS_OPTIONS options = FS_OPTIONS();
+    options.delayedAllocation = true;
+    FS_SESSION *session = openSession("fs-adiada.bin.solucao", options);
+    addDir(session, "/a");
+    addDir(session, "/b");
+    addFile(session, "/a/x.txt", "abc");
+    addFile(session, "/b/y.txt", "de");
+    addFile(session, "/a/z.txt", "f");
+    addFile(session, "/b/w.txt", "ghij");
+    remove(session, "/b/w.txt");
+    closeSession(session);
+    ASSERT_EQ(printSha256("fs-adiada.bin.solucao"),std::string("2E:68:D6:38:F3:AE:33:C9:BA:BE:CF:C1:0B:C3:7A:EC:CF:84:4D:BD:53:F9:A4:8E:F5:84:89:7C:0F:B0:70:19"));
+}
+
+TEST(FsTest, compressao){
+    initFs("fs-lz.bin.solucao", 8, 32, 8, FS_FEATURE_COMPRESSION);
+    addDir("fs-lz.bin.solucao", "/logs");
+
+    // Texto repetitivo é guardado comprimido; conteúdo sem repetição fica como está.
+    std::string texto = "";
+    for (int i = 0; i < 12; i++)
+    {
+        texto += "linha " + std::to_string(i % 3) + ";";
+    }
+    addFile("fs-lz.bin.solucao", "/logs/a.log", texto);
+    addFile("fs-lz.bin.solucao", "/b.txt", "qwertyuiop");
+
+    ASSERT_EQ(readFile("fs-lz.bin.solucao", "/logs/a.log"), texto);
+    ASSERT_EQ(readFile("fs-lz.bin.solucao", "/b.txt"), std::string("qwertyuiop"));
+}
+
+TEST(FsTest, deduplicacao){
+    initFs("fs-dedup.bin.solucao", 4, 16, 8, FS_FEATURE_DEDUP);
+
+    // Os dois arquivos compartilham o mesmo bloco "abcd"; remover um não libera o bloco do outro.
+    addFile("fs-dedup.bin.solucao", "/a.txt", "abcdabcd");
+    addFile("fs-dedup.bin.solucao", "/b.txt", "abcdabcd");
+    addFile("fs-dedup.bin.solucao", "/c.txt", "abcdxyz");
+    remove("fs-dedup.bin.solucao", "/a.txt");
+
+    ASSERT_EQ(readFile("fs-dedup.bin.solucao", "/b.txt"), std::string("abcdabcd"));
+    ASSERT_EQ(readFile("fs-dedup.bin.solucao", "/c.txt"), std::string("abcdxyz"));
+    ASSERT_EQ(printSha256("fs-dedup.bin.solucao"),std::string("CA:CF:4E:5A:38:9E:48:3F:6E:06:E4:BA:38:1B:8F:18:71:CA:A7:3B:83:FB:49:32:B9:84:15:95:0E:F2:96:A2"));
+}
+
+FS_WALK_ACTION visitar(const FS_DIRENT &entry, int depth, void *context){
+    std::string *visitados = (std::string *)context;
+    *visitados += std::to_string(depth) + ":" + std::string(entry.name, entry.nameLength) + " ";
+    return entry.isDir && std::string(entry.name, entry.nameLength) == "skip" ? FS_WALK_SKIP : FS_WALK_CONTINUE;
+}
+
+TEST(FsTest, readDirEWalk){
+    duplicate("fs-case7.bin", "fs-case7-dir.bin.solucao");
+    addDir("fs-case7-dir.bin.solucao", "/skip");
+    addFile("fs-case7-dir.bin.solucao", "/skip/x", "1");
+
+    FS_SESSION *session = openSession("fs-case7-dir.bin.solucao");
+
+    FS_DIR dir;
+    FS_DIRENT entry;
+    ASSERT_TRUE(openDir(session, "/", dir));
+    ASSERT_TRUE(readDir(dir, entry));
+    ASSERT_EQ(std::string(entry.name, entry.nameLength), std::string("teste.txt"));
+    ASSERT_FALSE(entry.isDir);
+    ASSERT_EQ(entry.size, 3);
+    ASSERT_TRUE(readDir(dir, entry));
+    ASSERT_EQ(std::string(entry.name, entry.nameLength), std::string("dec7556"));
+    ASSERT_TRUE(entry.isDir);
+    ASSERT_TRUE(readDir(dir, entry));
+    ASSERT_FALSE(readDir(dir, entry));
+    ASSERT_FALSE(openDir(session, "/teste.txt", dir));
+
+    // Pré-ordem com poda: o conteúdo de /skip não é visitado.
+    std::string visitados = "";
+    ASSERT_TRUE(walkTree(session, "/", visitar, NULL, &visitados));
+    ASSERT_EQ(visitados, std::string("0:teste.txt 0:dec7556 1:t2.txt 0:skip "));
+
+    closeSession(session);
+}
+
+TEST(FsTest, buildFs){
+    std::vector<FS_IMPORT_ENTRY> entries = {
+        {"/a.txt", false, "hello world"},
+        {"/docs", true, ""},
+        {"/docs/r.md", false, "line1"},
+        {"/docs/sub", true, ""},
+        {"/docs/sub/z", false, "zz"},
+    };
+    ASSERT_TRUE(buildFs("fs-build.bin.solucao", 4, 16, 8, 0, entries));
+
+    // Cada diretório vem seguido dos blocos dos seus arquivos: /, a.txt, docs, r.md, sub, z.
+    ASSERT_EQ(printSha256("fs-build.bin.solucao"),std::string("B3:5E:29:9A:49:BE:D1:3D:F9:D7:4C:21:7D:93:62:1C:D8:B7:7B:2F:19:FD:4D:01:79:EB:C9:A7:AE:D1:2F:C5"));
+    ASSERT_EQ(readFile("fs-build.bin.solucao", "/docs/sub/z"), std::string("zz"));
+    ASSERT_EQ(readFile("fs-build.bin.solucao", "/a.txt"), std::string("hello world"));
+
+    // Pai depois do filho não é aceito.
+    std::vector<FS_IMPORT_ENTRY> invalidas = {{"/x/y", false, "1"}, {"/x", true, ""}};
+    ASSERT_FALSE(buildFs("fs-build2.bin.solucao", 4, 16, 8, 0, invalidas));
+}
+
+TEST(FsTest, leituraMapeada){
+    initFs("fs-map.bin.solucao", 4, 32, 8, FS_FEATURE_COMPRESSION);
+    addDir("fs-map.bin.solucao", "/d");
+    addFile("fs-map.bin.solucao", "/d/a.txt", "abcabcabcabcabcabcabcabc");
+    addFile("fs-map.bin.solucao", "/b.txt", "hello");
+
+    FS_SESSION *session = openSession("fs-map.bin.solucao");
+    FS_DIR dir;
+    FS_DIRENT a, b, d;
+    ASSERT_TRUE(openDir(session, "/", dir));
+    ASSERT_TRUE(readDir(dir, d));
+    ASSERT_TRUE(readDir(dir, b));
+    ASSERT_TRUE(openDir(session, "/d", dir));
+    ASSERT_TRUE(readDir(dir, a));
+    closeSession(session);
+
+    // A leitura pelo mapeamento dá o mesmo conteúdo de readFile, inclusive de arquivos comprimidos.
+    FS_MAPPED *image = mapImage("fs-map.bin.solucao");
+    ASSERT_TRUE(image != NULL);
+    std::string conteudo;
+    ASSERT_TRUE(readFileMapped(image, a.inode, conteudo));
+    ASSERT_EQ(conteudo, readFile("fs-map.bin.solucao", "/d/a.txt"));
+    ASSERT_TRUE(readFileMapped(image, b.inode, conteudo));
+    ASSERT_EQ(conteudo, std::string("hello"));
+    ASSERT_FALSE(readFileMapped(image, d.inode, conteudo));
+    unmapImage(image);
+}
+
+TEST(FsTest, geometriaFixa){
+    // A mesma sequência pelo caminho dinâmico e pela imagem de geometria fixa gera o mesmo arquivo.
+    initFs("fs-dinamica.bin.solucao", 4, 24, 10);
+    addDir("fs-dinamica.bin.solucao", "/d");
+    addFile("fs-dinamica.bin.solucao", "/d/a.txt", "conteudo longo");
+    addFile("fs-dinamica.bin.solucao", "/b", "xy");
+    addDir("fs-dinamica.bin.solucao", "/d/e");
+    addFile("fs-dinamica.bin.solucao", "/d/e/c", "123456");
+    move("fs-dinamica.bin.solucao", "/b", "/d/e/b2");
+    remove("fs-dinamica.bin.solucao", "/d/a.txt");
+
+    FS_FIXED_IMAGE<4, 24, 10> image;
+    initFs(image);
+    ASSERT_TRUE(addDir(image, "/d"));
+    ASSERT_TRUE(addFile(image, "/d/a.txt", "conteudo longo"));
+    ASSERT_TRUE(addFile(image, "/b", "xy"));
+    ASSERT_TRUE(addDir(image, "/d/e"));
+    ASSERT_TRUE(addFile(image, "/d/e/c", "123456"));
+    ASSERT_TRUE(move(image, "/b", "/d/e/b2"));
+    ASSERT_TRUE(remove(image, "/d/a.txt"));
+    ASSERT_FALSE(move(image, "/d", "/d/e/x"));
+    ASSERT_TRUE(saveFs("fs-fixa.bin.solucao", image));
+    ASSERT_EQ(printSha256("fs-fixa.bin.solucao"), printSha256("fs-dinamica.bin.solucao"));
+
+    FS_FIXED_IMAGE<4, 24, 10> lida;
+    ASSERT_TRUE(loadFs("fs-dinamica.bin.solucao", lida));
+    std::string conteudo;
+    ASSERT_TRUE(readFile(lida, "/d/e/c", conteudo));
+    ASSERT_EQ(conteudo, std::string("123456"));
+
+    // Geometria diferente da do tipo não é aceita.
+    FS_FIXED_IMAGE<4, 24, 11> outra;
+    ASSERT_FALSE(loadFs("fs-dinamica.bin.solucao", outra));
+}
+
+FS_FRAG_STATS alocarComBuraco(FS_ALLOC_POLICY politica){
+    // a, b e c ocupam os blocos 1, 2 e 3; sem b fica um buraco de 1 bloco antes do espaço livre.
+    initFs("fs-politica.bin.solucao", 4, 16, 8);
+    FS_OPTIONS options = FS_OPTIONS();
+    options.allocationPolicy = politica;
+    FS_SESSION *session = openSession("fs-politica.bin.solucao", options);
+    addFile(session, "/a", "aaaa");
+    addFile(session, "/b", "bbbb");
+    addFile(session, "/c", "cccc");
+    remove(session, "/b");
+    addFile(session, "/d", "dddddddd");
+    FS_FRAG_STATS stats = fragmentationStats(session);
+    std::string conteudo;
+    readFile(session, "/d", conteudo);
+    EXPECT_EQ(conteudo, std::string("dddddddd"));
+    closeSession(session);
+    return stats;
+}
+
+TEST(FsTest, politicasDeAlocacao){
+    // First-fit preenche o buraco e quebra /d em duas extensões.
+    FS_FRAG_STATS primeiro = alocarComBuraco(FS_ALLOC_FIRST_FIT);
+    ASSERT_EQ(primeiro.files, 3);
+    ASSERT_EQ(primeiro.extents, 4);
+    ASSERT_EQ(primeiro.fragmentedFiles, 1);
+    ASSERT_EQ(primeiro.freeRuns, 1);
+    ASSERT_EQ(primeiro.largestFreeRun, 11);
+
+    // Best-fit põe /d inteiro em uma sequência livre e deixa o buraco.
+    FS_FRAG_STATS melhor = alocarComBuraco(FS_ALLOC_BEST_FIT);
+    ASSERT_EQ(melhor.fragmentedFiles, 0);
+    ASSERT_DOUBLE_EQ(melhor.averageExtentLength, 4.0 / 3);
+    ASSERT_EQ(melhor.freeBlocks, 11);
+    ASSERT_EQ(melhor.freeRuns, 2);
+    ASSERT_EQ(melhor.freeRunHistogram[0], 1);
+    ASSERT_EQ(melhor.freeRunHistogram[3], 1);
+
+    // Next-fit continua depois de /c.
+    ASSERT_EQ(alocarComBuraco(FS_ALLOC_NEXT_FIT).fragmentedFiles, 0);
+    ASSERT_EQ(alocarComBuraco(FS_ALLOC_GOAL).fragmentedFiles, 0);
+}
+
+TEST(FsTest, gruposDeBlocos){
+    // Blocos de 4 bytes: grupos de 32 blocos, então 3 grupos com 8 inodes cada.
+    initFs("fs-grupos.bin.solucao", 4, 96, 24, FS_FEATURE_GROUPS);
+    addDir("fs-grupos.bin.solucao", "/a");
+    addDir("fs-grupos.bin.solucao", "/b");
+    addFile("fs-grupos.bin.solucao", "/a/f", "hello");
+    addFile("fs-grupos.bin.solucao", "/g", "x");
+
+    FS_SESSION *session = openSession("fs-grupos.bin.solucao");
+
+    // Cada diretório vai para o grupo com mais blocos livres; o arquivo fica no grupo do pai.
+    FS_DIR dir;
+    FS_DIRENT entry;
+    ASSERT_TRUE(openDir(session, "/", dir));
+    ASSERT_TRUE(readDir(dir, entry));
+    ASSERT_EQ(entry.inode, 8);
+    ASSERT_TRUE(readDir(dir, entry));
+    ASSERT_EQ(entry.inode, 16);
+    ASSERT_TRUE(readDir(dir, entry));
+    ASSERT_EQ(entry.inode, 1);
+    ASSERT_TRUE(openDir(session, "/a", dir));
+    ASSERT_TRUE(readDir(dir, entry));
+    ASSERT_EQ(entry.inode, 9);
+
+    // Contadores lidos dos descritores gravados na imagem.
+    std::vector<FS_GROUP_INFO> groups;
+    groupInfo(session, groups);
+    ASSERT_EQ(groups.size(), 3);
+    ASSERT_EQ(groups[1].firstBlock, 32);
+    ASSERT_EQ(groups[1].firstInode, 8);
+    ASSERT_EQ(groups[0].freeBlocks, 30);
+    ASSERT_EQ(groups[0].freeInodes, 6);
+    ASSERT_EQ(groups[1].freeBlocks, 29);
+    ASSERT_EQ(groups[1].freeInodes, 6);
+    ASSERT_EQ(groups[1].dirs, 1);
+    ASSERT_EQ(groups[2].freeBlocks, 31);
+    ASSERT_EQ(groups[2].freeInodes, 7);
+
+    ASSERT_TRUE(remove(session, "/a"));
+    groupInfo(session, groups);
+    ASSERT_EQ(groups[1].freeBlocks, 32);
+    ASSERT_EQ(groups[1].freeInodes, 8);
+    ASSERT_EQ(groups[1].dirs, 0);
+    closeSession(session);
+}
+
+TEST(FsTest, flushAutomatico){
+    initFs("fs-sync.bin.solucao", 4, 32, 8);
+    FS_OPTIONS options = FS_OPTIONS();
+    options.durability = FS_DURABILITY_FULL;
+    options.syncEveryOps = 2;
+    FS_SESSION *session = openSession("fs-sync.bin.solucao", options);
+
+    // A segunda alteração dispara o flush; a terceira fica só na sessão até o próximo.
+    ASSERT_TRUE(addFile(session, "/a", "aaaa"));
+    ASSERT_TRUE(addDir(session, "/d"));
+    ASSERT_FALSE(remove(session, "/nao"));
+    ASSERT_TRUE(addFile(session, "/d/b", "bb"));
+
+    std::string conteudo;
+    FS_SESSION *leitura = openSession("fs-sync.bin.solucao");
+    ASSERT_TRUE(readFile(leitura, "/a", conteudo));
+    ASSERT_EQ(conteudo, std::string("aaaa"));
+    ASSERT_FALSE(readFile(leitura, "/d/b", conteudo));
+    closeSession(leitura);
+
+    closeSession(session);
+    ASSERT_EQ(readFile("fs-sync.bin.solucao", "/d/b"), std::string("bb"));
+}
+
+TEST(FsTest, indiceDeCaminhos){
+    initFs("fs-indice.bin.solucao", 4, 64, 16);
+    std::remove("fs-indice.bin.solucao.idx");
+    FS_OPTIONS options = FS_OPTIONS();
+    options.pathIndex = true;
+    FS_SESSION *session = openSession("fs-indice.bin.solucao", options);
+    ASSERT_TRUE(addDir(session, "/x"));
+    ASSERT_TRUE(addDir(session, "/x/y"));
+    ASSERT_TRUE(addFile(session, "/x/a", "12345678"));
+    ASSERT_TRUE(addFile(session, "/x/y/b", "0123456789"));
+    ASSERT_TRUE(addFile(session, "/c", "ccc"));
+
+    FS_USAGE usage;
+    ASSERT_TRUE(diskUsage(session, "/x/", usage));
+    ASSERT_EQ(usage.bytes, 18);
+    ASSERT_EQ(usage.files, 2);
+    ASSERT_EQ(usage.dirs, 1);
+    ASSERT_EQ(usage.blocks, 1 + 1 + 2 + 3);
+    std::vector<FS_INDEX_ENTRY> encontrados;
+    ASSERT_TRUE(findFiles(session, "/x", 8, encontrados));
+    ASSERT_EQ(encontrados.size(), 1);
+    ASSERT_EQ(encontrados[0].path, std::string("/x/y/b"));
+
+    // Mover um diretório troca o prefixo da subárvore inteira.
+    ASSERT_TRUE(move(session, "/x/y", "/z"));
+    ASSERT_TRUE(findFiles(session, "/z", -1, encontrados));
+    ASSERT_EQ(encontrados.size(), 1);
+    ASSERT_EQ(encontrados[0].path, std::string("/z/b"));
+    ASSERT_TRUE(diskUsage(session, "/x", usage));
+    ASSERT_EQ(usage.bytes, 8);
+    ASSERT_TRUE(remove(session, "/z"));
+    ASSERT_FALSE(diskUsage(session, "/z/b", usage));
+    ASSERT_TRUE(diskUsage(session, "/", usage));
+    ASSERT_EQ(usage.files, 2);
+    ASSERT_EQ(usage.dirs, 1);
+    closeSession(session);
+
+    // O índice gravado dá os mesmos totais de um índice montado do zero.
+    FS_USAGE gravado, montado;
+    session = openSession("fs-indice.bin.solucao", options);
+    ASSERT_TRUE(diskUsage(session, "/", gravado));
+    closeSession(session);
+    session = openSession("fs-indice.bin.solucao");
+    ASSERT_TRUE(diskUsage(session, "/", montado));
+    closeSession(session);
+    ASSERT_EQ(gravado.bytes, montado.bytes);
+    ASSERT_EQ(gravado.blocks, montado.blocks);
+    ASSERT_EQ(gravado.files, montado.files);
+
+    // Uma alteração feita sem o índice invalida o arquivo gravado.
+    addFile("fs-indice.bin.solucao", "/x/f", "ff");
+    session = openSession("fs-indice.bin.solucao", options);
+    ASSERT_TRUE(diskUsage(session, "/x", usage));
+    ASSERT_EQ(usage.files, 2);
+    closeSession(session);
+}
+
+TEST(FsTest, nomesECaminhos){
+    initFs("fs-nomes.bin.solucao", 4, 16, 8);
+    FS_SESSION *session = openSession("fs-nomes.bin.solucao");
+
+    // O campo NAME tem 10 bytes: nomes maiores são recusados em vez de truncados.
+    ASSERT_FALSE(addFile(session, "/abcdefghijk", "x"));
+    ASSERT_FALSE(addDir(session, "/"));
+    ASSERT_TRUE(addDir(session, "/abcdefghij"));
+    ASSERT_TRUE(addFile(session, "//abcdefghij///f/", "ff"));
+    std::string conteudo;
+    ASSERT_TRUE(readFile(session, "/abcdefghij/f", conteudo));
+    ASSERT_EQ(conteudo, std::string("ff"));
+    ASSERT_FALSE(move(session, "/abcdefghij/f", "/abcdefghij/fffffffffff"));
+
+    // Mesmo com barras repetidas, um diretório não vai para dentro de si mesmo.
+    ASSERT_FALSE(move(session, "/abcdefghij", "//abcdefghij/d"));
+    ASSERT_TRUE(move(session, "/abcdefghij/", "/d"));
+    ASSERT_TRUE(readFile(session, "/d/f", conteudo));
+    closeSession(session);
+}
+
+TEST(FsTest, dispositivos){
+    // As mesmas operações em cada dispositivo geram os mesmos bytes; a imagem em memória não cria arquivo.
+    // io_uring e threads gravam os blocos e os metadados de cada flush em lote.
+    const char *nomes[] = {"fs-dev-stdio.bin.solucao", "fs-dev-pread.bin.solucao", "fs-dev-mmap.bin.solucao",
+                           "fs-dev-uring.bin.solucao", "fs-dev-threads.bin.solucao", "mem:dev"};
+    FS_DEVICE dispositivos[] = {FS_DEVICE_STDIO, FS_DEVICE_PREAD, FS_DEVICE_MMAP, FS_DEVICE_URING, FS_DEVICE_THREADS, FS_DEVICE_STDIO};
+    std::vector<unsigned char> bytes[6];
+    for (int i = 0; i < 6; i++)
+    {
+        initFs(nomes[i], 4, 64, 12, FS_FEATURE_COMPRESSION | FS_FEATURE_DEDUP);
+        FS_OPTIONS options = FS_OPTIONS();
+        options.device = dispositivos[i];
+        options.delayedAllocation = true;
+        FS_SESSION *session = openSession(nomes[i], options);
+        ASSERT_TRUE(addDir(session, "/d"));
+        ASSERT_TRUE(addFile(session, "/d/a.txt", "abcabcabcabcabcabcabcabc"));
+        ASSERT_TRUE(addFile(session, "/b.txt", "hello"));
+        flushSession(session);
+        ASSERT_TRUE(addFile(session, "/d/c.txt", "abcdabcd"));
+        ASSERT_TRUE(move(session, "/b.txt", "/d/b.txt"));
+        ASSERT_TRUE(remove(session, "/d/a.txt"));
+        closeSession(session);
+        ASSERT_EQ(readFile(nomes[i], "/d/b.txt"), std::string("hello"));
+
+        // A leitura antecipada dos blocos de um diretório e de um arquivo devolve o mesmo conteúdo.
+        std::string conteudo;
+        session = openSession(nomes[i], options);
+        ASSERT_TRUE(readFile(session, "/d/c.txt", conteudo));
+        ASSERT_EQ(conteudo, std::string("abcdabcd"));
+        closeSession(session);
+
+        if (i < 5)
+        {
+            std::ifstream arquivo(nomes[i], std::ios::binary);
+            bytes[i].assign(std::istreambuf_iterator<char>(arquivo), std::istreambuf_iterator<char>());
+        }
+        else
+        {
+            ASSERT_TRUE(readMemoryImage(nomes[i], bytes[i]));
+        }
+        ASSERT_EQ(bytes[i], bytes[0]);
+    }
+    ASSERT_TRUE(fopen("mem:dev", "rb") == NULL);
+
+    // Uma imagem copiada para a memória pode ser lida pelo mapeamento e alterada sem tocar no arquivo.
+    writeMemoryImage("mem:copia", bytes[0]);
+    FS_MAPPED *image = mapImage("mem:copia");
+    ASSERT_TRUE(image != NULL);
+    unmapImage(image);
+    addFile("mem:copia", "/e.txt", "e");
+    ASSERT_EQ(readFile("mem:copia", "/e.txt"), std::string("e"));
+    ASSERT_EQ(readFile(nomes[0], "/e.txt"), std::string(""));
+    freeMemoryImage("mem:copia");
+    freeMemoryImage("mem:dev");
+    std::vector<unsigned char> vazio;
+    ASSERT_FALSE(readMemoryImage("mem:copia", vazio));
+}
+
+TEST(FsTest, poolDeImagens){
+    // Com o pool as funções de fs.h gravam os mesmos bytes que sem ele.
+    const char *nomes[] = {"fs-pool-sem.bin.solucao", "fs-pool-com.bin.solucao"};
+    std::string bytes[2];
+    for (int i = 0; i < 2; i++)
+    {
+        configureHandlePool(i == 0 ? 0 : 1 << 20);
+        initFs(nomes[i], 4, 32, 8);
+        addDir(nomes[i], "/d");
+        addFile(nomes[i], "/d/a.txt", "abcdefgh");
+        move(nomes[i], "/d/a.txt", "/a.txt");
+        addFile(nomes[i], "/b.txt", "xy");
+        remove(nomes[i], "/d");
+        ASSERT_EQ(readFile(nomes[i], "/a.txt"), std::string("abcdefgh"));
+        std::ifstream arquivo(nomes[i], std::ios::binary);
+        bytes[i].assign(std::istreambuf_iterator<char>(arquivo), std::istreambuf_iterator<char>());
+    }
+    ASSERT_EQ(bytes[0], bytes[1]);
+    FS_POOL_STATS stats = handlePoolStats();
+    ASSERT_EQ(stats.misses, 1);
+    ASSERT_EQ(stats.hits, 5);
+    ASSERT_EQ(stats.images, 1);
+
+    // Requisições simultâneas para a mesma imagem compartilham a sessão, uma de cada vez.
+    initFs("fs-pool-threads.bin.solucao", 4, 64, 32);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.push_back(std::thread([t]() {
+            for (int i = 0; i < 5; i++)
+            {
+                FS_SESSION *session = acquireSession("fs-pool-threads.bin.solucao");
+                addFile(session, "/" + std::to_string(t) + "-" + std::to_string(i), "t");
+                releaseSession(session);
+            }
+        }));
+    }
+    for (int t = 0; t < 4; t++)
+    {
+        threads[t].join();
+    }
+    stats = handlePoolStats();
+    ASSERT_EQ(stats.images, 2);
+
+    // Com um limite pequeno a imagem menos usada recentemente é gravada e fechada.
+    configureHandlePool(stats.memory - 1);
+    stats = handlePoolStats();
+    ASSERT_EQ(stats.images, 1);
+    ASSERT_EQ(stats.evictions, 1);
+    ASSERT_EQ(readFile("fs-pool-threads.bin.solucao", "/3-4"), std::string("t"));
+    configureHandlePool(0);
+    ASSERT_EQ(handlePoolStats().images, 0);
+    FS_SESSION *session = openSession("fs-pool-threads.bin.solucao");
+    FS_DIR dir;
+    FS_DIRENT entrada;
+    int arquivos = 0;
+    ASSERT_TRUE(openDir(session, "/", dir));
+    while (readDir(dir, entrada))
+    {
+        arquivos++;
+    }
+    ASSERT_EQ(arquivos, 20);
+    closeSession(session);
+
+    // initFs com a imagem adquirida: a sessão antiga não grava nada por cima da imagem nova.
+    configureHandlePool(1 << 20);
+    initFs("fs-pool-init.bin.solucao", 4, 32, 8);
+    session = acquireSession("fs-pool-init.bin.solucao");
+    ASSERT_TRUE(addFile(session, "/velho", "v"));
+    initFs("fs-pool-init.bin.solucao", 4, 32, 8);
+    flushSession(session);
+    releaseSession(session);
+    ASSERT_EQ(handlePoolStats().images, 0);
+    session = acquireSession("fs-pool-init.bin.solucao");
+    std::string conteudo;
+    ASSERT_FALSE(readFile(session, "/velho", conteudo));
+    ASSERT_TRUE(addFile(session, "/novo", "n"));
+    releaseSession(session);
+    configureHandlePool(0);
+    ASSERT_EQ(statFs("fs-pool-init.bin.solucao").freeBlocks, 30);
+    std::vector<std::string> problemas;
+    ASSERT_TRUE(checkFs("fs-pool-init.bin.solucao", problemas));
+
+    // Uma sessão de openSession entre duas operações do pool: a segunda não grava a cópia antiga por cima.
+    configureHandlePool(1 << 20);
+    initFs("fs-pool-sessao.bin.solucao", 4, 8, 8);
+    addDir("fs-pool-sessao.bin.solucao", "/a");
+    session = openSession("fs-pool-sessao.bin.solucao");
+    ASSERT_TRUE(addDir(session, "/b"));
+    closeSession(session);
+    addDir("fs-pool-sessao.bin.solucao", "/c");
+    configureHandlePool(0);
+    session = openSession("fs-pool-sessao.bin.solucao");
+    ASSERT_TRUE(openDir(session, "/", dir));
+    arquivos = 0;
+    while (readDir(dir, entrada))
+    {
+        arquivos++;
+    }
+    ASSERT_EQ(arquivos, 3);
+    closeSession(session);
+    ASSERT_TRUE(checkFs("fs-pool-sessao.bin.solucao", problemas));
+}
+
+TEST(FsTest, statFsEContadores){
+    // Os totais gravados no superbloco acompanham cada alteração e batem com a contagem do fsck.
+    initFs("fs-statfs.bin.solucao", 4, 64, 16, FS_FEATURE_COUNTERS | FS_FEATURE_GROUPS | FS_FEATURE_DEDUP);
+    FS_STATFS stats = statFs("fs-statfs.bin.solucao");
+    ASSERT_EQ(stats.freeBlocks, 63);
+    ASSERT_EQ(stats.freeInodes, 15);
+    ASSERT_EQ(stats.dirs, 1);
+    ASSERT_EQ(stats.files, 0);
+    ASSERT_EQ(stats.usedBytes, 0);
+
+    addDir("fs-statfs.bin.solucao", "/d");
+    addFile("fs-statfs.bin.solucao", "/d/a.txt", "abcdefgh");
+    addFile("fs-statfs.bin.solucao", "/b.txt", "abcdefgh");
+    addFile("fs-statfs.bin.solucao", "/c.txt", "xyz");
+    remove("fs-statfs.bin.solucao", "/c.txt");
+    stats = statFs("fs-statfs.bin.solucao");
+    ASSERT_EQ(stats.dirs, 2);
+    ASSERT_EQ(stats.files, 2);
+    ASSERT_EQ(stats.usedBytes, 16);
+    // Raiz com 2 blocos (d e b.txt), /d com 1 e os dois arquivos compartilhando 2 blocos deduplicados.
+    ASSERT_EQ(stats.freeBlocks, 64 - 1 - 1 - 2);
+
+    FS_SESSION *session = openSession("fs-statfs.bin.solucao");
+    ASSERT_TRUE(addFile(session, "/d/e.txt", "e"));
+    FS_STATFS pendente = statFs(session);
+    ASSERT_EQ(pendente.files, 3);
+    ASSERT_EQ(pendente.usedBytes, 17);
+    closeSession(session);
+
+    std::vector<std::string> problemas;
+    ASSERT_TRUE(checkFs("fs-statfs.bin.solucao", problemas));
+
+    // Imagens sem os totais gravados são contadas ao abrir, com o mesmo resultado.
+    initFs("fs-statfs-sem.bin.solucao", 4, 64, 16, FS_FEATURE_GROUPS | FS_FEATURE_DEDUP);
+    addDir("fs-statfs-sem.bin.solucao", "/d");
+    addFile("fs-statfs-sem.bin.solucao", "/d/a.txt", "abcdefgh");
+    addFile("fs-statfs-sem.bin.solucao", "/b.txt", "abcdefgh");
+    addFile("fs-statfs-sem.bin.solucao", "/d/e.txt", "e");
+    FS_STATFS contado = statFs("fs-statfs-sem.bin.solucao");
+    stats = statFs("fs-statfs.bin.solucao");
+    ASSERT_EQ(contado.freeBlocks, stats.freeBlocks);
+    ASSERT_EQ(contado.freeInodes, stats.freeInodes);
+    ASSERT_EQ(contado.usedBytes, stats.usedBytes);
+
+    // O fsck encontra um contador corrompido.
+    std::fstream arquivo("fs-statfs.bin.solucao", std::ios::binary | std::ios::in | std::ios::out);
+    arquivo.seekp(-5, std::ios::end);
+    arquivo.put(0);
+    arquivo.close();
+    ASSERT_FALSE(checkFs("fs-statfs.bin.solucao", problemas));
+    ASSERT_EQ(problemas.size(), 1);
+    ASSERT_EQ(problemas[0], std::string("free blocks counter is 0, expected 59"));
+}
+
+TEST(FsTest, alocacaoAdiadaSemEspaco){
+    // Com alocação adiada os blocos do arquivo ficam reservados no addFile: sem espaço, ele falha na hora, e as
+    // outras alocações não usam os blocos reservados.
+    initFs("fs-adiada.bin.solucao", 4, 8, 8);
+    addDir("fs-adiada.bin.solucao", "/a");
+    addDir("fs-adiada.bin.solucao", "/b");
+    FS_OPTIONS options = FS_OPTIONS();
+    options.delayedAllocation = true;
+    FS_SESSION *session = openSession("fs-adiada.bin.solucao", options);
+    ASSERT_FALSE(addFile(session, "/a/x", std::string(36, 'x')));
+    ASSERT_TRUE(addFile(session, "/a/x", std::string(12, 'x')));
+    ASSERT_FALSE(addFile(session, "/a/y", std::string(12, 'y')));
+    ASSERT_TRUE(addFile(session, "/b/y", std::string(8, 'y')));
+    ASSERT_FALSE(addDir(session, "/c"));
+    ASSERT_TRUE(move(session, "/a/x", "/b/x"));
+    closeSession(session);
+    ASSERT_EQ(readFile("fs-adiada.bin.solucao", "/b/x"), std::string(12, 'x'));
+    ASSERT_EQ(readFile("fs-adiada.bin.solucao", "/b/y"), std::string(8, 'y'));
+    ASSERT_EQ(statFs("fs-adiada.bin.solucao").freeBlocks, 0);
+    std::vector<std::string> problemas;
+    ASSERT_TRUE(checkFs("fs-adiada.bin.solucao", problemas));
+}
+
+TEST(FsTest, arquivosEsparsos){
+    // Blocos só de zeros viram buracos: ponteiro 0x00, nenhum bloco alocado, lidos de volta como zeros.
+    std::string esparso = "topo" + std::string(24, '\0') + "fim";
+    std::string zeros(20, '\0');
+    initFs("fs-esparso.bin.solucao", 4, 32, 8);
+    FS_STATFS antes = statFs("fs-esparso.bin.solucao");
+    addFile("fs-esparso.bin.solucao", "/a", esparso);
+    addFile("fs-esparso.bin.solucao", "/z", zeros);
+    ASSERT_EQ(readFile("fs-esparso.bin.solucao", "/a"), esparso);
+    ASSERT_EQ(readFile("fs-esparso.bin.solucao", "/z"), zeros);
+    ASSERT_EQ(antes.freeBlocks - statFs("fs-esparso.bin.solucao").freeBlocks, 2);
+
+    // A imagem de geometria fixa deixa os mesmos buracos.
+    FS_FIXED_IMAGE<4, 32, 8> image;
+    initFs(image);
+    ASSERT_TRUE(addFile(image, "/a", esparso));
+    ASSERT_TRUE(addFile(image, "/z", zeros));
+    ASSERT_TRUE(saveFs("fs-esparso-fixa.bin.solucao", image));
+    ASSERT_EQ(printSha256("fs-esparso-fixa.bin.solucao"), printSha256("fs-esparso.bin.solucao"));
+
+    // Com alocação adiada os buracos são decididos no flush; remover não libera bloco de buraco.
+    FS_OPTIONS options = FS_OPTIONS();
+    options.delayedAllocation = true;
+    FS_SESSION *session = openSession("fs-esparso.bin.solucao", options);
+    ASSERT_TRUE(addFile(session, "/b", zeros + "b"));
+    ASSERT_TRUE(remove(session, "/a"));
+    closeSession(session);
+    ASSERT_EQ(readFile("fs-esparso.bin.solucao", "/b"), zeros + "b");
+    ASSERT_EQ(antes.freeBlocks - statFs("fs-esparso.bin.solucao").freeBlocks, 1);
+    std::vector<std::string> problemas;
+    ASSERT_TRUE(checkFs("fs-esparso.bin.solucao", problemas));
+}
+
+std::vector<unsigned char> ponteirosGravados(const char *imagem, long posicaoInode){
+    std::ifstream arquivo(imagem, std::ios::binary);
+    std::vector<unsigned char> ponteiros(9);
+    arquivo.seekg(posicaoInode + 13);
+    arquivo.read((char *)ponteiros.data(), 9);
+    return ponteiros;
+}
+
+TEST(FsTest, extents){
+    // Um arquivo contíguo de 9 blocos é gravado como uma extensão só: {lógico 0, bloco 1, 9 blocos}.
+    initFs("fs-extents.bin.solucao", 16, 64, 16, FS_FEATURE_EXTENTS);
+    std::string contiguo(144, 'c');
+    addFile("fs-extents.bin.solucao", "/c", contiguo);
+    ASSERT_EQ(readFile("fs-extents.bin.solucao", "/c"), contiguo);
+    ASSERT_EQ(ponteirosGravados("fs-extents.bin.solucao", 3 + 8 + 22), std::vector<unsigned char>({0, 1, 9, 0, 0, 0, 0, 0, 0}));
+
+    // Sem sequência livre de 5 blocos, /big fica em 5 extensões: mais que as 3 do inode, então vão para um bloco folha.
+    initFs("fs-extents2.bin.solucao", 16, 13, 16, FS_FEATURE_EXTENTS);
+    for (int i = 1; i <= 10; i++)
+    {
+        addFile("fs-extents2.bin.solucao", "/b" + std::to_string(i), std::string(16, 'a' + i));
+    }
+    for (int i = 2; i <= 8; i += 2)
+    {
+        remove("fs-extents2.bin.solucao", "/b" + std::to_string(i));
+    }
+    std::string fragmentado(80, 'f');
+    addFile("fs-extents2.bin.solucao", "/big", fragmentado);
+    ASSERT_EQ(statFs("fs-extents2.bin.solucao").freeBlocks, 0);
+    ASSERT_EQ(ponteirosGravados("fs-extents2.bin.solucao", 3 + 2 + 2 * 22), std::vector<unsigned char>({0xFF, 12, 5, 0, 0, 0, 0, 0, 0}));
+    ASSERT_EQ(readFile("fs-extents2.bin.solucao", "/big"), fragmentado);
+    std::vector<std::string> problemas;
+    ASSERT_TRUE(checkFs("fs-extents2.bin.solucao", problemas));
+
+    // O mapeamento desfaz as extensões da folha.
+    FS_MAPPED *image = mapImage("fs-extents2.bin.solucao");
+    std::string conteudo;
+    ASSERT_TRUE(readFileMapped(image, 2, conteudo));
+    ASSERT_EQ(conteudo, fragmentado);
+    unmapImage(image);
+
+    // Remover libera os dados e a folha.
+    remove("fs-extents2.bin.solucao", "/big");
+    ASSERT_EQ(statFs("fs-extents2.bin.solucao").freeBlocks, 6);
+    ASSERT_TRUE(checkFs("fs-extents2.bin.solucao", problemas));
+}
+
+TEST(FsTest, writeAtEAppend){
+    // Append e writeAt alteram só os blocos da faixa: o primeiro bloco de /log fica onde estava.
+    initFs("fs-escrita.bin.solucao", 4, 32, 8);
+    addFile("fs-escrita.bin.solucao", "/log", "abc");
+    addDir("fs-escrita.bin.solucao", "/d");
+    FS_STATFS antes = statFs("fs-escrita.bin.solucao");
+    unsigned char primeiro = ponteirosGravados("fs-escrita.bin.solucao", 3 + 4 + 22)[0];
+    ASSERT_TRUE(append("fs-escrita.bin.solucao", "/log", "defgh"));
+    ASSERT_TRUE(writeAt("fs-escrita.bin.solucao", "/log", 1, "XY"));
+    ASSERT_EQ(readFile("fs-escrita.bin.solucao", "/log"), "aXYdefgh");
+    ASSERT_EQ(antes.freeBlocks - statFs("fs-escrita.bin.solucao").freeBlocks, 1);
+    ASSERT_EQ(ponteirosGravados("fs-escrita.bin.solucao", 3 + 4 + 22)[0], primeiro);
+
+    // Depois do fim: os blocos do meio são buracos.
+    ASSERT_TRUE(writeAt("fs-escrita.bin.solucao", "/log", 20, "z"));
+    ASSERT_EQ(readFile("fs-escrita.bin.solucao", "/log"), "aXYdefgh" + std::string(12, '\0') + "z");
+    ASSERT_EQ(antes.freeBlocks - statFs("fs-escrita.bin.solucao").freeBlocks, 2);
+
+    ASSERT_FALSE(append("fs-escrita.bin.solucao", "/d", "x"));
+    ASSERT_FALSE(append("fs-escrita.bin.solucao", "/nada", "x"));
+    ASSERT_FALSE(writeAt("fs-escrita.bin.solucao", "/log", 250, "123456"));
+    ASSERT_FALSE(writeAt("fs-escrita.bin.solucao", "/log", -1, "x"));
+    std::vector<std::string> problemas;
+    ASSERT_TRUE(checkFs("fs-escrita.bin.solucao", problemas));
+
+    // Com deduplicação o bloco compartilhado é copiado; com compressão o arquivo é regravado inteiro.
+    initFs("fs-escrita2.bin.solucao", 4, 64, 8, FS_FEATURE_COMPRESSION | FS_FEATURE_DEDUP);
+    std::string repetido(32, 'r');
+    addFile("fs-escrita2.bin.solucao", "/a", "mesmo");
+    addFile("fs-escrita2.bin.solucao", "/b", "mesmo");
+    addFile("fs-escrita2.bin.solucao", "/c", repetido);
+    FS_SESSION *session = openSession("fs-escrita2.bin.solucao");
+    ASSERT_TRUE(writeAt(session, "/a", 0, "M"));
+    ASSERT_TRUE(append(session, "/c", "fim"));
+    closeSession(session);
+    ASSERT_EQ(readFile("fs-escrita2.bin.solucao", "/a"), "Mesmo");
+    ASSERT_EQ(readFile("fs-escrita2.bin.solucao", "/b"), "mesmo");
+    ASSERT_EQ(readFile("fs-escrita2.bin.solucao", "/c"), repetido + "fim");
+    ASSERT_TRUE(checkFs("fs-escrita2.bin.solucao", problemas));
+}
+
+TEST(FsTest, traceERepeticao){
+    // Cada chamada de fs.h vira uma linha do trace, inclusive conteúdo com bytes fora do ASCII.
+    std::string binario("a\"b\\\n\x01\xff", 7);
+    ASSERT_TRUE(startTrace("fs-trace.jsonl.solucao"));
+    initFs("fs-trace.bin.solucao", 4, 32, 8);
+    addDir("fs-trace.bin.solucao", "/d");
+    addFile("fs-trace.bin.solucao", "/d/a.txt", binario);
+    move("fs-trace.bin.solucao", "/d/a.txt", "/a.txt");
+    readFile("fs-trace.bin.solucao", "/a.txt");
+    ASSERT_TRUE(append("fs-trace.bin.solucao", "/a.txt", "++"));
+    ASSERT_TRUE(writeAt("fs-trace.bin.solucao", "/a.txt", 1, "W"));
+    remove("fs-trace.bin.solucao", "/d");
+    stopTrace();
+    std::ifstream original("fs-trace.bin.solucao", std::ios::binary);
+    std::string bytesOriginal((std::istreambuf_iterator<char>(original)), std::istreambuf_iterator<char>());
+    addDir("fs-trace.bin.solucao", "/fora");
+
+    std::vector<FS_TRACE_RECORD> registros;
+    ASSERT_TRUE(readTrace("fs-trace.jsonl.solucao", registros));
+    ASSERT_EQ(registros.size(), 8);
+    FS_TRACE_OP ops[] = {FS_TRACE_INIT, FS_TRACE_ADD_DIR, FS_TRACE_ADD_FILE, FS_TRACE_MOVE, FS_TRACE_READ_FILE, FS_TRACE_APPEND,
+                         FS_TRACE_WRITE_AT, FS_TRACE_REMOVE};
+    for (int i = 0; i < 8; i++)
+    {
+        ASSERT_EQ(registros[i].op, ops[i]);
+        ASSERT_TRUE(registros[i].ok);
+        ASSERT_EQ(registros[i].image, std::string("fs-trace.bin.solucao"));
+        ASSERT_TRUE(i == 0 || registros[i].timeUs >= registros[i - 1].timeUs);
+    }
+    ASSERT_EQ(registros[0].numBlocks, 32);
+    ASSERT_EQ(registros[2].content, binario);
+    ASSERT_EQ(registros[3].newPath, std::string("/a.txt"));
+    ASSERT_EQ(registros[4].size, 7);
+    ASSERT_EQ(registros[5].content, std::string("++"));
+    ASSERT_EQ(registros[6].offset, 1);
+    ASSERT_EQ(registros[6].content, std::string("W"));
+
+    // Repetir o trace em outra imagem chega aos mesmos bytes.
+    for (int i = 0; i < registros.size(); i++)
+    {
+        const FS_TRACE_RECORD &r = registros[i];
+        if (r.op == FS_TRACE_INIT)
+            initFs("fs-trace-rep.bin.solucao", r.blockSize, r.numBlocks, r.numInodes, r.features);
+        else if (r.op == FS_TRACE_ADD_DIR)
+            addDir("fs-trace-rep.bin.solucao", r.path);
+        else if (r.op == FS_TRACE_ADD_FILE)
+            addFile("fs-trace-rep.bin.solucao", r.path, r.content);
+        else if (r.op == FS_TRACE_MOVE)
+            move("fs-trace-rep.bin.solucao", r.path, r.newPath);
+        else if (r.op == FS_TRACE_REMOVE)
+            remove("fs-trace-rep.bin.solucao", r.path);
+        else if (r.op == FS_TRACE_WRITE_AT)
+            writeAt("fs-trace-rep.bin.solucao", r.path, r.offset, r.content);
+        else if (r.op == FS_TRACE_APPEND)
+            append("fs-trace-rep.bin.solucao", r.path, r.content);
+    }
+    std::ifstream repetido("fs-trace-rep.bin.solucao", std::ios::binary);
+    std::string bytesRepetido((std::istreambuf_iterator<char>(repetido)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(bytesOriginal, bytesRepetido);
+
+    // Sem conteúdo, só o tamanho fica no trace.
+    ASSERT_TRUE(startTrace("fs-trace.jsonl.solucao", false));
+    addFile("fs-trace.bin.solucao", "/b.txt", "segredo");
+    append("fs-trace.bin.solucao", "/b.txt", "!!");
+    stopTrace();
+    ASSERT_TRUE(readTrace("fs-trace.jsonl.solucao", registros));
+    ASSERT_EQ(registros.size(), 2);
+    ASSERT_FALSE(registros[0].hasContent);
+    ASSERT_EQ(registros[0].size, 7);
+    ASSERT_FALSE(registros[1].hasContent);
+    ASSERT_EQ(registros[1].size, 2);
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
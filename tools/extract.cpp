@@ -0,0 +1,183 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Extrai todos os arquivos e diretórios de uma imagem para um diretório do sistema de arquivos local.
+// A árvore é percorrida uma vez (walkTree), os diretórios são criados em pré-ordem (pais antes dos filhos) e o
+// conteúdo dos arquivos é lido da imagem mapeada e gravado por um conjunto de threads.
+//
+// Compilar: g++ tools/extract.cpp fs.cpp sha256.cpp -o extract.out -O2 -std=c++17 -lcrypto -lpthread
+// Executar: ./extract.out <imagem> <diretorio> [--threads N]
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#include "../fsExt.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Entrada encontrada no percurso, com o caminho relativo à raiz da imagem.
+typedef struct
+{
+	string caminho;
+	bool isDir;
+	int inode;
+} ENTRADA;
+
+// Estado do percurso: caminho de cada nível aberto e entradas em pré-ordem.
+typedef struct
+{
+	vector<string> niveis;
+	vector<ENTRADA> entradas;
+} PERCURSO;
+
+FS_WALK_ACTION coletar(const FS_DIRENT &entry, int depth, void *context)
+{
+	PERCURSO *percurso = (PERCURSO *)context;
+	string nome(entry.name, entry.nameLength);
+	if (nome.empty() || nome == "." || nome == ".." || nome.find('/') != string::npos)
+	{
+		fprintf(stderr, "skipping invalid name at depth %d\n", depth);
+		return FS_WALK_SKIP;
+	}
+
+	string caminho = depth == 0 ? nome : percurso->niveis[depth - 1] + "/" + nome;
+	percurso->entradas.push_back({caminho, entry.isDir, entry.inode});
+	if (entry.isDir)
+	{
+		percurso->niveis.resize(depth + 1);
+		percurso->niveis[depth] = caminho;
+	}
+	return FS_WALK_CONTINUE;
+}
+
+// Lê e grava os arquivos com numThreads threads; cada thread pega o próximo arquivo da lista.
+bool gravarArquivos(FS_MAPPED *image, const fs::path &destino, const vector<ENTRADA> &entradas, int numThreads, long &bytes)
+{
+	atomic<int> proximo(0);
+	atomic<bool> ok(true);
+	atomic<long> total(0);
+	vector<thread> threads;
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.push_back(thread([&]()
+								 {
+			string conteudo;
+			for (int i = proximo++; i < (int)entradas.size(); i = proximo++)
+			{
+				if (entradas[i].isDir)
+				{
+					continue;
+				}
+				if (!readFileMapped(image, entradas[i].inode, conteudo))
+				{
+					fprintf(stderr, "could not read %s\n", entradas[i].caminho.c_str());
+					ok = false;
+					continue;
+				}
+				ofstream arquivo(destino / entradas[i].caminho, ios::binary | ios::trunc);
+				if (!arquivo.write(conteudo.data(), conteudo.size()))
+				{
+					fprintf(stderr, "could not write %s\n", entradas[i].caminho.c_str());
+					ok = false;
+					continue;
+				}
+				total += conteudo.size();
+			} }));
+	}
+	for (int t = 0; t < threads.size(); t++)
+	{
+		threads[t].join();
+	}
+	bytes = total;
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <image> <dir> [--threads N]\n", argv[0]);
+		return 1;
+	}
+
+	int numThreads = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 4;
+	for (int i = 3; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--threads") == 0)
+		{
+			numThreads = max(1, atoi(argv[i + 1]));
+		}
+	}
+
+	FILE *teste = fopen(argv[1], "rb");
+	if (teste == NULL)
+	{
+		fprintf(stderr, "could not open %s\n", argv[1]);
+		return 1;
+	}
+	fclose(teste);
+
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+
+	PERCURSO percurso;
+	FS_SESSION *session = openSession(argv[1]);
+	walkTree(session, "/", coletar, NULL, &percurso);
+	closeSession(session);
+
+	chrono::steady_clock::time_point percorrido = chrono::steady_clock::now();
+
+	// Pré-ordem: todo diretório aparece antes das suas entradas.
+	fs::path destino(argv[2]);
+	error_code erro;
+	fs::create_directories(destino, erro);
+	if (erro)
+	{
+		fprintf(stderr, "could not create %s\n", argv[2]);
+		return 1;
+	}
+	int numDiretorios = 0;
+	for (int i = 0; i < percurso.entradas.size(); i++)
+	{
+		if (percurso.entradas[i].isDir)
+		{
+			fs::create_directory(destino / percurso.entradas[i].caminho, erro);
+			if (erro)
+			{
+				fprintf(stderr, "could not create %s\n", percurso.entradas[i].caminho.c_str());
+				return 1;
+			}
+			numDiretorios++;
+		}
+	}
+
+	chrono::steady_clock::time_point criado = chrono::steady_clock::now();
+
+	FS_MAPPED *image = mapImage(argv[1]);
+	if (image == NULL)
+	{
+		fprintf(stderr, "could not map %s\n", argv[1]);
+		return 1;
+	}
+	long bytes = 0;
+	bool ok = gravarArquivos(image, destino, percurso.entradas, numThreads, bytes);
+	unmapImage(image);
+
+	chrono::steady_clock::time_point fim = chrono::steady_clock::now();
+
+	printf("%s: %d directories, %d files, %ld bytes\n", argv[2], numDiretorios, (int)percurso.entradas.size() - numDiretorios, bytes);
+	printf("walk %.3f ms, mkdir %.3f ms, write (%d threads) %.3f ms\n",
+		   chrono::duration<double, milli>(percorrido - inicio).count(),
+		   chrono::duration<double, milli>(criado - percorrido).count(), numThreads,
+		   chrono::duration<double, milli>(fim - criado).count());
+	return ok ? 0 : 1;
+}
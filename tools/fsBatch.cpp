@@ -0,0 +1,449 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Executa um lote de trabalhos sobre muitas imagens com um conjunto de threads com roubo de tarefas.
+// Os trabalhos de cada imagem rodam na ordem do manifesto; imagens diferentes rodam em paralelo. Os trabalhos
+// consecutivos que alteram uma imagem formam uma única etapa (uma sessão, um flush). Cada thread tem a sua fila:
+// ao terminar uma etapa ela continua a mesma imagem (a próxima etapa vai para o fim da sua fila), e uma thread sem
+// tarefas rouba a etapa mais antiga da fila de outra. Assim etapas de gravação (mkfs, alterações) de umas imagens e
+// de hash (CPU) de outras ficam ocupando todas as threads ao mesmo tempo. Uma thread sem nada para roubar dorme até
+// outra etapa ser enfileirada. Uma etapa de uma imagem que não existe conta como falha dos seus trabalhos.
+//
+// Manifesto, um trabalho por linha ('#' começa um comentário). A imagem pode ter um intervalo {a..b}, que repete a
+// linha para cada número:
+//
+//   img{0..199}.bin mkfs 4 64 32 [lz,dedup,groups,counters,extents]
+//   img{0..199}.bin addDir /d
+//   img{0..199}.bin addFile /d/a.txt conteúdo até o fim da linha
+//   img{0..199}.bin fill 20 40          20 arquivos /f0../f19 de 40 bytes
+//   img{0..199}.bin remove /d/a.txt
+//   img{0..199}.bin move /f1 /d/f1
+//   img{0..199}.bin verify              checkFs (fsck)
+//   img{0..199}.bin hash                printSha256
+//
+// Compilar: g++ tools/fsBatch.cpp fs.cpp sha256.cpp -o fsBatch.out -O2 -std=c++17 -lcrypto -lpthread
+// Executar: ./fsBatch.out <manifesto> [--threads N] [--quiet]
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#include "../fsExt.h"
+#include "../sha256.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+enum TIPO_ETAPA
+{
+	ETAPA_MKFS,
+	ETAPA_ALTERACOES,
+	ETAPA_VERIFY,
+	ETAPA_HASH,
+	NUM_ETAPAS
+};
+
+const char *NOMES_ETAPAS[NUM_ETAPAS] = {"mkfs", "mutate", "verify", "hash"};
+
+typedef struct
+{
+	string op;
+	vector<string> argumentos;
+} TRABALHO;
+
+typedef struct
+{
+	int tipo;
+	vector<TRABALHO> trabalhos;        // ETAPA_ALTERACOES: todos na mesma sessão
+} ETAPA;
+
+typedef struct
+{
+	string nome;
+	vector<ETAPA> etapas;
+
+	// Resultados, gravados só pela thread que executa a etapa.
+	string hash;
+	vector<string> problemas;
+	int falhas;
+} IMAGEM_LOTE;
+
+// Fila de uma thread. A dona tira do fim; as outras roubam do começo.
+typedef struct
+{
+	mutex trava;
+	deque<pair<int, int>> tarefas;     // (imagem, etapa)
+} FILA;
+
+typedef struct
+{
+	atomic<long> quantidade;
+	atomic<long> microssegundos;
+	atomic<long> bytes;
+} ESTATISTICA;
+
+// Expande o intervalo {a..b} do nome da imagem (sem intervalo, o nome fica como está). false se o intervalo for inválido.
+bool expandirIntervalo(const string &padrao, vector<string> &nomes)
+{
+	size_t abre = padrao.find('{'), fecha = padrao.find('}');
+	int a, b;
+	if (abre == string::npos || fecha == string::npos || fecha < abre ||
+		sscanf(padrao.substr(abre, fecha - abre + 1).c_str(), "{%d..%d}", &a, &b) != 2 || b < a)
+	{
+		nomes.push_back(padrao);
+		return abre == string::npos;
+	}
+	for (int i = a; i <= b; i++)
+	{
+		nomes.push_back(padrao.substr(0, abre) + to_string(i) + padrao.substr(fecha + 1));
+	}
+	return true;
+}
+
+// Lê o manifesto e monta as etapas de cada imagem, na ordem em que as imagens aparecem.
+bool lerManifesto(const char *nomeArquivo, vector<IMAGEM_LOTE> &imagens)
+{
+	ifstream manifesto(nomeArquivo);
+	if (!manifesto)
+	{
+		fprintf(stderr, "could not open %s\n", nomeArquivo);
+		return false;
+	}
+	map<string, int> indice;
+	string linha;
+	for (int numero = 1; getline(manifesto, linha); numero++)
+	{
+		size_t comentario = linha.find('#');
+		if (comentario != string::npos)
+		{
+			linha.erase(comentario);
+		}
+		istringstream campos(linha);
+		string padrao;
+		TRABALHO trabalho;
+		if (!(campos >> padrao))
+		{
+			continue;
+		}
+		campos >> trabalho.op;
+		string argumento;
+		if (trabalho.op == "addFile")
+		{
+			// O conteúdo é o resto da linha.
+			campos >> argumento;
+			trabalho.argumentos.push_back(argumento);
+			getline(campos >> ws, argumento);
+			trabalho.argumentos.push_back(argumento);
+		}
+		while (campos >> argumento)
+		{
+			trabalho.argumentos.push_back(argumento);
+		}
+
+		int tipo = trabalho.op == "mkfs" ? ETAPA_MKFS : trabalho.op == "verify" ? ETAPA_VERIFY : trabalho.op == "hash" ? ETAPA_HASH : ETAPA_ALTERACOES;
+		size_t minimo = trabalho.op == "mkfs" ? 3 : trabalho.op == "move" || trabalho.op == "fill" || trabalho.op == "addFile" ? 2 : tipo == ETAPA_ALTERACOES ? 1 : 0;
+		bool conhecido = tipo != ETAPA_ALTERACOES || trabalho.op == "addDir" || trabalho.op == "addFile" || trabalho.op == "fill" ||
+						 trabalho.op == "remove" || trabalho.op == "move";
+		vector<string> nomes;
+		if (!conhecido || trabalho.argumentos.size() < minimo || !expandirIntervalo(padrao, nomes))
+		{
+			fprintf(stderr, "%s:%d: invalid job\n", nomeArquivo, numero);
+			return false;
+		}
+
+		for (int i = 0; i < nomes.size(); i++)
+		{
+			map<string, int>::iterator existente = indice.find(nomes[i]);
+			if (existente == indice.end())
+			{
+				existente = indice.insert(make_pair(nomes[i], (int)imagens.size())).first;
+				imagens.push_back(IMAGEM_LOTE());
+				imagens.back().nome = nomes[i];
+				imagens.back().falhas = 0;
+			}
+			vector<ETAPA> &etapas = imagens[existente->second].etapas;
+			if (tipo != ETAPA_ALTERACOES || etapas.empty() || etapas.back().tipo != ETAPA_ALTERACOES)
+			{
+				etapas.push_back(ETAPA());
+				etapas.back().tipo = tipo;
+			}
+			etapas.back().trabalhos.push_back(trabalho);
+		}
+	}
+	return true;
+}
+
+// As etapas que não criam a imagem precisam do arquivo: openSession e checkFs encerram o processo sem ele.
+bool imagemExiste(const char *nome)
+{
+	FILE *arquivo = fopen(nome, "rb");
+	if (arquivo == NULL)
+	{
+		return false;
+	}
+	fclose(arquivo);
+	return true;
+}
+
+// Executa uma etapa de uma imagem; devolve os bytes processados (hash) para a vazão.
+long executarEtapa(IMAGEM_LOTE &imagem, const ETAPA &etapa)
+{
+	const char *nome = imagem.nome.c_str();
+	if (etapa.tipo == ETAPA_MKFS)
+	{
+		const vector<string> &a = etapa.trabalhos[0].argumentos;
+		int features = 0;
+		if (a.size() > 3)
+		{
+			features |= a[3].find("lz") != string::npos ? FS_FEATURE_COMPRESSION : 0;
+			features |= a[3].find("dedup") != string::npos ? FS_FEATURE_DEDUP : 0;
+			features |= a[3].find("groups") != string::npos ? FS_FEATURE_GROUPS : 0;
+			features |= a[3].find("counters") != string::npos ? FS_FEATURE_COUNTERS : 0;
+			features |= a[3].find("extents") != string::npos ? FS_FEATURE_EXTENTS : 0;
+		}
+		initFs(imagem.nome, atoi(a[0].c_str()), atoi(a[1].c_str()), atoi(a[2].c_str()), features);
+		return 0;
+	}
+	if (!imagemExiste(nome))
+	{
+		imagem.falhas += etapa.trabalhos.size();
+		return 0;
+	}
+	if (etapa.tipo == ETAPA_VERIFY)
+	{
+		checkFs(imagem.nome, imagem.problemas);
+		return 0;
+	}
+	if (etapa.tipo == ETAPA_HASH)
+	{
+		imagem.hash = printSha256(nome);
+		FILE *arquivo = fopen(nome, "rb");
+		long tamanho = 0;
+		if (arquivo != NULL)
+		{
+			fseek(arquivo, 0, SEEK_END);
+			tamanho = ftell(arquivo);
+			fclose(arquivo);
+		}
+		return tamanho;
+	}
+
+	// Alterações consecutivas: uma sessão e um flush.
+	FS_SESSION *session = openSession(imagem.nome);
+	for (int i = 0; i < etapa.trabalhos.size(); i++)
+	{
+		const TRABALHO &t = etapa.trabalhos[i];
+		bool ok = true;
+		if (t.op == "addDir")
+		{
+			ok = addDir(session, t.argumentos[0]);
+		}
+		else if (t.op == "addFile")
+		{
+			ok = addFile(session, t.argumentos[0], t.argumentos[1]);
+		}
+		else if (t.op == "remove")
+		{
+			ok = remove(session, t.argumentos[0]);
+		}
+		else if (t.op == "move")
+		{
+			ok = move(session, t.argumentos[0], t.argumentos[1]);
+		}
+		else if (t.op == "fill")
+		{
+			int quantidade = atoi(t.argumentos[0].c_str()), tamanho = atoi(t.argumentos[1].c_str());
+			for (int f = 0; f < quantidade; f++)
+			{
+				ok = addFile(session, "/f" + to_string(f), string(tamanho, 'a' + f % 26)) && ok;
+			}
+		}
+		imagem.falhas += !ok;
+	}
+	closeSession(session);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <manifest> [--threads N] [--quiet]\n", argv[0]);
+		return 1;
+	}
+	int numThreads = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 4;
+	bool silencioso = false;
+	for (int i = 2; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			numThreads = max(1, atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--quiet") == 0)
+		{
+			silencioso = true;
+		}
+	}
+
+	vector<IMAGEM_LOTE> imagens;
+	if (!lerManifesto(argv[1], imagens))
+	{
+		return 1;
+	}
+
+	// A primeira etapa de cada imagem é distribuída entre as filas; as seguintes são enfileiradas por quem terminar
+	// a anterior.
+	vector<FILA> filas(numThreads);
+	atomic<long> restantes(0);
+	atomic<long> enfileiradas(imagens.size());
+	for (int i = 0; i < imagens.size(); i++)
+	{
+		restantes += imagens[i].etapas.size();
+		filas[i % numThreads].tarefas.push_back(make_pair(i, 0));
+	}
+
+	// Threads sem tarefa esperam aqui. Quem muda enfileiradas ou restantes passa pela trava antes de avisar, para
+	// o aviso não se perder entre o teste e a espera.
+	mutex travaEspera;
+	condition_variable temTarefa;
+	auto avisar = [&](bool todas)
+	{
+		{
+			lock_guard<mutex> trava(travaEspera);
+		}
+		if (todas)
+		{
+			temTarefa.notify_all();
+		}
+		else
+		{
+			temTarefa.notify_one();
+		}
+	};
+	ESTATISTICA estatisticas[NUM_ETAPAS];
+	for (int e = 0; e < NUM_ETAPAS; e++)
+	{
+		estatisticas[e].quantidade = 0;
+		estatisticas[e].microssegundos = 0;
+		estatisticas[e].bytes = 0;
+	}
+	atomic<long> roubos(0);
+
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	vector<thread> threads;
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.push_back(thread([&, t]()
+								 {
+			while (restantes > 0)
+			{
+				pair<int, int> tarefa(-1, -1);
+				{
+					lock_guard<mutex> trava(filas[t].trava);
+					if (!filas[t].tarefas.empty())
+					{
+						tarefa = filas[t].tarefas.back();
+						filas[t].tarefas.pop_back();
+						enfileiradas--;
+					}
+				}
+				for (int v = 1; tarefa.first == -1 && v < numThreads; v++)
+				{
+					FILA &vitima = filas[(t + v) % numThreads];
+					lock_guard<mutex> trava(vitima.trava);
+					if (!vitima.tarefas.empty())
+					{
+						tarefa = vitima.tarefas.front();
+						vitima.tarefas.pop_front();
+						enfileiradas--;
+						roubos++;
+					}
+				}
+				if (tarefa.first == -1)
+				{
+					unique_lock<mutex> trava(travaEspera);
+					temTarefa.wait(trava, [&]() { return enfileiradas > 0 || restantes == 0; });
+					continue;
+				}
+
+				IMAGEM_LOTE &imagem = imagens[tarefa.first];
+				const ETAPA &etapa = imagem.etapas[tarefa.second];
+				chrono::steady_clock::time_point antes = chrono::steady_clock::now();
+				long bytes = executarEtapa(imagem, etapa);
+				long duracao = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - antes).count();
+				estatisticas[etapa.tipo].quantidade++;
+				estatisticas[etapa.tipo].microssegundos += duracao;
+				estatisticas[etapa.tipo].bytes += bytes;
+
+				if (tarefa.second + 1 < imagem.etapas.size())
+				{
+					{
+						lock_guard<mutex> trava(filas[t].trava);
+						filas[t].tarefas.push_back(make_pair(tarefa.first, tarefa.second + 1));
+					}
+					enfileiradas++;
+					avisar(false);
+				}
+				if (--restantes == 0)
+				{
+					avisar(true);
+				}
+			} }));
+	}
+	for (int t = 0; t < threads.size(); t++)
+	{
+		threads[t].join();
+	}
+	double tempoTotal = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	// Resultados na ordem do manifesto.
+	int problemas = 0, falhas = 0;
+	long totalEtapas = 0;
+	for (int i = 0; i < imagens.size(); i++)
+	{
+		const IMAGEM_LOTE &imagem = imagens[i];
+		totalEtapas += imagem.etapas.size();
+		falhas += imagem.falhas;
+		problemas += imagem.problemas.size();
+		if (!silencioso && !imagem.hash.empty())
+		{
+			printf("%s  %s\n", imagem.hash.c_str(), imagem.nome.c_str());
+		}
+		for (int p = 0; p < imagem.problemas.size(); p++)
+		{
+			printf("%s: %s\n", imagem.nome.c_str(), imagem.problemas[p].c_str());
+		}
+		if (imagem.falhas > 0)
+		{
+			printf("%s: %d failed jobs\n", imagem.nome.c_str(), imagem.falhas);
+		}
+	}
+
+	fprintf(stderr, "%d images, %ld stages in %.3f s with %d threads: %.0f images/s, %.0f stages/s, %ld steals\n", (int)imagens.size(),
+			totalEtapas, tempoTotal, numThreads, imagens.size() / tempoTotal, totalEtapas / tempoTotal, roubos.load());
+	for (int e = 0; e < NUM_ETAPAS; e++)
+	{
+		if (estatisticas[e].quantidade == 0)
+		{
+			continue;
+		}
+		double segundos = estatisticas[e].microssegundos / 1e6;
+		fprintf(stderr, "  %-7s %8ld stages %10.3f s busy", NOMES_ETAPAS[e], estatisticas[e].quantidade.load(), segundos);
+		if (estatisticas[e].bytes > 0)
+		{
+			fprintf(stderr, " %10.1f MB/s per thread", estatisticas[e].bytes / 1e6 / segundos);
+		}
+		fprintf(stderr, "\n");
+	}
+	return problemas > 0 || falhas > 0 ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Cliente de fsServer. Lê comandos da entrada padrão, um por linha, envia todos pelo socket com até
+// --window pedidos em andamento e imprime as respostas na ordem dos comandos.
+//
+//   addFile <imagem> <caminho> <conteúdo até o fim da linha>
+//   addDir <imagem> <caminho>       remove <imagem> <caminho>       readFile <imagem> <caminho>
+//   move <imagem> <antigo> <novo>   flush <imagem>
+//
+// Compilar: g++ tools/fsClient.cpp -o fsClient.out -O2 -std=c++17
+// Executar: ./fsClient.out <socket> [--window N] < comandos.txt
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#include "protocolo.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+const char *NOMES_ESTADOS[] = {"ok", "failed", "invalid"};
+
+// Converte uma linha em pedido; false se o comando for desconhecido ou faltarem campos.
+bool interpretarLinha(const string &linha, unsigned int id, PEDIDO &pedido)
+{
+	istringstream entrada(linha);
+	string comando;
+	entrada >> comando;
+
+	const char *comandos[] = {"addFile", "addDir", "remove", "move", "readFile", "flush"};
+	pedido.operacao = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		if (comando == comandos[i])
+		{
+			pedido.operacao = OP_ADD_FILE + i;
+		}
+	}
+	if (pedido.operacao == 0)
+	{
+		return false;
+	}
+
+	pedido.id = id;
+	pedido.campos.assign(camposDaOperacao(pedido.operacao), "");
+	for (int i = 0; i < pedido.campos.size(); i++)
+	{
+		// O conteúdo de addFile é o resto da linha, com espaços.
+		if (pedido.operacao == OP_ADD_FILE && i == 2)
+		{
+			getline(entrada >> ws, pedido.campos[i]);
+		}
+		else if (!(entrada >> pedido.campos[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Lê do socket até ter uma resposta completa.
+bool receberResposta(int descritor, string &buffer, RESPOSTA &resposta)
+{
+	string corpo;
+	char bloco[16 * 1024];
+	while (extrairQuadro(buffer, corpo) != 1)
+	{
+		ssize_t n = recv(descritor, bloco, sizeof(bloco), 0);
+		if (n <= 0)
+		{
+			return false;
+		}
+		buffer.append(bloco, n);
+	}
+	return decodificarResposta(corpo, resposta);
+}
+
+bool enviarTudo(int descritor, const string &dados)
+{
+	for (size_t enviado = 0; enviado < dados.size();)
+	{
+		ssize_t n = send(descritor, dados.data() + enviado, dados.size() - enviado, MSG_NOSIGNAL);
+		if (n <= 0)
+		{
+			return false;
+		}
+		enviado += n;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <socket> [--window N] < commands\n", argv[0]);
+		return 1;
+	}
+	int janela = 64;
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--window") == 0)
+		{
+			janela = max(1, atoi(argv[i + 1]));
+		}
+	}
+
+	vector<PEDIDO> pedidos;
+	string linha;
+	while (getline(cin, linha))
+	{
+		if (linha.empty() || linha[0] == '#')
+		{
+			continue;
+		}
+		PEDIDO pedido;
+		if (!interpretarLinha(linha, pedidos.size(), pedido))
+		{
+			fprintf(stderr, "invalid command: %s\n", linha.c_str());
+			return 1;
+		}
+		pedidos.push_back(pedido);
+	}
+
+	sockaddr_un endereco;
+	memset(&endereco, 0, sizeof(endereco));
+	endereco.sun_family = AF_UNIX;
+	strncpy(endereco.sun_path, argv[1], sizeof(endereco.sun_path) - 1);
+	int descritor = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (descritor == -1 || connect(descritor, (sockaddr *)&endereco, sizeof(endereco)) == -1)
+	{
+		fprintf(stderr, "could not connect to %s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+
+	// Mantém até janela pedidos sem resposta: envia em lotes e lê uma resposta para cada pedido novo.
+	string buffer;
+	int enviados = 0;
+	int falhas = 0;
+	for (int recebidos = 0; recebidos < pedidos.size(); recebidos++)
+	{
+		string lote;
+		while (enviados < pedidos.size() && enviados - recebidos < janela)
+		{
+			codificarPedido(lote, pedidos[enviados++]);
+		}
+		if (!lote.empty() && !enviarTudo(descritor, lote))
+		{
+			fprintf(stderr, "connection lost\n");
+			return 1;
+		}
+
+		RESPOSTA resposta;
+		if (!receberResposta(descritor, buffer, resposta) || resposta.id != recebidos)
+		{
+			fprintf(stderr, "connection lost\n");
+			return 1;
+		}
+		if (resposta.estado > ESTADO_INVALIDO)
+		{
+			resposta.estado = ESTADO_INVALIDO;
+		}
+		falhas += resposta.estado != ESTADO_OK;
+		printf("%u %s", resposta.id, NOMES_ESTADOS[resposta.estado]);
+		if (pedidos[recebidos].operacao == OP_READ && resposta.estado == ESTADO_OK)
+		{
+			printf(" %s", resposta.dado.c_str());
+		}
+		printf("\n");
+	}
+	close(descritor);
+
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - inicio).count();
+	fprintf(stderr, "%d requests (%d not ok) in %.3f ms, window %d\n", (int)pedidos.size(), falhas, ms, janela);
+	return 0;
+}
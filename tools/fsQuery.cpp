@@ -0,0 +1,97 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Consultas find/du/count sobre uma imagem usando o índice de caminhos (<imagem>.idx).
+// Na primeira execução o índice é montado percorrendo a imagem e gravado; nas seguintes ele é só lido, a menos que
+// a imagem tenha sido alterada sem o índice. As sessões abertas com FS_OPTIONS::pathIndex o mantêm atualizado.
+//
+//   find <diretório> [--larger-than N]   arquivos da subárvore maiores que N bytes
+//   du <caminho>                         bytes e blocos usados pela subárvore
+//   count <caminho>                      arquivos e diretórios da subárvore
+//
+// Compilar: g++ tools/fsQuery.cpp fs.cpp sha256.cpp -o fsQuery.out -O2 -std=c++17 -lcrypto -lpthread
+// Executar: ./fsQuery.out <imagem> <find|du|count> <caminho> [--larger-than N]
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#include "../fsExt.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+	if (argc < 4)
+	{
+		fprintf(stderr, "usage: %s <image> <find|du|count> <path> [--larger-than N]\n", argv[0]);
+		return 1;
+	}
+	string consulta = argv[2];
+	int maiorQue = -1;
+	for (int i = 4; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--larger-than") == 0)
+		{
+			maiorQue = atoi(argv[i + 1]);
+		}
+	}
+	if (consulta != "find" && consulta != "du" && consulta != "count")
+	{
+		fprintf(stderr, "unknown query: %s\n", argv[2]);
+		return 1;
+	}
+
+	FILE *teste = fopen(argv[1], "rb");
+	if (teste == NULL)
+	{
+		fprintf(stderr, "could not open %s\n", argv[1]);
+		return 1;
+	}
+	fclose(teste);
+
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	FS_OPTIONS options = FS_OPTIONS();
+	options.pathIndex = true;
+	FS_SESSION *session = openSession(argv[1], options);
+	chrono::steady_clock::time_point aberto = chrono::steady_clock::now();
+
+	bool ok;
+	if (consulta == "find")
+	{
+		vector<FS_INDEX_ENTRY> encontrados;
+		ok = findFiles(session, argv[3], maiorQue, encontrados);
+		for (int i = 0; i < encontrados.size(); i++)
+		{
+			printf("%s\t%d\t%d\n", encontrados[i].path.c_str(), encontrados[i].size, encontrados[i].blocks);
+		}
+	}
+	else
+	{
+		FS_USAGE uso;
+		ok = diskUsage(session, argv[3], uso);
+		if (ok && consulta == "du")
+		{
+			printf("%ld bytes\t%d blocks\t%s\n", uso.bytes, uso.blocks, argv[3]);
+		}
+		else if (ok)
+		{
+			printf("%d files\t%d dirs\t%s\n", uso.files, uso.dirs, argv[3]);
+		}
+	}
+	chrono::steady_clock::time_point consultado = chrono::steady_clock::now();
+
+	// Grava o índice se ele teve de ser montado.
+	closeSession(session);
+
+	if (!ok)
+	{
+		fprintf(stderr, "no such path: %s\n", argv[3]);
+	}
+	fprintf(stderr, "open+index %.3f ms, query %.3f ms\n", chrono::duration<double, milli>(aberto - inicio).count(),
+			chrono::duration<double, milli>(consultado - aberto).count());
+	return ok ? 0 : 1;
+}
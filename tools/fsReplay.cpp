@@ -0,0 +1,195 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Repete um trace gravado com startTrace contra imagens novas e informa a vazão e a latência p50/p99 de
+// cada operação, ao lado da latência registrada no trace. As chamadas são repetidas na ordem do trace, pelas
+// funções de fs.h; cada imagem do trace vira <prefixo><nome do arquivo> (com --prefix mem: tudo fica em memória).
+//
+//   --timing fast        uma chamada logo após a outra (padrão)
+//   --timing original    cada chamada começa no mesmo instante relativo em que começou na gravação
+//   --init B,N,I         geometria das imagens que o trace usa sem criar com initFs
+//
+// Trace sem conteúdo (startTrace(..., false)): addFile, writeAt e append gravam bytes pseudoaleatórios do tamanho
+// registrado.
+//
+// Compilar: g++ tools/fsReplay.cpp fs.cpp sha256.cpp -o fsReplay.out -O2 -std=c++17 -lcrypto -lpthread
+// Executar: ./fsReplay.out <trace> [--timing fast|original] [--prefix replay-] [--init 4,64,32]
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#include "../fsExt.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef struct
+{
+	vector<double> latencias;          // repetição, em microssegundos
+	double gravada;                    // soma das latências registradas no trace
+} ESTATISTICA;
+
+double percentil(vector<double> valores, double p)
+{
+	if (valores.empty())
+	{
+		return 0;
+	}
+	sort(valores.begin(), valores.end());
+	return valores[min(valores.size() - 1, (size_t)(p * valores.size()))];
+}
+
+// Nome da imagem repetida: prefixo + nome do arquivo, sem os diretórios.
+string imagemRepetida(const string &prefixo, const string &imagem)
+{
+	size_t barra = imagem.find_last_of("/\\");
+	string nome = barra == string::npos ? imagem : imagem.substr(barra + 1);
+	if (nome.compare(0, strlen(FS_MEMORY_PREFIX), FS_MEMORY_PREFIX) == 0)
+	{
+		nome = nome.substr(strlen(FS_MEMORY_PREFIX));
+	}
+	return prefixo + nome;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <trace> [--timing fast|original] [--prefix replay-] [--init B,N,I]\n", argv[0]);
+		return 1;
+	}
+	bool tempoOriginal = false;
+	string prefixo = "replay-";
+	int geometria[3] = {0, 0, 0};
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--timing") == 0)
+		{
+			tempoOriginal = strcmp(argv[i + 1], "original") == 0;
+		}
+		else if (strcmp(argv[i], "--prefix") == 0)
+		{
+			prefixo = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--init") == 0)
+		{
+			sscanf(argv[i + 1], "%d,%d,%d", &geometria[0], &geometria[1], &geometria[2]);
+		}
+	}
+
+	vector<FS_TRACE_RECORD> registros;
+	if (!readTrace(argv[1], registros))
+	{
+		fprintf(stderr, "could not read trace %s\n", argv[1]);
+		return 1;
+	}
+
+	// Imagens usadas antes de um initFs no trace são criadas com a geometria de --init.
+	set<string> criadas;
+	for (int i = 0; i < registros.size(); i++)
+	{
+		const string &imagem = registros[i].image;
+		if (registros[i].op != FS_TRACE_INIT && !criadas.count(imagem))
+		{
+			if (geometria[0] == 0)
+			{
+				fprintf(stderr, "%s is used before initFs in the trace; pass --init B,N,I\n", imagem.c_str());
+				return 1;
+			}
+			initFs(imagemRepetida(prefixo, imagem), geometria[0], geometria[1], geometria[2]);
+		}
+		criadas.insert(imagem);
+	}
+
+	vector<ESTATISTICA> estatisticas(FS_TRACE_NUM_OPS, ESTATISTICA());
+	mt19937 gerador(1);
+	int divergencias = 0;
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+	for (int i = 0; i < registros.size(); i++)
+	{
+		const FS_TRACE_RECORD &r = registros[i];
+		string imagem = imagemRepetida(prefixo, r.image);
+		string conteudo = r.content;
+		bool escrita = r.op == FS_TRACE_ADD_FILE || r.op == FS_TRACE_WRITE_AT || r.op == FS_TRACE_APPEND;
+		if (escrita && !r.hasContent)
+		{
+			conteudo.resize(r.size);
+			for (int j = 0; j < r.size; j++)
+			{
+				conteudo[j] = 'a' + gerador() % 26;
+			}
+		}
+		if (tempoOriginal)
+		{
+			this_thread::sleep_until(inicio + chrono::microseconds(r.timeUs));
+		}
+
+		chrono::steady_clock::time_point antes = chrono::steady_clock::now();
+		switch (r.op)
+		{
+		case FS_TRACE_INIT:
+			initFs(imagem, r.blockSize, r.numBlocks, r.numInodes, r.features);
+			break;
+		case FS_TRACE_ADD_FILE:
+			addFile(imagem, r.path, conteudo);
+			break;
+		case FS_TRACE_ADD_DIR:
+			addDir(imagem, r.path);
+			break;
+		case FS_TRACE_REMOVE:
+			remove(imagem, r.path);
+			break;
+		case FS_TRACE_MOVE:
+			move(imagem, r.path, r.newPath);
+			break;
+		case FS_TRACE_READ_FILE:
+			// O tamanho lido confere se a repetição chegou ao mesmo estado da gravação.
+			divergencias += (int)readFile(imagem, r.path).size() != r.size;
+			break;
+		case FS_TRACE_WRITE_AT:
+			divergencias += writeAt(imagem, r.path, r.offset, conteudo) != r.ok;
+			break;
+		case FS_TRACE_APPEND:
+			divergencias += append(imagem, r.path, conteudo) != r.ok;
+			break;
+		default:
+			break;
+		}
+		chrono::steady_clock::time_point depois = chrono::steady_clock::now();
+		estatisticas[r.op].latencias.push_back(chrono::duration<double, micro>(depois - antes).count());
+		estatisticas[r.op].gravada += r.latencyUs;
+	}
+	double tempoTotal = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+	printf("trace %s: %d calls in %.3f s (%.0f ops/s), timing=%s\n", argv[1], (int)registros.size(), tempoTotal,
+		   tempoTotal > 0 ? registros.size() / tempoTotal : 0.0, tempoOriginal ? "original" : "fast");
+	printf("  %-9s %8s %10s %10s %12s %12s\n", "op", "count", "p50(us)", "p99(us)", "mean(us)", "traced(us)");
+	for (int i = 0; i < FS_TRACE_NUM_OPS; i++)
+	{
+		const ESTATISTICA &e = estatisticas[i];
+		if (e.latencias.empty())
+		{
+			continue;
+		}
+		double soma = 0;
+		for (int j = 0; j < e.latencias.size(); j++)
+		{
+			soma += e.latencias[j];
+		}
+		printf("  %-9s %8d %10.2f %10.2f %12.2f %12.2f\n", FS_TRACE_OP_NAMES[i], (int)e.latencias.size(), percentil(e.latencias, 0.5),
+			   percentil(e.latencias, 0.99), soma / e.latencias.size(), e.gravada / e.latencias.size());
+	}
+	if (divergencias > 0)
+	{
+		printf("  %d readFile/writeAt/append calls returned a different size or result than traced\n", divergencias);
+	}
+	return divergencias > 0 ? 2 : 0;
+}
@@ -0,0 +1,354 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Servidor local que mantém imagens abertas e atende addFile/addDir/remove/move/readFile pelo socket Unix,
+// com o protocolo binário de protocolo.hpp. Os clientes podem enviar vários pedidos sem esperar as respostas.
+// A cada rodada do laço todos os pedidos já recebidos são executados em memória, cada imagem alterada recebe um único
+// flushSession (gravação agrupada) e só então as respostas são enviadas: uma resposta OK de escrita significa que a
+// alteração já está no arquivo. Se o flush de uma imagem falhar, as escritas da rodada nela respondem com falha.
+//
+// Compilar: g++ tools/fsServer.cpp fs.cpp sha256.cpp -o fsServer.out -O2 -std=c++17 -lcrypto -lpthread
+// Executar: ./fsServer.out <socket> <imagem> [<imagem> ...]     (encerra com SIGINT/SIGTERM, gravando as imagens)
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#include "../fsExt.h"
+#include "protocolo.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Pedidos executados por cliente em cada rodada, para um cliente não atrasar os outros.
+const int PEDIDOS_POR_RODADA = 256;
+
+// Enquanto a saída de um cliente passar disto, os pedidos dele não são lidos.
+const size_t SAIDA_MAXIMA = 1024 * 1024;
+
+typedef struct
+{
+	FS_SESSION *session;
+	bool alterada;                     // alguma escrita da rodada deu certo
+	bool flushPedido;                  // OP_FLUSH na rodada
+	bool falhou;                       // o flush da rodada falhou
+} IMAGEM_ABERTA;
+
+// Resposta da rodada. As de escrita só valem depois do flush da imagem.
+typedef struct
+{
+	RESPOSTA resposta;
+	map<string, IMAGEM_ABERTA>::iterator imagem;
+	bool escrita;
+} RESPOSTA_PENDENTE;
+
+typedef struct
+{
+	int descritor;
+	string entrada;
+	vector<RESPOSTA_PENDENTE> respostas; // respostas da rodada, enviadas depois da gravação
+	string saida;
+	bool fimEntrada;                   // o cliente não vai mandar mais nada; fecha depois de responder tudo
+	bool fechar;                       // erro: fecha sem esperar
+} CLIENTE;
+
+volatile sig_atomic_t encerrar = 0;
+
+void pedirEncerramento(int)
+{
+	encerrar = 1;
+}
+
+void semBloqueio(int descritor)
+{
+	fcntl(descritor, F_SETFL, fcntl(descritor, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// Executa um pedido na sessão da imagem e monta a resposta.
+void executar(map<string, IMAGEM_ABERTA> &imagens, const PEDIDO &pedido, RESPOSTA_PENDENTE &pendente)
+{
+	RESPOSTA &resposta = pendente.resposta;
+	resposta.id = pedido.id;
+	resposta.dado.clear();
+	pendente.escrita = false;
+
+	map<string, IMAGEM_ABERTA>::iterator imagem = imagens.find(pedido.campos[0]);
+	if (imagem == imagens.end())
+	{
+		resposta.estado = ESTADO_INVALIDO;
+		return;
+	}
+	pendente.imagem = imagem;
+
+	FS_SESSION *session = imagem->second.session;
+	bool ok = true;
+	switch (pedido.operacao)
+	{
+	case OP_ADD_FILE:
+		ok = addFile(session, pedido.campos[1], pedido.campos[2]);
+		break;
+	case OP_ADD_DIR:
+		ok = addDir(session, pedido.campos[1]);
+		break;
+	case OP_REMOVE:
+		ok = remove(session, pedido.campos[1]);
+		break;
+	case OP_MOVE:
+		ok = move(session, pedido.campos[1], pedido.campos[2]);
+		break;
+	case OP_READ:
+		ok = readFile(session, pedido.campos[1], resposta.dado);
+		break;
+	case OP_FLUSH:
+		imagem->second.flushPedido = true;
+		break;
+	}
+	if (ok && pedido.operacao != OP_READ)
+	{
+		imagem->second.alterada = imagem->second.alterada || pedido.operacao != OP_FLUSH;
+		pendente.escrita = true;
+	}
+	resposta.estado = ok ? ESTADO_OK : ESTADO_FALHA;
+}
+
+// Lê o que estiver disponível no socket do cliente.
+void receber(CLIENTE &cliente)
+{
+	char buffer[16 * 1024];
+	while (true)
+	{
+		ssize_t n = recv(cliente.descritor, buffer, sizeof(buffer), 0);
+		if (n > 0)
+		{
+			cliente.entrada.append(buffer, n);
+			continue;
+		}
+		if (n == 0)
+		{
+			cliente.fimEntrada = true;
+		}
+		else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			cliente.fechar = true;
+		}
+		return;
+	}
+}
+
+// Executa até PEDIDOS_POR_RODADA pedidos completos do buffer de entrada. Retorna true se sobrarem pedidos.
+bool processar(map<string, IMAGEM_ABERTA> &imagens, CLIENTE &cliente, long &numPedidos)
+{
+	string corpo;
+	PEDIDO pedido;
+	RESPOSTA_PENDENTE pendente;
+	for (int i = 0; i < PEDIDOS_POR_RODADA; i++)
+	{
+		int lido = extrairQuadro(cliente.entrada, corpo);
+		if (lido == 0)
+		{
+			return false;
+		}
+		if (lido == -1)
+		{
+			cliente.fechar = true;
+			return false;
+		}
+		if (decodificarPedido(corpo, pedido))
+		{
+			executar(imagens, pedido, pendente);
+		}
+		else
+		{
+			pendente.resposta.id = pedido.id;
+			pendente.resposta.estado = ESTADO_INVALIDO;
+			pendente.resposta.dado.clear();
+			pendente.escrita = false;
+		}
+		cliente.respostas.push_back(pendente);
+		numPedidos++;
+	}
+	return quadroCompleto(cliente.entrada);
+}
+
+// Envia o que o socket aceitar sem bloquear.
+void enviar(CLIENTE &cliente)
+{
+	while (!cliente.saida.empty())
+	{
+		ssize_t n = send(cliente.descritor, cliente.saida.data(), cliente.saida.size(), MSG_NOSIGNAL);
+		if (n > 0)
+		{
+			cliente.saida.erase(0, n);
+			continue;
+		}
+		if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+		{
+			cliente.fechar = true;
+		}
+		return;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <socket> <image> [<image> ...]\n", argv[0]);
+		return 1;
+	}
+
+	map<string, IMAGEM_ABERTA> imagens;
+	for (int i = 2; i < argc; i++)
+	{
+		FILE *teste = fopen(argv[i], "rb");
+		if (teste == NULL)
+		{
+			fprintf(stderr, "could not open %s\n", argv[i]);
+			return 1;
+		}
+		fclose(teste);
+		imagens[argv[i]] = {openSession(argv[i]), false, false, false};
+	}
+
+	sockaddr_un endereco;
+	memset(&endereco, 0, sizeof(endereco));
+	endereco.sun_family = AF_UNIX;
+	if (strlen(argv[1]) >= sizeof(endereco.sun_path))
+	{
+		fprintf(stderr, "socket path too long: %s\n", argv[1]);
+		return 1;
+	}
+	strcpy(endereco.sun_path, argv[1]);
+	unlink(argv[1]);
+
+	int servidor = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (servidor == -1 || bind(servidor, (sockaddr *)&endereco, sizeof(endereco)) == -1 || listen(servidor, 64) == -1)
+	{
+		fprintf(stderr, "could not listen on %s: %s\n", argv[1], strerror(errno));
+		return 1;
+	}
+	semBloqueio(servidor);
+
+	struct sigaction acao;
+	memset(&acao, 0, sizeof(acao));
+	acao.sa_handler = pedirEncerramento;
+	sigaction(SIGINT, &acao, NULL);
+	sigaction(SIGTERM, &acao, NULL);
+
+	printf("listening on %s with %d image(s)\n", argv[1], (int)imagens.size());
+	fflush(stdout);
+
+	vector<CLIENTE> clientes;
+	vector<pollfd> descritores;
+	long numPedidos = 0;
+	long numGravacoes = 0;
+	bool haPendentes = false;
+	while (!encerrar)
+	{
+		// Posição 0: socket do servidor; depois um por cliente, na mesma ordem de clientes.
+		descritores.assign(1, {servidor, POLLIN, 0});
+		for (int i = 0; i < clientes.size(); i++)
+		{
+			short eventos = !clientes[i].fimEntrada && clientes[i].saida.size() < SAIDA_MAXIMA ? POLLIN : 0;
+			if (!clientes[i].saida.empty())
+			{
+				eventos |= POLLOUT;
+			}
+			descritores.push_back({clientes[i].descritor, eventos, 0});
+		}
+
+		// Se sobraram pedidos no buffer de algum cliente, não espera por novos dados.
+		if (poll(descritores.data(), descritores.size(), haPendentes ? 0 : -1) == -1 && errno != EINTR)
+		{
+			fprintf(stderr, "poll: %s\n", strerror(errno));
+			break;
+		}
+		if (encerrar)
+		{
+			break;
+		}
+
+		if (descritores[0].revents & POLLIN)
+		{
+			for (int novo = accept(servidor, NULL, NULL); novo != -1; novo = accept(servidor, NULL, NULL))
+			{
+				semBloqueio(novo);
+				clientes.push_back({novo, "", {}, "", false, false});
+			}
+		}
+
+		// Executa em memória tudo o que chegou nesta rodada.
+		haPendentes = false;
+		for (int i = 0; i + 1 < descritores.size(); i++)
+		{
+			if (descritores[i + 1].revents & (POLLIN | POLLHUP | POLLERR) && !clientes[i].fimEntrada)
+			{
+				receber(clientes[i]);
+			}
+			if (clientes[i].saida.size() < SAIDA_MAXIMA && processar(imagens, clientes[i], numPedidos))
+			{
+				haPendentes = true;
+			}
+		}
+
+		// Gravação agrupada: um flush por imagem alterada, antes de qualquer resposta da rodada sair.
+		for (map<string, IMAGEM_ABERTA>::iterator imagem = imagens.begin(); imagem != imagens.end(); imagem++)
+		{
+			imagem->second.falhou = false;
+			if (imagem->second.alterada || imagem->second.flushPedido)
+			{
+				imagem->second.falhou = !flushSession(imagem->second.session);
+				imagem->second.alterada = false;
+				imagem->second.flushPedido = false;
+				numGravacoes++;
+			}
+		}
+
+		for (int i = 0; i < clientes.size(); i++)
+		{
+			for (int r = 0; r < clientes[i].respostas.size(); r++)
+			{
+				RESPOSTA_PENDENTE &pendente = clientes[i].respostas[r];
+				if (pendente.escrita && pendente.imagem->second.falhou)
+				{
+					pendente.resposta.estado = ESTADO_FALHA;
+				}
+				codificarResposta(clientes[i].saida, pendente.resposta);
+			}
+			clientes[i].respostas.clear();
+			enviar(clientes[i]);
+		}
+		for (int i = clientes.size() - 1; i >= 0; i--)
+		{
+			bool respondido = clientes[i].fimEntrada && !quadroCompleto(clientes[i].entrada) && clientes[i].saida.empty();
+			if (clientes[i].fechar || respondido)
+			{
+				close(clientes[i].descritor);
+				clientes.erase(clientes.begin() + i);
+			}
+		}
+	}
+
+	for (int i = 0; i < clientes.size(); i++)
+	{
+		close(clientes[i].descritor);
+	}
+	close(servidor);
+	unlink(argv[1]);
+	for (map<string, IMAGEM_ABERTA>::iterator imagem = imagens.begin(); imagem != imagens.end(); imagem++)
+	{
+		closeSession(imagem->second.session);
+	}
+	printf("%ld requests, %ld commits\n", numPedidos, numGravacoes);
+	return 0;
+}
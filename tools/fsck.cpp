@@ -0,0 +1,44 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Confere uma imagem: o mapa de bits contra os blocos usados pelos inodes e os contadores dos grupos e os
+// totais de statFs (gravados com FS_FEATURE_COUNTERS) contra uma contagem completa. Mostra a ocupação da imagem.
+//
+// Compilar: g++ tools/fsck.cpp fs.cpp sha256.cpp -o fsck.out -O2 -std=c++17 -lcrypto -lpthread
+// Executar: ./fsck.out <imagem>
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#include "../fsExt.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <image>\n", argv[0]);
+		return 1;
+	}
+	FILE *teste = fopen(argv[1], "rb");
+	if (teste == NULL)
+	{
+		fprintf(stderr, "could not open %s\n", argv[1]);
+		return 1;
+	}
+	fclose(teste);
+
+	vector<string> problemas;
+	bool ok = checkFs(argv[1], problemas);
+	for (int i = 0; i < problemas.size(); i++)
+	{
+		printf("%s\n", problemas[i].c_str());
+	}
+
+	FS_STATFS stats = statFs(argv[1]);
+	printf("%s: %d/%d blocks free, %d/%d inodes free, %d files, %d dirs, %ld bytes%s\n", argv[1], stats.freeBlocks,
+		   stats.numBlocks, stats.freeInodes, stats.numInodes, stats.files, stats.dirs, stats.usedBytes, ok ? "" : " (counters need repair)");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Cria uma imagem a partir de um diretório do sistema de arquivos local.
+// O diretório é varrido uma vez, a geometria é calculada a partir da árvore, o conteúdo dos arquivos é lido por um
+// conjunto de threads e a imagem é montada e gravada em uma única passada (buildFs).
+//
+// Compilar: g++ tools/mkfsFromDir.cpp fs.cpp sha256.cpp -o mkfsFromDir.out -O2 -std=c++17 -lcrypto -lpthread
+// Executar: ./mkfsFromDir.out <diretorio> <imagem> [--block-size N] [--threads N] [--features lz,dedup,counters,extents]
+//                             [--extra-inodes N] [--extra-blocks N]
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#include "../fsExt.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Caminho no sistema local de cada entrada (mesma posição da lista de FS_IMPORT_ENTRY).
+typedef struct
+{
+	vector<FS_IMPORT_ENTRY> entradas;
+	vector<fs::path> origens;
+	vector<int> filhosPorDiretorio;
+	int filhosRaiz;
+} ARVORE;
+
+// Varre um diretório em pré-ordem (pais antes dos filhos), com os nomes em ordem alfabética. Sem compressão, um
+// arquivo cabe em no máximo 9 blocos (os ponteiros do inode).
+bool varrer(const fs::path &diretorio, const string &destino, int blockSize, bool comprimido, ARVORE &arvore, int &numFilhos)
+{
+	vector<fs::directory_entry> itens;
+	for (const fs::directory_entry &item : fs::directory_iterator(diretorio))
+	{
+		if (item.is_directory() || item.is_regular_file())
+		{
+			itens.push_back(item);
+		}
+	}
+	sort(itens.begin(), itens.end(), [](const fs::directory_entry &a, const fs::directory_entry &b)
+		 { return a.path().filename() < b.path().filename(); });
+	numFilhos = itens.size();
+
+	for (int i = 0; i < itens.size(); i++)
+	{
+		string nome = itens[i].path().filename().string();
+		if (nome.size() > 10)
+		{
+			fprintf(stderr, "name longer than 10 bytes: %s\n", itens[i].path().c_str());
+			return false;
+		}
+
+		FS_IMPORT_ENTRY entrada;
+		entrada.path = destino == "/" ? "/" + nome : destino + "/" + nome;
+		entrada.isDir = itens[i].is_directory();
+		if (!entrada.isDir && itens[i].file_size() > 255)
+		{
+			fprintf(stderr, "file larger than 255 bytes: %s\n", itens[i].path().c_str());
+			return false;
+		}
+		if (!entrada.isDir && !comprimido && itens[i].file_size() > 9 * (uintmax_t)blockSize)
+		{
+			fprintf(stderr, "file needs more than 9 blocks of %d bytes: %s\n", blockSize, itens[i].path().c_str());
+			return false;
+		}
+
+		int posicao = arvore.entradas.size();
+		arvore.entradas.push_back(entrada);
+		arvore.origens.push_back(itens[i].path());
+		arvore.filhosPorDiretorio.push_back(0);
+		if (entrada.isDir && !varrer(itens[i].path(), entrada.path, blockSize, comprimido, arvore, arvore.filhosPorDiretorio[posicao]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Lê o conteúdo de todos os arquivos com numThreads threads; cada thread pega o próximo arquivo da lista.
+bool lerConteudos(ARVORE &arvore, int numThreads)
+{
+	atomic<int> proximo(0);
+	atomic<bool> ok(true);
+	vector<thread> threads;
+	for (int t = 0; t < numThreads; t++)
+	{
+		threads.push_back(thread([&]()
+								 {
+			for (int i = proximo++; i < (int)arvore.entradas.size(); i = proximo++)
+			{
+				if (arvore.entradas[i].isDir)
+				{
+					continue;
+				}
+				ifstream arquivo(arvore.origens[i], ios::binary);
+				if (!arquivo)
+				{
+					ok = false;
+					continue;
+				}
+				arvore.entradas[i].content.assign(istreambuf_iterator<char>(arquivo), istreambuf_iterator<char>());
+			} }));
+	}
+	for (int t = 0; t < threads.size(); t++)
+	{
+		threads[t].join();
+	}
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <dir> <image> [--block-size N] [--threads N] [--features lz,dedup,counters,extents] [--extra-inodes N] [--extra-blocks N]\n", argv[0]);
+		return 1;
+	}
+
+	int blockSize = 16;
+	int numThreads = thread::hardware_concurrency() > 0 ? thread::hardware_concurrency() : 4;
+	int features = 0;
+	int inodesExtras = 0;
+	int blocosExtras = 0;
+	for (int i = 3; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--block-size") == 0)
+		{
+			blockSize = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--threads") == 0)
+		{
+			numThreads = max(1, atoi(argv[i + 1]));
+		}
+		else if (strcmp(argv[i], "--features") == 0)
+		{
+			features |= strstr(argv[i + 1], "lz") ? FS_FEATURE_COMPRESSION : 0;
+			features |= strstr(argv[i + 1], "dedup") ? FS_FEATURE_DEDUP : 0;
+			features |= strstr(argv[i + 1], "counters") ? FS_FEATURE_COUNTERS : 0;
+			features |= strstr(argv[i + 1], "extents") ? FS_FEATURE_EXTENTS : 0;
+		}
+		else if (strcmp(argv[i], "--extra-inodes") == 0)
+		{
+			inodesExtras = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--extra-blocks") == 0)
+		{
+			blocosExtras = atoi(argv[i + 1]);
+		}
+	}
+	if (blockSize < 1 || blockSize > 255)
+	{
+		fprintf(stderr, "block size must be between 1 and 255: %d\n", blockSize);
+		return 1;
+	}
+
+	chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+
+	ARVORE arvore;
+	if (!fs::is_directory(argv[1]) || !varrer(argv[1], "/", blockSize, features & FS_FEATURE_COMPRESSION, arvore, arvore.filhosRaiz))
+	{
+		fprintf(stderr, "could not scan %s\n", argv[1]);
+		return 1;
+	}
+
+	// Geometria: um inode por entrada mais a raiz; blocos dos diretórios (entradas) e dos arquivos (tamanho).
+	int numInodes = arvore.entradas.size() + 1 + inodesExtras;
+	int numBlocks = max(1, (arvore.filhosRaiz + blockSize - 1) / blockSize) + blocosExtras;
+	long bytes = 0;
+	for (int i = 0; i < arvore.entradas.size(); i++)
+	{
+		if (arvore.entradas[i].isDir)
+		{
+			numBlocks += max(1, (arvore.filhosPorDiretorio[i] + blockSize - 1) / blockSize);
+		}
+		else
+		{
+			long tamanho = fs::file_size(arvore.origens[i]);
+			numBlocks += (tamanho + blockSize - 1) / blockSize;
+			bytes += tamanho;
+		}
+	}
+	if (numInodes > 255 || numBlocks > 255)
+	{
+		fprintf(stderr, "tree does not fit the format: %d inodes, %d blocks (max 255 each)\n", numInodes, numBlocks);
+		return 1;
+	}
+
+	chrono::steady_clock::time_point varrido = chrono::steady_clock::now();
+	if (!lerConteudos(arvore, numThreads))
+	{
+		fprintf(stderr, "could not read some files\n");
+		return 1;
+	}
+	chrono::steady_clock::time_point lido = chrono::steady_clock::now();
+
+	if (!buildFs(argv[2], blockSize, numBlocks, numInodes, features, arvore.entradas))
+	{
+		fprintf(stderr, "could not build %s\n", argv[2]);
+		return 1;
+	}
+	chrono::steady_clock::time_point fim = chrono::steady_clock::now();
+
+	printf("%s: %d entries, %ld bytes, geometry %d/%d/%d\n", argv[2], (int)arvore.entradas.size(), bytes, blockSize, numBlocks, numInodes);
+	printf("scan %.3f ms, read (%d threads) %.3f ms, build %.3f ms\n",
+		   chrono::duration<double, milli>(varrido - inicio).count(), numThreads,
+		   chrono::duration<double, milli>(lido - varrido).count(),
+		   chrono::duration<double, milli>(fim - lido).count());
+	return 0;
+}
@@ -0,0 +1,218 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Protocolo binário entre fsServer e seus clientes (socket Unix).
+//
+// Pedido:   tamanho (u32) | operação (u8) | id (u32) | campos
+// Resposta: tamanho (u32) | id (u32) | estado (u8) | dado
+// O tamanho não conta os 4 bytes dele mesmo. Inteiros em little-endian; cada campo ou dado é tamanho (u16) + bytes.
+// Campos por operação: imagem, depois
+//   OP_ADD_FILE: caminho, conteúdo   OP_ADD_DIR, OP_REMOVE, OP_READ: caminho   OP_MOVE: caminho antigo, caminho novo
+//   OP_FLUSH: nenhum
+// O cliente pode enviar vários pedidos sem esperar as respostas; elas voltam na ordem dos pedidos.
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#ifndef protocolo_hpp
+#define protocolo_hpp
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum OPERACAO_PROTOCOLO
+{
+	OP_ADD_FILE = 1,
+	OP_ADD_DIR,
+	OP_REMOVE,
+	OP_MOVE,
+	OP_READ,
+	OP_FLUSH
+};
+
+enum ESTADO_RESPOSTA
+{
+	ESTADO_OK = 0,
+	ESTADO_FALHA,        // a operação não pôde ser feita (caminho inexistente, sem espaço...)
+	ESTADO_INVALIDO      // pedido mal formado ou imagem desconhecida
+};
+
+// Maior pedido aceito; acima disso a conexão é encerrada.
+const size_t TAMANHO_MAXIMO_PEDIDO = 64 * 1024;
+
+typedef struct
+{
+	unsigned char operacao;
+	unsigned int id;
+	vector<string> campos;
+} PEDIDO;
+
+typedef struct
+{
+	unsigned int id;
+	unsigned char estado;
+	string dado;
+} RESPOSTA;
+
+// Quantidade de campos de cada operação (incluindo a imagem); 0 para operação desconhecida.
+inline int camposDaOperacao(unsigned char operacao)
+{
+	switch (operacao)
+	{
+	case OP_ADD_FILE:
+	case OP_MOVE:
+		return 3;
+	case OP_ADD_DIR:
+	case OP_REMOVE:
+	case OP_READ:
+		return 2;
+	case OP_FLUSH:
+		return 1;
+	}
+	return 0;
+}
+
+inline void gravarU16(string &saida, unsigned int valor)
+{
+	saida += (char)(valor & 0xFF);
+	saida += (char)((valor >> 8) & 0xFF);
+}
+
+inline void gravarU32(string &saida, unsigned int valor)
+{
+	gravarU16(saida, valor & 0xFFFF);
+	gravarU16(saida, valor >> 16);
+}
+
+inline unsigned int lerU16(const unsigned char *dados)
+{
+	return dados[0] | (dados[1] << 8);
+}
+
+inline unsigned int lerU32(const unsigned char *dados)
+{
+	return lerU16(dados) | (lerU16(dados + 2) << 16);
+}
+
+// Acrescenta um campo (u16 + bytes). Campos maiores que 65535 bytes são truncados.
+inline void gravarCampo(string &saida, const string &campo)
+{
+	size_t tamanho = campo.size() > 0xFFFF ? 0xFFFF : campo.size();
+	gravarU16(saida, tamanho);
+	saida.append(campo, 0, tamanho);
+}
+
+// Lê um campo a partir de posicao; false se passar do fim.
+inline bool lerCampo(const unsigned char *dados, size_t tamanho, size_t &posicao, string &campo)
+{
+	if (posicao + 2 > tamanho)
+	{
+		return false;
+	}
+	size_t n = lerU16(dados + posicao);
+	if (posicao + 2 + n > tamanho)
+	{
+		return false;
+	}
+	campo.assign((const char *)dados + posicao + 2, n);
+	posicao += 2 + n;
+	return true;
+}
+
+inline void codificarPedido(string &saida, const PEDIDO &pedido)
+{
+	string corpo;
+	corpo += (char)pedido.operacao;
+	gravarU32(corpo, pedido.id);
+	for (int i = 0; i < pedido.campos.size(); i++)
+	{
+		gravarCampo(corpo, pedido.campos[i]);
+	}
+	gravarU32(saida, corpo.size());
+	saida += corpo;
+}
+
+inline void codificarResposta(string &saida, const RESPOSTA &resposta)
+{
+	gravarU32(saida, 4 + 1 + 2 + resposta.dado.size());
+	gravarU32(saida, resposta.id);
+	saida += (char)resposta.estado;
+	gravarCampo(saida, resposta.dado);
+}
+
+/**
+ * @brief Tira o próximo quadro completo (tamanho + corpo) do início de um buffer.
+ * @param buffer bytes recebidos; o quadro lido é removido.
+ * @param corpo corpo do quadro, sem o tamanho.
+ * @return 1 se leu um quadro, 0 se ainda faltam bytes, -1 se o quadro passar de TAMANHO_MAXIMO_PEDIDO.
+ */
+inline int extrairQuadro(string &buffer, string &corpo)
+{
+	if (buffer.size() < 4)
+	{
+		return 0;
+	}
+	size_t tamanho = lerU32((const unsigned char *)buffer.data());
+	if (tamanho > TAMANHO_MAXIMO_PEDIDO)
+	{
+		return -1;
+	}
+	if (buffer.size() < 4 + tamanho)
+	{
+		return 0;
+	}
+	corpo.assign(buffer, 4, tamanho);
+	buffer.erase(0, 4 + tamanho);
+	return 1;
+}
+
+// true se o buffer já tiver um quadro inteiro (ou um tamanho inválido, que extrairQuadro rejeita).
+inline bool quadroCompleto(const string &buffer)
+{
+	if (buffer.size() < 4)
+	{
+		return false;
+	}
+	size_t tamanho = lerU32((const unsigned char *)buffer.data());
+	return tamanho > TAMANHO_MAXIMO_PEDIDO || buffer.size() >= 4 + tamanho;
+}
+
+// Interpreta o corpo de um pedido. Se só o id puder ser lido, devolve false com pedido.id preenchido.
+inline bool decodificarPedido(const string &corpo, PEDIDO &pedido)
+{
+	const unsigned char *dados = (const unsigned char *)corpo.data();
+	pedido.id = 0;
+	pedido.campos.clear();
+	if (corpo.size() < 5)
+	{
+		return false;
+	}
+	pedido.operacao = dados[0];
+	pedido.id = lerU32(dados + 1);
+
+	int numCampos = camposDaOperacao(pedido.operacao);
+	size_t posicao = 5;
+	pedido.campos.resize(numCampos);
+	for (int i = 0; i < numCampos; i++)
+	{
+		if (!lerCampo(dados, corpo.size(), posicao, pedido.campos[i]))
+		{
+			return false;
+		}
+	}
+	return numCampos > 0 && posicao == corpo.size();
+}
+
+inline bool decodificarResposta(const string &corpo, RESPOSTA &resposta)
+{
+	const unsigned char *dados = (const unsigned char *)corpo.data();
+	if (corpo.size() < 5)
+	{
+		return false;
+	}
+	resposta.id = lerU32(dados);
+	resposta.estado = dados[4];
+	size_t posicao = 5;
+	return lerCampo(dados, corpo.size(), posicao, resposta.dado) && posicao == corpo.size();
+}
+
+#endif /* protocolo_hpp */
@@ -0,0 +1,786 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Teste de estresse do simulador. Gera sequências aleatórias (reprodutíveis pela semente) de
+// addFile/addDir/remove/move/append/readFile, confere cada passo contra um modelo da árvore em memória e
+// informa a vazão (ops/s) e a latência p50/p99 de cada tipo de operação em várias geometrias.
+//
+// Compilar: g++ tools/stress.cpp fs.cpp sha256.cpp -o stress.out -O2 -std=c++17 -lcrypto -lpthread
+// Executar: ./stress.out [--seed N] [--ops N] [--mode plain|lz|dedup|delayed|groups|counters|extents] [--reopen N]
+//                        [--policy first|next|best|goal] [--durability none|ordered|full] [--sync-ops N] [--sync-ms N]
+//                        [--device stdio|pread|mmap|uring|threads|mem]
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#include "../caminho.hpp"
+#include "../fsExt.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef struct
+{
+	int blockSize;
+	int numBlocks;
+	int numInodes;
+} GEOMETRIA;
+
+// Geometrias testadas (o formato guarda cada campo em 1 byte).
+const GEOMETRIA GEOMETRIAS[] = {
+	{4, 64, 32},
+	{8, 128, 64},
+	{16, 255, 128},
+	{32, 255, 255},
+};
+
+enum OPERACAO
+{
+	OP_ADD_FILE,
+	OP_ADD_DIR,
+	OP_REMOVE,
+	OP_MOVE,
+	OP_APPEND,
+	OP_READ,
+	NUM_OPERACOES
+};
+
+const char *NOMES_OPERACOES[NUM_OPERACOES] = {"addFile", "addDir", "remove", "move", "append", "readFile"};
+
+// Resultado esperado de uma operação no modelo.
+enum ESPERADO
+{
+	SUCESSO,
+	FALHA,
+	FALHA_ESPACO
+};
+
+// Nó do modelo: diretório (com os nomes dos filhos na ordem das entradas) ou arquivo (com o conteúdo).
+typedef struct
+{
+	bool dir;
+	string conteudo;
+	vector<string> filhos;
+} NO;
+
+string caminhoPai(const string &path)
+{
+	size_t barra = path.find_last_of('/');
+	return barra == 0 ? "/" : path.substr(0, barra);
+}
+
+string nomeDe(const string &path)
+{
+	return path.substr(path.find_last_of('/') + 1);
+}
+
+string juntar(const string &pai, const string &nome)
+{
+	return pai == "/" ? "/" + nome : pai + "/" + nome;
+}
+
+// Modelo de referência da árvore, com a mesma contagem de inodes e blocos que o simulador usa.
+class Modelo
+{
+public:
+	map<string, NO> nos;
+	GEOMETRIA geometria;
+	int inodesUsados;
+	int blocosUsados;
+	bool folhaExtents;                 // modo extents: um arquivo com 4 ou mais blocos pode ocupar uma folha a mais
+
+	Modelo(GEOMETRIA g) : geometria(g), inodesUsados(1), blocosUsados(1), folhaExtents(false)
+	{
+		nos["/"].dir = true;
+	}
+
+	bool existe(const string &path) const
+	{
+		return nos.count(path) > 0;
+	}
+
+	int blocosArquivo(int tamanho) const
+	{
+		return (tamanho + geometria.blockSize - 1) / geometria.blockSize;
+	}
+
+	int blocosDiretorio(int entradas) const
+	{
+		return max(1, blocosArquivo(entradas));
+	}
+
+	// Blocos alocados para um conteúdo: os pedaços só de zeros viram buracos e não ocupam bloco.
+	int blocosConteudo(const string &conteudo) const
+	{
+		int blocos = 0;
+		for (size_t inicio = 0; inicio < conteudo.size(); inicio += geometria.blockSize)
+		{
+			string pedaco = conteudo.substr(inicio, geometria.blockSize);
+			blocos += pedaco.find_first_not_of('\0') != string::npos;
+		}
+		// A folha só é usada com mais de 3 extensões, e 4 extensões (3 bytes cada) precisam caber em um bloco.
+		return blocos + (folhaExtents && blocos > 3 && geometria.blockSize >= 12);
+	}
+
+	// Confere se o pai aceita mais uma entrada; blocoExtra indica se será preciso um novo bloco de diretório.
+	ESPERADO podeVincular(const string &pai, int &blocoExtra) const
+	{
+		int entradas = nos.at(pai).filhos.size();
+		if (entradas / geometria.blockSize >= 9 || entradas >= MAX_ENTRADAS_DIRETORIO)
+		{
+			return FALHA;
+		}
+		blocoExtra = (entradas >= geometria.blockSize && entradas % geometria.blockSize == 0) ? 1 : 0;
+		return SUCESSO;
+	}
+
+	ESPERADO adicionar(const string &path, bool dir, const string &conteudo, bool aplicar)
+	{
+		string pai = caminhoPai(path);
+		if (!existe(pai) || !nos[pai].dir || existe(path) || conteudo.size() > 255)
+		{
+			return FALHA;
+		}
+		int blocos = dir ? 1 : blocosConteudo(conteudo);
+		if (inodesUsados == geometria.numInodes || (!dir && blocosArquivo(conteudo.size()) > 9))
+		{
+			return FALHA;
+		}
+		int blocoExtra = 0;
+		if (podeVincular(pai, blocoExtra) == FALHA)
+		{
+			return FALHA;
+		}
+		if (geometria.numBlocks - blocosUsados < blocoExtra + blocos)
+		{
+			return FALHA_ESPACO;
+		}
+		if (aplicar)
+		{
+			nos[pai].filhos.push_back(nomeDe(path));
+			nos[path].dir = dir;
+			nos[path].conteudo = conteudo;
+			inodesUsados++;
+			blocosUsados += blocoExtra + blocos;
+		}
+		return SUCESSO;
+	}
+
+	// Acrescenta dados ao fim de um arquivo. Só os blocos depois do fim antigo são alocados; nos modos conservadores
+	// um arquivo comprimido é regravado inteiro e, com dedup, o último bloco é copiado antes de o antigo ser solto,
+	// então nesses modos só se espera sucesso se o conteúdo novo inteiro couber nos blocos livres.
+	ESPERADO acrescentar(const string &path, const string &dados, bool conservador, bool aplicar)
+	{
+		if (!existe(path) || nos[path].dir || nos[path].conteudo.size() + dados.size() > 255)
+		{
+			return FALHA;
+		}
+		string novo = nos[path].conteudo + dados;
+		if (blocosArquivo(novo.size()) > 9)
+		{
+			return FALHA;
+		}
+		int antes = blocosConteudo(nos[path].conteudo);
+		int depois = blocosConteudo(novo);
+		if (geometria.numBlocks - blocosUsados < (conservador ? depois : depois - antes))
+		{
+			return FALHA_ESPACO;
+		}
+		if (aplicar)
+		{
+			nos[path].conteudo = novo;
+			blocosUsados += depois - antes;
+		}
+		return SUCESSO;
+	}
+
+	// Retira um nome da lista do pai, liberando o último bloco do pai se ele passar a caber em menos blocos.
+	void desvincular(const string &path)
+	{
+		NO &pai = nos[caminhoPai(path)];
+		int antes = blocosDiretorio(pai.filhos.size());
+		pai.filhos.erase(find(pai.filhos.begin(), pai.filhos.end(), nomeDe(path)));
+		blocosUsados -= antes - blocosDiretorio(pai.filhos.size());
+	}
+
+	void apagarSubarvore(const string &path)
+	{
+		NO &no = nos[path];
+		for (int i = 0; i < no.filhos.size(); i++)
+		{
+			apagarSubarvore(juntar(path, no.filhos[i]));
+		}
+		blocosUsados -= no.dir ? blocosDiretorio(no.filhos.size()) : blocosConteudo(no.conteudo);
+		inodesUsados--;
+		nos.erase(path);
+	}
+
+	ESPERADO remover(const string &path)
+	{
+		if (path == "/" || !existe(path))
+		{
+			return FALHA;
+		}
+		desvincular(path);
+		apagarSubarvore(path);
+		return SUCESSO;
+	}
+
+	ESPERADO mover(const string &oldPath, const string &newPath, bool aplicar)
+	{
+		if (oldPath == "/" || !existe(oldPath) || newPath.compare(0, oldPath.size() + 1, oldPath + "/") == 0)
+		{
+			return FALHA;
+		}
+		string paiNovo = caminhoPai(newPath);
+		if (!existe(paiNovo) || !nos[paiNovo].dir || (existe(newPath) && newPath != oldPath))
+		{
+			return FALHA;
+		}
+		bool mesmoPai = paiNovo == caminhoPai(oldPath);
+		int blocoExtra = 0;
+		if (!mesmoPai)
+		{
+			if (podeVincular(paiNovo, blocoExtra) == FALHA)
+			{
+				return FALHA;
+			}
+			if (geometria.numBlocks - blocosUsados < blocoExtra)
+			{
+				return FALHA_ESPACO;
+			}
+		}
+		if (!aplicar || newPath == oldPath)
+		{
+			return SUCESSO;
+		}
+
+		if (mesmoPai)
+		{
+			vector<string> &filhos = nos[paiNovo].filhos;
+			*find(filhos.begin(), filhos.end(), nomeDe(oldPath)) = nomeDe(newPath);
+		}
+		else
+		{
+			nos[paiNovo].filhos.push_back(nomeDe(newPath));
+			blocosUsados += blocoExtra;
+			desvincular(oldPath);
+		}
+
+		// Renomeia as chaves da subárvore.
+		vector<pair<string, NO>> movidos;
+		for (map<string, NO>::iterator it = nos.begin(); it != nos.end();)
+		{
+			if (it->first == oldPath || it->first.compare(0, oldPath.size() + 1, oldPath + "/") == 0)
+			{
+				movidos.push_back(make_pair(newPath + it->first.substr(oldPath.size()), it->second));
+				it = nos.erase(it);
+			}
+			else
+			{
+				it++;
+			}
+		}
+		for (int i = 0; i < movidos.size(); i++)
+		{
+			nos[movidos[i].first] = movidos[i].second;
+		}
+		return SUCESSO;
+	}
+};
+
+// Gerador de operações: escolhe caminhos existentes na maior parte das vezes e caminhos inválidos às vezes.
+class Gerador
+{
+public:
+	mt19937_64 aleatorio;
+
+	Gerador(unsigned long long semente) : aleatorio(semente) {}
+
+	int entre(int minimo, int maximo)
+	{
+		return uniform_int_distribution<int>(minimo, maximo)(aleatorio);
+	}
+
+	string nome()
+	{
+		// Alfabeto pequeno para provocar nomes repetidos.
+		string nome = "";
+		int tamanho = entre(1, 3);
+		for (int i = 0; i < tamanho; i++)
+		{
+			nome += (char)('a' + entre(0, 5));
+		}
+		if (entre(0, 1))
+		{
+			nome += ".txt";
+		}
+		return nome;
+	}
+
+	string conteudo(int maximo)
+	{
+		int tamanho = entre(0, maximo);
+		string conteudo = "";
+		switch (entre(0, 3))
+		{
+		case 0:
+			// Texto repetitivo (comprime bem e gera blocos iguais).
+			while (conteudo.size() < tamanho)
+			{
+				conteudo += "log " + to_string(entre(0, 3)) + "\n";
+			}
+			conteudo.resize(tamanho);
+			break;
+		case 1:
+			for (int i = 0; i < tamanho; i++)
+			{
+				conteudo += (char)entre(0, 255);
+			}
+			break;
+		case 2:
+			conteudo.assign(tamanho, 'x');
+			break;
+		default:
+			// Arquivo pré-alocado: zeros com alguns bytes escritos (os blocos de zeros viram buracos).
+			conteudo.assign(tamanho, '\0');
+			for (int i = 0; i < tamanho / 16; i++)
+			{
+				conteudo[entre(0, tamanho - 1)] = (char)entre(1, 255);
+			}
+			break;
+		}
+		return conteudo;
+	}
+
+	string caminhoExistente(const Modelo &modelo, bool apenasDiretorios)
+	{
+		vector<string> candidatos;
+		for (map<string, NO>::const_iterator it = modelo.nos.begin(); it != modelo.nos.end(); it++)
+		{
+			if (!apenasDiretorios || it->second.dir)
+			{
+				candidatos.push_back(it->first);
+			}
+		}
+		return candidatos[entre(0, candidatos.size() - 1)];
+	}
+
+	string caminhoQualquer(const Modelo &modelo)
+	{
+		if (entre(0, 9) == 0)
+		{
+			return juntar(juntar("/", nome()), nome());
+		}
+		return caminhoExistente(modelo, false);
+	}
+
+	string caminhoNovo(const Modelo &modelo)
+	{
+		return juntar(caminhoExistente(modelo, entre(0, 9) != 0), nome());
+	}
+};
+
+typedef struct
+{
+	vector<double> latencias;
+	int sucessos;
+} ESTATISTICA;
+
+typedef struct
+{
+	unsigned long long semente;
+	int numOperacoes;
+	int reabrirACada;
+	string modo;
+	FS_ALLOC_POLICY politica;
+	FS_DURABILITY durabilidade;
+	int sincronizarACada;
+	int intervaloMs;
+	int dispositivo;                   // FS_DEVICE, ou NUM_DISPOSITIVOS - 1 para imagens em memória
+} CONFIGURACAO;
+
+const char *NOMES_POLITICAS[] = {"first", "next", "best", "goal"};
+const char *NOMES_DURABILIDADES[] = {"none", "ordered", "full"};
+const int NUM_DISPOSITIVOS = 6;
+const char *NOMES_DISPOSITIVOS[NUM_DISPOSITIVOS] = {"stdio", "pread", "mmap", "uring", "threads", "mem"};
+
+double percentil(vector<double> valores, double p)
+{
+	if (valores.empty())
+	{
+		return 0;
+	}
+	sort(valores.begin(), valores.end());
+	return valores[min(valores.size() - 1, (size_t)(p * valores.size()))];
+}
+
+void falhar(const CONFIGURACAO &config, const GEOMETRIA &g, int passo, const string &mensagem)
+{
+	printf("MISMATCH seed=%llu geometry=%d/%d/%d step=%d: %s\n", config.semente, g.blockSize, g.numBlocks, g.numInodes, passo, mensagem.c_str());
+	exit(1);
+}
+
+// Confere todos os nós do modelo contra a imagem: conteúdo dos arquivos e entradas (na ordem) dos diretórios.
+void conferirTudo(FS_SESSION *session, const Modelo &modelo, const CONFIGURACAO &config, int passo)
+{
+	for (map<string, NO>::const_iterator it = modelo.nos.begin(); it != modelo.nos.end(); it++)
+	{
+		if (!it->second.dir)
+		{
+			string conteudo;
+			if (!readFile(session, it->first, conteudo) || conteudo != it->second.conteudo)
+			{
+				falhar(config, modelo.geometria, passo, "content of " + it->first);
+			}
+			continue;
+		}
+
+		FS_DIR dir;
+		FS_DIRENT entry;
+		if (!openDir(session, it->first, dir))
+		{
+			falhar(config, modelo.geometria, passo, "openDir " + it->first);
+		}
+		for (int i = 0; i < it->second.filhos.size(); i++)
+		{
+			if (!readDir(dir, entry) || it->second.filhos[i].compare(0, string::npos, entry.name, entry.nameLength) != 0 ||
+				entry.isDir != modelo.nos.at(juntar(it->first, it->second.filhos[i])).dir)
+			{
+				falhar(config, modelo.geometria, passo, "entries of " + it->first);
+			}
+		}
+		if (readDir(dir, entry))
+		{
+			falhar(config, modelo.geometria, passo, "extra entry in " + it->first);
+		}
+	}
+}
+
+FS_SESSION *abrir(const string &imagem, const CONFIGURACAO &config)
+{
+	FS_OPTIONS options = FS_OPTIONS();
+	options.delayedAllocation = config.modo == "delayed";
+	options.allocationPolicy = config.politica;
+	options.durability = config.durabilidade;
+	options.syncEveryOps = config.sincronizarACada;
+	options.syncIntervalMs = config.intervaloMs;
+	options.device = config.dispositivo < NUM_DISPOSITIVOS - 1 ? (FS_DEVICE)config.dispositivo : FS_DEVICE_STDIO;
+	return openSession(imagem, options);
+}
+
+void executarGeometria(const GEOMETRIA &g, const CONFIGURACAO &config)
+{
+	string imagem = "stress-" + to_string(g.blockSize) + "-" + to_string(g.numBlocks) + "-" + to_string(g.numInodes) + ".bin";
+	if (config.dispositivo == NUM_DISPOSITIVOS - 1)
+	{
+		imagem = FS_MEMORY_PREFIX + imagem;
+	}
+	int features = 0;
+	if (config.modo == "lz")
+	{
+		features = FS_FEATURE_COMPRESSION;
+	}
+	else if (config.modo == "dedup")
+	{
+		features = FS_FEATURE_DEDUP;
+	}
+	else if (config.modo == "groups")
+	{
+		features = FS_FEATURE_GROUPS;
+	}
+	else if (config.modo == "counters")
+	{
+		features = FS_FEATURE_COUNTERS;
+	}
+	else if (config.modo == "extents")
+	{
+		features = FS_FEATURE_EXTENTS;
+	}
+	initFs(imagem, g.blockSize, g.numBlocks, g.numInodes, features);
+
+	// Fora dos modos plain, groups, counters e delayed (em que os blocos ficam reservados já no addFile) o simulador pode
+	// usar menos blocos que o modelo; então operações que o modelo recusaria por falta de espaço não são geradas.
+	bool conservador = config.modo != "plain" && config.modo != "groups" && config.modo != "counters" && config.modo != "delayed";
+
+	Modelo modelo(g);
+	modelo.folhaExtents = config.modo == "extents";
+	Gerador gerador(config.semente ^ (g.blockSize * 1000003ULL + g.numBlocks * 1009ULL + g.numInodes));
+	vector<ESTATISTICA> estatisticas(NUM_OPERACOES);
+	for (int i = 0; i < NUM_OPERACOES; i++)
+	{
+		estatisticas[i].sucessos = 0;
+	}
+
+	FS_SESSION *session = abrir(imagem, config);
+	for (int passo = 0; passo < config.numOperacoes; passo++)
+	{
+		int sorteio = gerador.entre(0, 99);
+		OPERACAO op = sorteio < 35 ? OP_ADD_FILE : sorteio < 50 ? OP_ADD_DIR : sorteio < 65 ? OP_REMOVE : sorteio < 78 ? OP_MOVE :
+						 sorteio < 88 ? OP_APPEND : OP_READ;
+
+		string path = "", destino = "", conteudo = "";
+		ESPERADO esperado = FALHA;
+		switch (op)
+		{
+		case OP_ADD_FILE:
+			path = gerador.caminhoNovo(modelo);
+			conteudo = gerador.conteudo(min(260, 9 * g.blockSize));
+			esperado = modelo.adicionar(path, false, conteudo, false);
+			break;
+		case OP_ADD_DIR:
+			path = gerador.caminhoNovo(modelo);
+			esperado = modelo.adicionar(path, true, "", false);
+			break;
+		case OP_REMOVE:
+			path = gerador.caminhoQualquer(modelo);
+			esperado = modelo.existe(path) && path != "/" ? SUCESSO : FALHA;
+			break;
+		case OP_MOVE:
+			path = gerador.caminhoQualquer(modelo);
+			destino = gerador.caminhoNovo(modelo);
+			esperado = modelo.mover(path, destino, false);
+			break;
+		case OP_APPEND:
+			// Até o limite de 9 blocos, como em addFile; passar dele só é possível pelos 255 bytes de SIZE.
+			path = gerador.caminhoQualquer(modelo);
+			conteudo = gerador.conteudo(max(0, min(260, 9 * g.blockSize) - (modelo.existe(path) ? (int)modelo.nos[path].conteudo.size() : 0)));
+			esperado = modelo.acrescentar(path, conteudo, conservador, false);
+			break;
+		default:
+			path = gerador.caminhoQualquer(modelo);
+			esperado = modelo.existe(path) && !modelo.nos[path].dir ? SUCESSO : FALHA;
+			break;
+		}
+		if (conservador && esperado == FALHA_ESPACO)
+		{
+			continue;
+		}
+
+		string lido;
+		bool resultado = false;
+		chrono::steady_clock::time_point inicio = chrono::steady_clock::now();
+		switch (op)
+		{
+		case OP_ADD_FILE:
+			resultado = addFile(session, path, conteudo);
+			break;
+		case OP_ADD_DIR:
+			resultado = addDir(session, path);
+			break;
+		case OP_REMOVE:
+			resultado = remove(session, path);
+			break;
+		case OP_MOVE:
+			resultado = move(session, path, destino);
+			break;
+		case OP_APPEND:
+			resultado = append(session, path, conteudo);
+			break;
+		default:
+			resultado = readFile(session, path, lido);
+			break;
+		}
+		double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - inicio).count();
+		estatisticas[op].latencias.push_back(micros);
+		estatisticas[op].sucessos += resultado;
+
+		if (resultado != (esperado == SUCESSO))
+		{
+			falhar(config, g, passo, string(NOMES_OPERACOES[op]) + " " + path + " " + destino + (resultado ? " succeeded" : " failed"));
+		}
+		if (resultado)
+		{
+			switch (op)
+			{
+			case OP_ADD_FILE:
+				modelo.adicionar(path, false, conteudo, true);
+				break;
+			case OP_ADD_DIR:
+				modelo.adicionar(path, true, "", true);
+				break;
+			case OP_REMOVE:
+				modelo.remover(path);
+				break;
+			case OP_MOVE:
+				modelo.mover(path, destino, true);
+				break;
+			case OP_APPEND:
+				modelo.acrescentar(path, conteudo, conservador, true);
+				break;
+			default:
+				if (lido != modelo.nos[path].conteudo)
+				{
+					falhar(config, g, passo, "readFile " + path);
+				}
+				break;
+			}
+		}
+
+		if (config.reabrirACada > 0 && (passo + 1) % config.reabrirACada == 0)
+		{
+			closeSession(session);
+			session = abrir(imagem, config);
+		}
+		conferirTudo(session, modelo, config, passo);
+	}
+	closeSession(session);
+
+	// Confere o que foi gravado no arquivo.
+	session = abrir(imagem, config);
+	conferirTudo(session, modelo, config, config.numOperacoes);
+	FS_FRAG_STATS fragmentacao = fragmentationStats(session);
+
+	// Os contadores dos grupos (gravados com groups) têm de bater com o mapa de bits e os inodes.
+	vector<FS_GROUP_INFO> grupos;
+	groupInfo(session, grupos);
+	int blocosLivres = 0;
+	int inodesLivres = 0;
+	for (int i = 0; i < grupos.size(); i++)
+	{
+		blocosLivres += grupos[i].freeBlocks;
+		inodesLivres += grupos[i].freeInodes;
+	}
+	if (blocosLivres != fragmentacao.freeBlocks || inodesLivres != g.numInodes - modelo.inodesUsados)
+	{
+		falhar(config, g, config.numOperacoes, "group counters");
+	}
+	closeSession(session);
+
+	// fsck: mapa de bits, grupos e totais batem com uma contagem completa; statFs (lido do superbloco com counters)
+	// bate com o modelo.
+	vector<string> problemas;
+	if (!checkFs(imagem, problemas))
+	{
+		falhar(config, g, config.numOperacoes, "fsck: " + problemas[0]);
+	}
+	FS_STATFS ocupacao = statFs(imagem);
+	if (ocupacao.freeBlocks != fragmentacao.freeBlocks || ocupacao.freeInodes != g.numInodes - modelo.inodesUsados)
+	{
+		falhar(config, g, config.numOperacoes, "statFs");
+	}
+	if (config.dispositivo == NUM_DISPOSITIVOS - 1)
+	{
+		freeMemoryImage(imagem);
+	}
+	else
+	{
+		std::remove(imagem.c_str());
+	}
+
+	double tempoTotal = 0;
+	int totalOperacoes = 0;
+	printf("geometry %d/%d/%d mode=%s: %d nodes, %d/%d inodes, %d/%d blocks (model)\n", g.blockSize, g.numBlocks, g.numInodes,
+		   config.modo.c_str(), (int)modelo.nos.size(), modelo.inodesUsados, g.numInodes, modelo.blocosUsados, g.numBlocks);
+	printf("  %-9s %8s %8s %12s %10s %10s\n", "op", "count", "ok", "ops/s", "p50(us)", "p99(us)");
+	for (int i = 0; i < NUM_OPERACOES; i++)
+	{
+		double tempo = 0;
+		for (int j = 0; j < estatisticas[i].latencias.size(); j++)
+		{
+			tempo += estatisticas[i].latencias[j];
+		}
+		tempoTotal += tempo;
+		totalOperacoes += estatisticas[i].latencias.size();
+		printf("  %-9s %8d %8d %12.0f %10.2f %10.2f\n", NOMES_OPERACOES[i], (int)estatisticas[i].latencias.size(), estatisticas[i].sucessos,
+			   tempo > 0 ? estatisticas[i].latencias.size() / (tempo / 1e6) : 0.0, percentil(estatisticas[i].latencias, 0.50),
+			   percentil(estatisticas[i].latencias, 0.99));
+	}
+	printf("  %-9s %8d %8s %12.0f\n", "mixed", totalOperacoes, "", tempoTotal > 0 ? totalOperacoes / (tempoTotal / 1e6) : 0.0);
+	printf("  layout policy=%s: %d files, avg extent %.2f blocks, %d fragmented; %d free blocks in %d runs (largest %d)\n",
+		   NOMES_POLITICAS[config.politica], fragmentacao.files, fragmentacao.averageExtentLength, fragmentacao.fragmentedFiles,
+		   fragmentacao.freeBlocks, fragmentacao.freeRuns, fragmentacao.largestFreeRun);
+	printf("  free runs by length:");
+	for (int k = 0; k < 8; k++)
+	{
+		printf(" %d-%d:%d", 1 << k, (2 << k) - 1, fragmentacao.freeRunHistogram[k]);
+	}
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	CONFIGURACAO config;
+	config.semente = 1;
+	config.numOperacoes = 2000;
+	config.reabrirACada = 50;
+	config.modo = "plain";
+	config.politica = FS_ALLOC_FIRST_FIT;
+	config.durabilidade = FS_DURABILITY_NONE;
+	config.sincronizarACada = 0;
+	config.intervaloMs = 0;
+	config.dispositivo = FS_DEVICE_STDIO;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--seed") == 0)
+		{
+			config.semente = strtoull(argv[i + 1], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--ops") == 0)
+		{
+			config.numOperacoes = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--reopen") == 0)
+		{
+			config.reabrirACada = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--mode") == 0)
+		{
+			config.modo = argv[i + 1];
+		}
+		else if (strcmp(argv[i], "--durability") == 0)
+		{
+			for (int d = 0; d < 3; d++)
+			{
+				if (strcmp(argv[i + 1], NOMES_DURABILIDADES[d]) == 0)
+				{
+					config.durabilidade = (FS_DURABILITY)d;
+				}
+			}
+		}
+		else if (strcmp(argv[i], "--sync-ops") == 0)
+		{
+			config.sincronizarACada = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--sync-ms") == 0)
+		{
+			config.intervaloMs = atoi(argv[i + 1]);
+		}
+		else if (strcmp(argv[i], "--device") == 0)
+		{
+			for (int d = 0; d < NUM_DISPOSITIVOS; d++)
+			{
+				if (strcmp(argv[i + 1], NOMES_DISPOSITIVOS[d]) == 0)
+				{
+					config.dispositivo = d;
+				}
+			}
+		}
+		else if (strcmp(argv[i], "--policy") == 0)
+		{
+			for (int p = 0; p < 4; p++)
+			{
+				if (strcmp(argv[i + 1], NOMES_POLITICAS[p]) == 0)
+				{
+					config.politica = (FS_ALLOC_POLICY)p;
+				}
+			}
+		}
+	}
+
+	printf("seed=%llu ops=%d reopen=%d mode=%s policy=%s durability=%s sync-ops=%d sync-ms=%d device=%s\n", config.semente, config.numOperacoes,
+		   config.reabrirACada, config.modo.c_str(), NOMES_POLITICAS[config.politica], NOMES_DURABILIDADES[config.durabilidade],
+		   config.sincronizarACada, config.intervaloMs, NOMES_DISPOSITIVOS[config.dispositivo]);
+	for (int i = 0; i < sizeof(GEOMETRIAS) / sizeof(GEOMETRIAS[0]); i++)
+	{
+		executarGeometria(GEOMETRIAS[i], config);
+	}
+	return 0;
+}
@@ -0,0 +1,292 @@
+// Autor: Helder Henrique da Silva
+// Descrição: Formato do trace das chamadas de fs.h: uma linha JSON por chamada, com os campos sempre na mesma ordem.
+//
+//   {"t":120,"op":"addFile","image":"fs.bin","path":"/a.txt","size":5,"content":"hello","lat":35,"ok":true}
+//   {"t":0,"op":"initFs","image":"fs.bin","blockSize":4,"numBlocks":32,"numInodes":8,"features":0,"lat":80,"ok":true}
+//   {"t":310,"op":"writeAt","image":"fs.bin","path":"/a.txt","offset":2,"size":1,"content":"X","lat":12,"ok":true}
+//
+// O conteúdo é uma sequência de bytes, não de caracteres: bytes de controle e fora do ASCII são escritos como \u00XX e
+// lidos de volta como um byte.
+//
+// Copyright (C) 2022 Helder Henrique da Silva. Todos os direitos reservados.
+
+#ifndef traco_hpp
+#define traco_hpp
+
+#include "fsExt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+
+using namespace std;
+
+// Função para escrever uma string JSON, escapando aspas, barras invertidas e bytes de controle ou fora do ASCII.
+void escreverStringJson(string &saida, const string &valor)
+{
+  saida += '"';
+  for (size_t i = 0; i < valor.size(); i++)
+  {
+    unsigned char c = valor[i];
+    if (c == '"' || c == '\\')
+    {
+      saida += '\\';
+      saida += c;
+    }
+    else if (c < 0x20 || c >= 0x7F)
+    {
+      char escape[8];
+      snprintf(escape, sizeof(escape), "\\u%04x", c);
+      saida += escape;
+    }
+    else
+    {
+      saida += c;
+    }
+  }
+  saida += '"';
+}
+
+/**
+ * @brief Lê uma string JSON a partir da posição das aspas iniciais.
+ * @param linha texto.
+ * @param posicao posição das aspas; avança para depois das aspas finais.
+ * @param valor bytes da string.
+ * @return false se a string não terminar ou tiver um escape inválido (ou \u acima de 00FF).
+ */
+bool lerStringJson(const string &linha, size_t &posicao, string &valor)
+{
+  valor.clear();
+  if (posicao >= linha.size() || linha[posicao] != '"')
+  {
+    return false;
+  }
+  for (posicao++; posicao < linha.size(); posicao++)
+  {
+    char c = linha[posicao];
+    if (c == '"')
+    {
+      posicao++;
+      return true;
+    }
+    if (c != '\\')
+    {
+      valor += c;
+      continue;
+    }
+    if (++posicao >= linha.size())
+    {
+      return false;
+    }
+    switch (linha[posicao])
+    {
+    case 'n':
+      valor += '\n';
+      break;
+    case 't':
+      valor += '\t';
+      break;
+    case 'r':
+      valor += '\r';
+      break;
+    case 'b':
+      valor += '\b';
+      break;
+    case 'f':
+      valor += '\f';
+      break;
+    case 'u':
+    {
+      if (posicao + 4 >= linha.size())
+      {
+        return false;
+      }
+      char *fim;
+      string hexa = linha.substr(posicao + 1, 4);
+      long codigo = strtol(hexa.c_str(), &fim, 16);
+      if (*fim != '\0' || codigo > 0xFF)
+      {
+        return false;
+      }
+      valor += (char)codigo;
+      posicao += 4;
+      break;
+    }
+    default:
+      valor += linha[posicao];
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Lê um objeto JSON de um nível (valores string, número, true ou false).
+ * @param linha texto do objeto.
+ * @param campos valor de cada chave; números e literais ficam como texto.
+ * @return false se o objeto for inválido.
+ */
+bool lerObjetoJson(const string &linha, map<string, string> &campos)
+{
+  campos.clear();
+  size_t posicao = linha.find_first_not_of(" \t\r");
+  if (posicao == string::npos || linha[posicao] != '{')
+  {
+    return false;
+  }
+  posicao = linha.find_first_not_of(" \t\r", posicao + 1);
+  if (posicao != string::npos && linha[posicao] == '}')
+  {
+    return true;
+  }
+  while (posicao != string::npos)
+  {
+    string chave, valor;
+    if (!lerStringJson(linha, posicao, chave))
+    {
+      return false;
+    }
+    posicao = linha.find_first_not_of(" \t\r", posicao);
+    if (posicao == string::npos || linha[posicao] != ':')
+    {
+      return false;
+    }
+    posicao = linha.find_first_not_of(" \t\r", posicao + 1);
+    if (posicao == string::npos)
+    {
+      return false;
+    }
+    if (linha[posicao] == '"')
+    {
+      if (!lerStringJson(linha, posicao, valor))
+      {
+        return false;
+      }
+    }
+    else
+    {
+      size_t fim = linha.find_first_of(",} \t\r", posicao);
+      if (fim == string::npos || fim == posicao)
+      {
+        return false;
+      }
+      valor = linha.substr(posicao, fim - posicao);
+      posicao = fim;
+    }
+    campos[chave] = valor;
+
+    posicao = linha.find_first_not_of(" \t\r", posicao);
+    if (posicao == string::npos)
+    {
+      return false;
+    }
+    if (linha[posicao] == '}')
+    {
+      return true;
+    }
+    if (linha[posicao] != ',')
+    {
+      return false;
+    }
+    posicao = linha.find_first_not_of(" \t\r", posicao + 1);
+  }
+  return false;
+}
+
+/**
+ * @brief Monta a linha do trace de uma chamada.
+ * @param registro chamada registrada.
+ * @param comConteudo false: o conteúdo de addFile, writeAt e append não é gravado, só o tamanho.
+ * @return linha JSON terminada em '\n'.
+ */
+string linhaDoTraco(const FS_TRACE_RECORD &registro, bool comConteudo)
+{
+  string linha = "{\"t\":" + to_string(registro.timeUs) + ",\"op\":\"" + FS_TRACE_OP_NAMES[registro.op] + "\",\"image\":";
+  escreverStringJson(linha, registro.image);
+  if (registro.op == FS_TRACE_INIT)
+  {
+    linha += ",\"blockSize\":" + to_string(registro.blockSize) + ",\"numBlocks\":" + to_string(registro.numBlocks) +
+             ",\"numInodes\":" + to_string(registro.numInodes) + ",\"features\":" + to_string(registro.features);
+  }
+  else
+  {
+    linha += ",\"path\":";
+    escreverStringJson(linha, registro.path);
+  }
+  if (registro.op == FS_TRACE_MOVE)
+  {
+    linha += ",\"newPath\":";
+    escreverStringJson(linha, registro.newPath);
+  }
+  bool escrita = registro.op == FS_TRACE_ADD_FILE || registro.op == FS_TRACE_WRITE_AT || registro.op == FS_TRACE_APPEND;
+  if (registro.op == FS_TRACE_WRITE_AT)
+  {
+    linha += ",\"offset\":" + to_string(registro.offset);
+  }
+  if (escrita || registro.op == FS_TRACE_READ_FILE)
+  {
+    linha += ",\"size\":" + to_string(registro.size);
+  }
+  if (escrita && comConteudo && registro.hasContent)
+  {
+    linha += ",\"content\":";
+    escreverStringJson(linha, registro.content);
+  }
+  linha += ",\"lat\":" + to_string(registro.latencyUs) + ",\"ok\":" + (registro.ok ? "true" : "false") + "}\n";
+  return linha;
+}
+
+// Registro vazio de uma chamada.
+FS_TRACE_RECORD novoRegistro(FS_TRACE_OP op, const string &imagem, bool ok)
+{
+  FS_TRACE_RECORD registro;
+  registro.op = op;
+  registro.timeUs = 0;
+  registro.latencyUs = 0;
+  registro.ok = ok;
+  registro.image = imagem;
+  registro.size = 0;
+  registro.hasContent = false;
+  registro.offset = 0;
+  registro.blockSize = registro.numBlocks = registro.numInodes = registro.features = 0;
+  return registro;
+}
+
+/**
+ * @brief Interpreta uma linha do trace.
+ * @param linha linha JSON.
+ * @param registro chamada lida.
+ * @return false se a linha for inválida ou a operação desconhecida.
+ */
+bool registroDaLinha(const string &linha, FS_TRACE_RECORD &registro)
+{
+  map<string, string> campos;
+  if (!lerObjetoJson(linha, campos) || !campos.count("op") || !campos.count("image") || !campos.count("t"))
+  {
+    return false;
+  }
+  int op = 0;
+  while (op < FS_TRACE_NUM_OPS && campos["op"] != FS_TRACE_OP_NAMES[op])
+  {
+    op++;
+  }
+  if (op == FS_TRACE_NUM_OPS)
+  {
+    return false;
+  }
+  registro = novoRegistro((FS_TRACE_OP)op, campos["image"], campos["ok"] != "false");
+  registro.timeUs = atol(campos["t"].c_str());
+  registro.latencyUs = atol(campos["lat"].c_str());
+  registro.path = campos["path"];
+  registro.newPath = campos["newPath"];
+  registro.size = atoi(campos["size"].c_str());
+  registro.hasContent = campos.count("content") > 0;
+  registro.content = campos["content"];
+  registro.offset = atoi(campos["offset"].c_str());
+  registro.blockSize = atoi(campos["blockSize"].c_str());
+  registro.numBlocks = atoi(campos["numBlocks"].c_str());
+  registro.numInodes = atoi(campos["numInodes"].c_str());
+  registro.features = atoi(campos["features"].c_str());
+  return true;
+}
+
+#endif /* traco_hpp */